@@ -0,0 +1,187 @@
+/*
+ *  fake_ytdlp.c  —  scripted stand-in for yt-dlp (and a media player).
+ *
+ *  Installed as bench/bin/yt-dlp it answers the invocations ytplay makes
+ *  without touching the network:
+ *
+ *    --version                        prints a version
+ *    --dump-json ytsearchN:QUERY      N NDJSON result lines (honours -I A:B)
+ *    -g URL                           a video and an audio googlevideo URL
+ *    -o TEMPLATE URL                  writes a file, reports progress (and
+ *                                     its path with --print-to-file)
+ *
+ *  Installed under any other name (bench/bin/fakeplayer) it behaves like
+ *  a player that exits straight away.
+ *
+ *  Tunables (environment):
+ *    YTSTUB_RESULTS     cap on emitted results            (default: N)
+ *    YTSTUB_LINE_SIZE   bytes per JSON line               (default 2048)
+ *    YTSTUB_GIANT       every Kth line is ~500 KB          (default 0 = never)
+ *    YTSTUB_DELAY_MS    sleep before each line            (default 0)
+ *    YTSTUB_STARTUP_MS  sleep before any output           (default 0)
+ *    YTSTUB_FILE_SIZE   bytes written by a download       (default 1 MB)
+ *    YTSTUB_PLAY_MS     how long the player "plays"       (default 0)
+ *    YTSTUB_STATS       file to append "<bytes emitted>\n" to
+ *
+ *  Build: make bench (part of it)
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GIANT_LINE (500*1024)
+
+static long env_long(const char *name, long def) {
+    const char *v=getenv(name);
+    return v && *v ? atol(v) : def;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    if (ms<=0) return;
+    ts.tv_sec=ms/1000; ts.tv_nsec=(ms%1000)*1000000L;
+    nanosleep(&ts,NULL);
+}
+
+static const char *arg_after(int argc, char **argv, const char *flag) {
+    for (int i=1; i<argc-1; i++) if (!strcmp(argv[i],flag)) return argv[i+1];
+    return NULL;
+}
+
+static int has_arg(int argc, char **argv, const char *flag) {
+    for (int i=1; i<argc; i++) if (!strcmp(argv[i],flag)) return 1;
+    return 0;
+}
+
+/*
+ *  One flat-playlist result line padded to `size` bytes. The padding goes
+ *  into "description" and a "thumbnails" array placed before the fields
+ *  ytplay wants, like real yt-dlp output.
+ */
+static const char *build_result(const char *query, int i, size_t size, size_t *len) {
+    static char *buf;
+    static size_t cap;
+    char head[1024], tail[1024];
+    int hn, tn;
+    size_t pad;
+
+    hn=snprintf(head,sizeof(head),
+        "{\"_type\": \"url\", \"ie_key\": \"Youtube\", \"id\": \"bench%06d\", "
+        "\"url\": \"https://www.youtube.com/watch?v=bench%06d\", "
+        "\"thumbnails\": [{\"url\": \"https://i.ytimg.com/vi/bench%06d/hqdefault.jpg\", \"height\": 202, \"width\": 360}], "
+        "\"description\": \"",i,i,i);
+    tn=snprintf(tail,sizeof(tail),
+        "\", \"title\": \"%s \\u2014 result #%d\", \"duration\": %d, "
+        "\"channel\": \"Bench Channel %d\", \"channel_id\": \"UCbench\", "
+        "\"view_count\": %ld, \"live_status\": null}\n",
+        query,i,60*i+7,i%7,1234L*i*i);
+    pad = size>(size_t)(hn+tn) ? size-(size_t)(hn+tn) : 0;
+    if (cap<(size_t)(hn+tn)+pad+1) {
+        cap=(size_t)(hn+tn)+pad+1;
+        buf=(char*)realloc(buf,cap);
+        if (!buf) exit(3);
+    }
+    memcpy(buf,head,(size_t)hn);
+    for (size_t k=0; k<pad; k++) buf[hn+k] = (k%64==63) ? ' ' : (char)('a'+k%26);
+    memcpy(buf+hn+pad,tail,(size_t)tn);
+    *len=(size_t)hn+pad+(size_t)tn;
+    return buf;
+}
+
+static int do_search(int argc, char **argv, const char *spec) {
+    int n=atoi(spec+8), first=1, last;
+    const char *q=strchr(spec,':'), *items=arg_after(argc,argv,"-I");
+    long cap=env_long("YTSTUB_RESULTS",-1), size=env_long("YTSTUB_LINE_SIZE",2048);
+    long giant=env_long("YTSTUB_GIANT",0), delay=env_long("YTSTUB_DELAY_MS",0);
+    size_t bytes=0, len;
+    const char *line;
+    char query[256];
+
+    if (n<1) n=1;
+    snprintf(query,sizeof(query),"%s",q ? q+1 : "query");
+    for (char *p=query; *p; p++) if (*p=='"' || *p=='\\') *p='_';
+    last=n;
+    if (!items) items=arg_after(argc,argv,"--playlist-items");
+    if (items) sscanf(items,"%d:%d",&first,&last);
+    if (last>n) last=n;
+    if (cap>=0 && last>cap) last=(int)cap;
+
+    /* recorded up front: ytplay may stop reading once it has enough */
+    const char *stats=getenv("YTSTUB_STATS");
+    if (stats) {
+        FILE *f=fopen(stats,"a");
+        for (int i=first; i<=last; i++) {
+            build_result(query,i,(giant>0 && i%giant==0) ? GIANT_LINE : (size_t)size,&len);
+            bytes+=len;
+        }
+        if (f) { fprintf(f,"%lu\n",(unsigned long)bytes); fclose(f); }
+    }
+    for (int i=first; i<=last; i++) {
+        sleep_ms(delay);
+        line=build_result(query,i,(giant>0 && i%giant==0) ? GIANT_LINE : (size_t)size,&len);
+        fwrite(line,1,len,stdout);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static int do_geturl(const char *url) {
+    const char *id=strstr(url,"v=");
+    long exp=(long)time(NULL)+6*3600;
+    id = id ? id+2 : url;
+    printf("https://rr1---sn-bench.googlevideo.com/videoplayback?expire=%ld&id=%s&itag=137&dur=67.000\n",exp,id);
+    printf("https://rr1---sn-bench.googlevideo.com/videoplayback?expire=%ld&id=%s&itag=140&dur=67.000\n",exp,id);
+    return 0;
+}
+
+static int do_download(int argc, char **argv) {
+    const char *tmpl=arg_after(argc,argv,"-o"), *url=argv[argc-1], *id=strstr(url,"v=");
+    long size=env_long("YTSTUB_FILE_SIZE",1024*1024), chunk=64*1024, done=0;
+    char path[2048], *o=path;
+    static char block[64*1024];
+    FILE *f;
+
+    id = id ? id+2 : "bench";
+    if (!tmpl) tmpl="%(title)s.%(ext)s";
+    for (const char *t=tmpl; *t && o<path+sizeof(path)-64; ) {
+        if      (!strncmp(t,"%(title)s",9)) { o+=sprintf(o,"Bench %s",id); t+=9; }
+        else if (!strncmp(t,"%(id)s",6))    { o+=sprintf(o,"%s",id);       t+=6; }
+        else if (!strncmp(t,"%(ext)s",7))   { o+=sprintf(o,"mp4");         t+=7; }
+        else *o++=*t++;
+    }
+    *o='\0';
+
+    printf("[youtube] Extracting URL: %s\n[download] Destination: %s\n",url,path);
+    fflush(stdout);
+    if (!(f=fopen(path,"wb"))) { fprintf(stderr,"ERROR: cannot write %s\n",path); return 1; }
+    memset(block,'x',sizeof(block));
+    while (done<size) {
+        long w = size-done<chunk ? size-done : chunk;
+        fwrite(block,1,(size_t)w,f);
+        done+=w;
+        printf("[ytplay] %ld %ld NA\n",done,size);
+    }
+    fclose(f);
+    for (int i=1; i<argc-2; i++)
+        if (!strcmp(argv[i],"--print-to-file") && !strcmp(argv[i+1],"after_move:filepath")) {
+            FILE *r=fopen(argv[i+2],"a");
+            if (r) { fprintf(r,"%s\n",path); fclose(r); }
+        }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *self=strrchr(argv[0],'/');
+    self = self ? self+1 : argv[0];
+    if (strcmp(self,"yt-dlp")) { sleep_ms(env_long("YTSTUB_PLAY_MS",0)); return 0; }
+
+    if (has_arg(argc,argv,"--version")) { puts("2099.01.01"); return 0; }
+    sleep_ms(env_long("YTSTUB_STARTUP_MS",0));
+    for (int i=1; i<argc; i++)
+        if (!strncmp(argv[i],"ytsearch",8)) return do_search(argc,argv,argv[i]);
+    if (argc<2) return 2;
+    if (has_arg(argc,argv,"-g")) return do_geturl(argv[argc-1]);
+    return do_download(argc,argv);
+}
@@ -0,0 +1,166 @@
+/*
+ *  json_bench.c  —  JSON field extraction throughput, old vs new.
+ *
+ *  Compares the single-pass json_fields() tokenizer in ytplay.c against
+ *  the strstr-per-key json_get() it replaced, on synthetic yt-dlp
+ *  --dump-json lines of increasing size. The wanted keys sit at the end
+ *  of the object behind a large "thumbnails" array and "description",
+ *  which is the worst case for strstr and the common case in practice.
+ *
+ *  Build & run:  make bench-json
+ */
+#define main ytplay_main
+#include "../ytplay.c"
+#undef main
+
+/* ─── The pre-tokenizer extractor, verbatim ──────────────────── */
+static int legacy_json_get(const char *json, const char *key, char *out, size_t outlen) {
+    char pat[256];
+    snprintf(pat, sizeof(pat), "\"%s\"", key);
+    const char *p = json;
+    while ((p = strstr(p, pat)) != NULL) {
+        const char *before = p - 1;
+        while (before > json && (*before==' '||*before=='\t')) before--;
+        if (before >= json && *before != '{' && *before != ',') { p++; continue; }
+
+        p += strlen(pat);
+        while (*p==' '||*p=='\t') p++;
+        if (*p != ':') continue;
+        p++;
+        while (*p==' '||*p=='\t') p++;
+
+        if (*p == '"') {
+            p++;
+            size_t i = 0;
+            while (*p && *p!='"' && i<outlen-1) {
+                if (*p=='\\' && *(p+1)) {
+                    p++;
+                    switch (*p) {
+                        case 'n':  out[i++]='\n'; break;
+                        case 't':  out[i++]='\t'; break;
+                        case '\\': out[i++]='\\'; break;
+                        case '"':  out[i++]='"';  break;
+                        case '/':  out[i++]='/';  break;
+                        default:   out[i++]='?';  break;
+                    }
+                    p++;
+                } else out[i++] = *p++;
+            }
+            out[i] = '\0';
+            return 1;
+        } else if (isdigit((unsigned char)*p) || *p=='-') {
+            size_t i = 0;
+            while ((*p=='-'||isdigit((unsigned char)*p)) && i<outlen-1)
+                out[i++] = *p++;
+            out[i] = '\0';
+            return 1;
+        } else if (strncmp(p,"null",4)==0 || strncmp(p,"false",5)==0 ||
+                   strncmp(p,"true",4)==0) {
+            out[0] = '\0';
+            return 0;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+/* ─── Synthetic yt-dlp line of roughly `size` bytes ──────────── */
+/*
+ *  Shaped like real output: a thumbnails array, then (for the big
+ *  sizes) a formats array of googlevideo URLs with nested http_headers,
+ *  then a description with the usual \n and \u escapes, and the fields
+ *  we want last. One thumbnail carries a nested "title" key, which the
+ *  strstr extractor wrongly returns.
+ */
+static char *make_line(size_t size, size_t *len) {
+    Buf b={0};
+    char tmp[2048];
+    const char *head="{\"_type\": \"url\", \"ie_key\": \"Youtube\", \"thumbnails\": [";
+    buf_put(&b,head,strlen(head));
+    for (int i=0; i<8; i++) {
+        int n=snprintf(tmp,sizeof(tmp),"%s{\"url\": \"https://i.ytimg.com/vi/dQw4w9WgXcQ/hqdefault.jpg?sqp=-oaymwEcCNACELwBSFXyq4qpAw4IARUAAIhCGAFwAcABBg==&rs=AOn4CLB%d\", \"height\": %d, \"width\": %d%s}",
+                     i?", ":"", i, 90+i, 160+i, i==3?", \"title\": \"nested thumbnail title\"":"");
+        buf_put(&b,tmp,(size_t)n);
+    }
+    buf_put(&b,"], \"formats\": [",15);
+    for (int i=0; b.len < size*3/4; i++) {
+        int n=snprintf(tmp,sizeof(tmp),"%s{\"format_id\": \"%d\", \"url\": \"https://rr3---sn-4g5ednsz.googlevideo.com/videoplayback?expire=1700000000&ei=abcDEFghiJKL&ip=203.0.113.7&id=o-ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789abcdefghij&itag=%d&source=youtube&requiressl=yes&mh=7c&mm=31%%2C29&mn=sn-4g5ednsz&ms=au%%2Crdu&mv=m&mvi=3&pl=24&initcwndbps=1234567&vprv=1&mime=video%%2Fmp4&gir=yes&clen=%d&dur=212.040&lmt=1699999999999999&mt=1699999999&fvip=3&keepalive=yes&c=ANDROID&txp=5535434&sparams=expire%%2Cei%%2Cip%%2Cid%%2Citag%%2Csource%%2Crequiressl&sig=AOq0QJ8wRQIhAKz%d\", \"ext\": \"mp4\", \"height\": %d, \"tbr\": %d.5, \"http_headers\": {\"User-Agent\": \"Mozilla/5.0 (X11; Linux x86_64)\", \"Accept\": \"text/html,application/xhtml+xml\", \"Accept-Language\": \"en-us,en;q=0.5\"}, \"downloader_options\": {\"http_chunk_size\": 10485760}}",
+                     i?", ":"", 100+i, 100+i, 1000000+i, i, 144+i, 100+i);
+        buf_put(&b,tmp,(size_t)n);
+    }
+    const char *desc="], \"description\": \"";
+    buf_put(&b,desc,strlen(desc));
+    while (b.len < size-400) {
+        const char *chunk="Official music video, remastered in 4K. Listen to more from the album and subscribe.\\n"
+                          "Caf\\u00e9 sessions \\u2014 recorded live \\ud83c\\udfb5 \\\"Never gonna give you up\\\".\\n";
+        buf_put(&b,chunk,strlen(chunk));
+    }
+    const char *tail="\", \"title\": \"Rick Astley - Never Gonna Give You Up (Official Music Video) \\u2014 4K Remaster\","
+                     " \"id\": \"dQw4w9WgXcQ\", \"duration\": 212.0, \"channel\": \"Rick Astley\","
+                     " \"uploader\": \"Rick Astley\", \"view_count\": 1467382915}\n";
+    buf_put(&b,tail,strlen(tail)+1);
+    *len=b.len-1;
+    return (char*)b.p;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static volatile size_t g_sink;
+
+/* called through volatile pointers so the compiler can't hoist or fold them */
+static int (*volatile legacy_get)(const char*, const char*, char*, size_t) = legacy_json_get;
+static int (*volatile single_pass)(const char*, size_t, JsonField*, int, int) = json_fields;
+
+int main(void) {
+    static const size_t sizes[] = { 2*1024, 64*1024, 512*1024 };
+    printf("%-10s %-8s %12s %12s %8s\n","line","iters","legacy MB/s","single MB/s","speedup");
+    for (size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        size_t len;
+        char *line=make_line(sizes[s],&len);
+        int iters=(int)((64u*1024*1024)/len);
+        char title[512], id[32], dur[32], views[32], chan[128], upl[128];
+
+        double best_old=1e9, best_new=1e9;
+        char legacy_title[512];
+        for (int rep=0; rep<5; rep++) {                 /* best of 5 */
+            double t0=now_s();
+            for (int i=0; i<iters; i++) {
+                legacy_get(line,"title",title,sizeof(title));
+                legacy_get(line,"id",id,sizeof(id));
+                legacy_get(line,"duration",dur,sizeof(dur));
+                legacy_get(line,"view_count",views,sizeof(views));
+                if (!legacy_get(line,"channel",chan,sizeof(chan)))
+                    legacy_get(line,"uploader",upl,sizeof(upl));
+                g_sink+=(size_t)title[0];
+            }
+            double t1=now_s();
+            memcpy(legacy_title,title,sizeof(title));
+            for (int i=0; i<iters; i++) {
+                JsonField f[] = {
+                    { "title", title, sizeof(title), 0 }, { "id", id, sizeof(id), 0 },
+                    { "duration", dur, sizeof(dur), 0 },  { "view_count", views, sizeof(views), 0 },
+                    { "channel", chan, sizeof(chan), 0 }, { "uploader", upl, sizeof(upl), 0 },
+                };
+                single_pass(line,len,f,6,5);
+                g_sink+=(size_t)title[0];
+            }
+            double t2=now_s();
+            if (t1-t0<best_old) best_old=t1-t0;
+            if (t2-t1<best_new) best_new=t2-t1;
+        }
+
+        double mb=(double)len*iters/(1024.0*1024.0);
+        char label[32]; snprintf(label,sizeof(label),"%luK",(unsigned long)(len/1024));
+        printf("%-10s %-8d %12.0f %12.0f %7.1fx\n",label,iters,mb/best_old,mb/best_new,best_old/best_new);
+        if (s==0) {
+            printf("  legacy title: %s\n",legacy_title);
+            printf("  single title: %s\n",title);
+        }
+        free(line);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#!/bin/sh
+#
+#  run.sh  —  offline end-to-end benchmark of ytplay (make bench).
+#
+#  Puts bench/bin (fake yt-dlp + fake player) first on PATH, runs each
+#  scenario RUNS times through ytbench and writes a TSV to
+#  bench/results/<timestamp>.tsv:
+#
+#    name  runs  wall_ms  ttfr_ms  parse_mb_s  rss_kb
+#
+#  With BASELINE=<old tsv> every metric is compared against it; a
+#  slowdown (or RSS growth) of more than THRESHOLD percent is reported
+#  and the script exits non-zero. Times must also move by at least
+#  2 ms and RSS by 512 KB, so sub-millisecond jitter is not a regression.
+#
+#    make bench
+#    make bench BASELINE=bench/results/20240101-120000.tsv THRESHOLD=10
+#
+set -eu
+
+cd "$(dirname "$0")/.."
+RUNS=${RUNS:-5}
+THRESHOLD=${THRESHOLD:-10}
+BASELINE=${BASELINE:-}
+mkdir -p bench/results
+OUT=${OUT:-bench/results/$(date +%Y%m%d-%H%M%S).tsv}
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT INT TERM
+PATH="$PWD/bench/bin:$PATH"
+XDG_CACHE_HOME="$TMP/cache"
+export PATH XDG_CACHE_HOME
+unset YTSTUB_RESULTS YTSTUB_LINE_SIZE YTSTUB_GIANT YTSTUB_DELAY_MS YTSTUB_STARTUP_MS
+export YTSTUB_STATS="$TMP/stats"
+
+# --no-daemon: time ytplay itself, not a daemon that happens to be running
+YTPLAY="./ytplay --no-banner --quiet --no-daemon -p fakeplayer --trace $TMP/trace.json"
+
+# scenario NAME [VAR=value ...] -- ytplay arguments
+scenario() {
+    name=$1; shift
+    vars=""
+    while [ "$1" != "--" ]; do vars="$vars $1"; shift; done
+    shift
+    # shellcheck disable=SC2086
+    env $vars ./bench/bin/ytbench "$name" "$RUNS" "$TMP/trace.json" "$YTSTUB_STATS" -- $YTPLAY "$@" >>"$OUT"
+    tail -n 1 "$OUT"
+}
+
+seq 1 32 | sed 's/^/batch query /' >"$TMP/queries"
+printf 'name\truns\twall_ms\tttfr_ms\tparse_mb_s\trss_kb\n' >"$OUT"
+printf '  %-14s %4s %9s %9s %11s %8s\n' scenario runs wall_ms ttfr_ms parse_mb_s rss_kb
+
+{
+    # list only: search, render, quit at EOF on stdin
+    scenario search-8      YTSTUB_LINE_SIZE=2048                      -- --no-cache -n 8  "bench query"
+    scenario search-25     YTSTUB_LINE_SIZE=4096                      -- --no-cache -n 25 "bench query"
+    scenario slow-25       YTSTUB_LINE_SIZE=4096 YTSTUB_DELAY_MS=20   -- --no-cache -n 25 "bench query"
+    scenario giant-25      YTSTUB_LINE_SIZE=4096 YTSTUB_GIANT=5       -- --no-cache -n 25 "bench query"
+    scenario startup-200   YTSTUB_STARTUP_MS=200                      -- --no-cache -n 8  "bench query"
+    # warm caches: one priming run, then the measured ones
+    $YTPLAY -n 8 "cached query" </dev/null >/dev/null
+    scenario cached-8      YTSTUB_LINE_SIZE=2048                      -- -n 8 "cached query"
+    # first result straight to the (non-native) player: search + -g + launch
+    scenario play-first    YTSTUB_LINE_SIZE=2048                      -- --no-cache --no-prefetch -1 "bench query"
+    # 32 queries, 8 searches at a time, NDJSON to stdout
+    scenario batch-32      YTSTUB_LINE_SIZE=2048 YTSTUB_DELAY_MS=5    -- --no-cache -n 8 -j 8 --batch "$TMP/queries"
+    scenario bulk-8        YTSTUB_FILE_SIZE=4194304                   -- --no-cache -n 8 --select all -j 4 -o "$TMP/dl" "bench query"
+} | while IFS='	' read -r n r w t p m; do
+    printf '  %-14s %4s %9s %9s %11s %8s\n' "$n" "$r" "$w" "$t" "$p" "$m"
+done
+
+echo
+echo "  Results: $OUT"
+
+[ -n "$BASELINE" ] || exit 0
+[ -f "$BASELINE" ] || { echo "  Baseline $BASELINE not found" >&2; exit 2; }
+
+# Compare: wall/ttfr/rss lower is better, parse throughput higher is better.
+awk -F'\t' -v thr="$THRESHOLD" '
+    FNR==1 { next }
+    NR==FNR { for (i=3; i<=6; i++) base[$1,i]=$i; seen[$1]=1; next }
+    !($1 in seen) { printf "  %-14s (new scenario)\n", $1; next }
+    {
+        split("wall_ms ttfr_ms parse_mb_s rss_kb", col, " ")
+        line=sprintf("  %-14s", $1)
+        for (i=3; i<=6; i++) {
+            b=base[$1,i]; c=$i
+            if (b=="-" || c=="-" || b==0) { line=line sprintf(" %s      -   ", col[i-2]); continue }
+            d=(c-b)*100/b
+            worse = (i==5) ? -d : d
+            floor = (i==6) ? 512 : 2
+            if (i!=5 && c-b<floor) worse=0
+            flag = worse>thr ? " !" : "  "
+            if (worse>thr) bad++
+            line=line sprintf(" %s %+6.1f%%%s", col[i-2], d, flag)
+        }
+        print line
+    }
+    END {
+        if (bad) { printf "\n  %d metric(s) regressed by more than %s%% against the baseline\n", bad, thr; exit 1 }
+        printf "\n  No regressions beyond %s%%\n", thr
+    }
+' "$BASELINE" "$OUT"
@@ -0,0 +1,131 @@
+/*
+ *  ytbench.c  —  run one benchmark scenario and print a result row.
+ *
+ *    ytbench NAME RUNS TRACE STATS -- ytplay [args...]
+ *
+ *  Runs the command RUNS times with stdin and stdout on /dev/null and
+ *  prints one tab-separated line:
+ *
+ *    name  runs  wall_ms  ttfr_ms  parse_mb_s  rss_kb
+ *
+ *  wall_ms    median wall-clock time of the whole run
+ *  ttfr_ms    median time to the first parsed result, read from the
+ *             Chrome trace the command writes to TRACE (--trace)
+ *  parse_mb_s search bytes emitted by the fake yt-dlp (summed from
+ *             STATS) over the total "json.parse" time in the trace
+ *  rss_kb     peak resident set size of ytplay, max over the runs
+ *
+ *  Columns that don't apply to a scenario are "-".
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_RUNS 64
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec*1e3 + ts.tv_nsec/1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double d=*(const double*)a-*(const double*)b;
+    return d<0 ? -1 : d>0;
+}
+
+static double median(double *v, int n) {
+    qsort(v,(size_t)n,sizeof(double),cmp_double);
+    return n%2 ? v[n/2] : (v[n/2-1]+v[n/2])/2;
+}
+
+/* Numeric value of "key": on a trace line, or -1. */
+static double trace_num(const char *line, const char *key) {
+    const char *p=strstr(line,key);
+    return p ? atof(p+strlen(key)) : -1;
+}
+
+/* First-result timestamp and summed json.parse time from a trace, in µs. */
+static void read_trace(const char *path, double *ttfr, double *parse) {
+    char line[1024];
+    FILE *f=fopen(path,"r");
+    *ttfr=-1; *parse=0;
+    if (!f) return;
+    while (fgets(line,sizeof(line),f)) {
+        if (strstr(line,"\"name\":\"search.first_result\"") && *ttfr<0)
+            *ttfr=trace_num(line,"\"ts\":");
+        else if (strstr(line,"\"name\":\"json.parse\""))
+            *parse+=trace_num(line,"\"dur\":");
+    }
+    fclose(f);
+}
+
+static double read_stats(const char *path) {
+    double total=0, v;
+    FILE *f=fopen(path,"r");
+    if (!f) return 0;
+    while (fscanf(f,"%lf",&v)==1) total+=v;
+    fclose(f);
+    return total;
+}
+
+int main(int argc, char **argv) {
+    double wall[MAX_RUNS], ttfr[MAX_RUNS], mbps[MAX_RUNS];
+    int nttfr=0, nmbps=0;
+    long rss=0;
+
+    if (argc<7 || strcmp(argv[5],"--")) {
+        fprintf(stderr,"usage: ytbench NAME RUNS TRACE STATS -- command [args...]\n");
+        return 2;
+    }
+    const char *name=argv[1], *trace=argv[3], *stats=argv[4];
+    int runs=atoi(argv[2]);
+    if (runs<1) runs=1;
+    if (runs>MAX_RUNS) runs=MAX_RUNS;
+
+    for (int r=0; r<runs; r++) {
+        struct rusage ru;
+        int st;
+        remove(trace); remove(stats);
+        double t0=now_ms();
+        pid_t pid=fork();
+        if (pid<0) { perror("fork"); return 1; }
+        if (pid==0) {
+            int nul=open("/dev/null",O_RDWR);
+            dup2(nul,0); dup2(nul,1);
+            execvp(argv[6],argv+6);
+            _exit(127);
+        }
+        if (wait4(pid,&st,0,&ru)<0) { perror("wait4"); return 1; }
+        wall[r]=now_ms()-t0;
+        if (!WIFEXITED(st) || WEXITSTATUS(st)!=0) {
+            fprintf(stderr,"ytbench: %s: run %d exited with status %d\n",name,r+1,
+                    WIFEXITED(st) ? WEXITSTATUS(st) : -1);
+            return 1;
+        }
+#ifdef __APPLE__
+        if (ru.ru_maxrss/1024>rss) rss=ru.ru_maxrss/1024;    /* bytes there */
+#else
+        if (ru.ru_maxrss>rss) rss=ru.ru_maxrss;
+#endif
+        double first, parse, bytes=read_stats(stats);
+        read_trace(trace,&first,&parse);
+        if (first>=0) ttfr[nttfr++]=first/1e3;
+        if (parse>0 && bytes>0) mbps[nmbps++]=bytes/1048576.0/(parse/1e6);
+    }
+
+    printf("%s\t%d\t%.1f\t",name,runs,median(wall,runs));
+    if (nttfr) printf("%.1f\t",median(ttfr,nttfr)); else printf("-\t");
+    if (nmbps) printf("%.1f\t",median(mbps,nmbps)); else printf("-\t");
+    printf("%ld\n",rss);
+    remove(trace); remove(stats);
+    return 0;
+}
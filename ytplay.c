@@ -17,9 +17,12 @@
  *    - mpv / vlc / ffplay / iina
  */
 
-/* popen/pclose on POSIX */
+/* posix_spawn, poll, waitpid on POSIX; splice and pipe sizing on Linux */
 #if !defined(_WIN32)
 #  define _POSIX_C_SOURCE 200809L
+#  ifdef __linux__
+#    define _GNU_SOURCE
+#  endif
 #endif
 
 #include <stdio.h>
@@ -27,25 +30,59 @@
 #include <string.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <time.h>
+
+/* AVX2 JSON skipper, picked at run time (see json_skip_avx2) */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#  include <immintrin.h>
+#  define HAVE_JSON_AVX2
+#endif
 
 /* ─── Platform ───────────────────────────────────────────────── */
 #ifdef _WIN32
 #  define PLATFORM_WINDOWS
 #  include <windows.h>
 #  include <direct.h>
+#  include <io.h>
+#  include <fcntl.h>
+#  include <stdint.h>
+#  include <sys/stat.h>
 #  define PATH_SEP   "\\"
+#  define PATH_LIST  ';'
+#  define X_OK       0
+#  define access(p,m) _access(p,m)
 #  define DEVNULL    "NUL"
-#  define POPEN(c,m) _popen(c,m)
-#  define PCLOSE(f)  _pclose(f)
 #  define MKDIR(p)   _mkdir(p)
+#  define RMDIR(p)   _rmdir(p)
+#  define GETPID()   ((long)GetCurrentProcessId())
+#  define RENAME(a,b) (remove(b), rename(a,b))
+#  define READ(f,b,n) _read(f,b,(unsigned)(n))
+#  define STDIN_FILENO 0
 #else
 #  include <unistd.h>
+#  include <fcntl.h>
+#  include <errno.h>
+#  include <poll.h>
+#  include <signal.h>
+#  include <spawn.h>
+#  include <dirent.h>
 #  include <sys/stat.h>
+#  include <sys/types.h>
+#  include <sys/wait.h>
+#  include <sys/ioctl.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <netdb.h>
+#  include <termios.h>
 #  define PATH_SEP   "/"
+#  define PATH_LIST  ':'
 #  define DEVNULL    "/dev/null"
-#  define POPEN(c,m) popen(c,m)
-#  define PCLOSE(f)  pclose(f)
 #  define MKDIR(p)   mkdir(p,0700)
+#  define RMDIR(p)   rmdir(p)
+#  define GETPID()   ((long)getpid())
+extern char **environ;
+#  define RENAME(a,b) rename(a,b)
+#  define READ(f,b,n) read(f,b,n)
 #  ifdef __APPLE__
 #    define PLATFORM_MACOS
 #  else
@@ -66,19 +103,59 @@ static int g_color = 1;
 
 /* ─── Constants ──────────────────────────────────────────────── */
 #define YTPLAY_VERSION  "1.4.0"
-#define MAX_RESULTS     25
 #define MAX_CMD         8192
 #define DEFAULT_RESULTS 8
 #define DEFAULT_QUALITY "bestvideo[height<=1080]+bestaudio/best[height<=1080]"
-#define JSON_LINE_MAX   (512*1024)   /* 512 KB — fits any yt-dlp JSON line */
+#define ARENA_BLOCK     (64*1024)    /* result string arena chunk size      */
+#define SCACHE_TTL      (6*60*60)    /* search cache entry lifetime, seconds */
+#define SCACHE_MAX_SIZE (1024*1024)  /* search cache file cap, LRU-evicted   */
+#define DEFAULT_PREFETCH 3            /* stream URLs resolved ahead at the prompt */
+#define MAX_PREFETCH    16            /* ... upper bound for --prefetch          */
+#define PREFETCH_JOBS   2             /* ... at most this many at once           */
+#define UCACHE_MARGIN   (10*60)       /* resolved URLs must outlive playback by this */
+#define UCACHE_MAX      256           /* resolved URL cache entries kept         */
+#define ENRICH_JOBS     3             /* --enrich extractions at once            */
+#define META_TTL        (24*60*60)    /* --enrich details are trusted, seconds   */
+#define META_MAX        1024          /* ... entries kept in meta.tsv            */
+#define HIST_BYTES      (256*1024)    /* history.tsv is halved past this size    */
+#define HIST_WINDOW     (30*24*60*60) /* --warm looks back this far, seconds     */
+#define WARM_QUERIES    4             /* --warm: recurring searches refreshed    */
+#define WARM_TOP        3             /* ... top hits of each taken as candidates */
+#define WARM_VIDEOS     8             /* ... videos readied per pass             */
+#define WARM_FRESH      (3*60*60)     /* ... warmed URLs must stay valid this long */
+#define DEFAULT_WARM_MB 512           /* ... downloaded into the store per pass  */
+#define PLAYER_FAIL_FAST 5            /* player exit within N s = dead stream URL */
+#define RESOLVE_TIMEOUT (90*1000)     /* ms allowed for one `yt-dlp -g`          */
+#define DEFAULT_BUFFER  10            /* s buffered before progressive playback  */
+#define FALLBACK_BPS    (256*1024)    /* bytes/s assumed when size is unknown    */
+#define PIPE_SIZE       (1024*1024)   /* --pipe: each pipe is grown to this      */
+#define DEFAULT_JOBS    3             /* concurrent downloads in --bulk mode     */
+#define DEFAULT_RETRIES 2             /* extra attempts per --bulk item          */
+#define DEFAULT_STORE_MB 4096         /* download store budget, LRU-evicted      */
+#define MAX_CONNECTIONS 16            /* upper bound for --connections           */
+#define RANGE_CHUNK     (4*1024*1024) /* bytes per range request                 */
+#define RANGE_RETRIES   3             /* extra attempts per range                */
+#define RANGE_STALL     15            /* s a range may go without a byte         */
+#define AUTO_SAMPLE     (2*1024*1024) /* bytes fetched to measure throughput     */
+#define AUTO_TIME       3             /* ... for at most this many seconds       */
+#define AUTO_HEADROOM   1.5           /* throughput needed per bit of bitrate    */
+#define AUTO_TTL        (12*60*60)    /* a network's measurement is trusted, s   */
+#define DEBOUNCE_MS     300           /* typing pause before a --interactive search */
+#define SEARCH_TIMEOUT  (60*1000)     /* ms a --daemon allows one search          */
+#define DAEMON_WARM     2             /* idle pre-imported yt-dlp workers kept    */
+#define DAEMON_MAX_JOBS 32            /* requests a --daemon runs at once         */
+#define DAEMON_MAX_CONNS 16           /* ... and is still reading                 */
+#define DAEMON_READ_MS  5000          /* a client must send its request within    */
+#define DAEMON_CACHE_MAX (16*1024*1024) /* in-memory search/-g output, LRU-evicted */
 
 /* ─── Structures ─────────────────────────────────────────────── */
+/* Strings point into the result arena; numbers are formatted on display. */
 typedef struct {
-    char title[512];
-    char id[32];
-    char duration[24];
-    char views[16];
-    char channel[128];
+    const char *title;
+    const char *id;
+    const char *channel;
+    long        duration;       /* seconds, 0 = unknown/live */
+    long        views;
 } VideoResult;
 
 typedef struct {
@@ -87,11 +164,17 @@ typedef struct {
 
     char player[64];
     char quality[256];
+    int  auto_quality;
     int  stream;
+    int  pipe;
     int  audio_only;
 
     char output_dir[1024];
+    int  output_set;
     int  keep;
+    int  no_store;
+    long store_mb;
+    int  connections;
     char subtitle_lang[8];
 
     char extra_player[512];
@@ -101,11 +184,42 @@ typedef struct {
     int  quiet;
     int  verbose;
     int  direct_play;
+
+    int  no_cache;
+    int  refresh;
+    long cache_ttl;
+
+    int  prefetch;
+    int  enrich;
+    int  local;
+
+    int  progressive;
+    long buffer_secs;
+    long buffer_bytes;
+
+    int  interactive;
+    int  daemon;
+    int  no_daemon;
+
+    char batch[1024];
+    char queue[1024];
+    int  resume;
+
+    int  no_history;
+    int  warm;
+    long warm_mb;
+    char warm_rate[32];
+
+    int  bulk;
+    char select[256];
+    int  jobs;
+    int  retries;
 } Config;
 
 /* ─── Globals ────────────────────────────────────────────────── */
-static VideoResult g_results[MAX_RESULTS];
-static int         g_nresults = 0;
+static VideoResult *g_results;
+static int          g_nresults = 0, g_rcap = 0;
+static int          g_queue;            /* playing g_results as a queue */
 
 /* ─── Logging helpers ────────────────────────────────────────── */
 static void die(const char *fmt, ...) {
@@ -134,69 +248,280 @@ static void warn_msg(const char *fmt, ...) {
     fputs("\n", stderr);
 }
 
-static void trim_nl(char *s) {
-    size_t n = strlen(s);
-    while (n>0 && (s[n-1]=='\n'||s[n-1]=='\r'||s[n-1]==' ')) s[--n]='\0';
-}
-
-/* ─── Tiny JSON field extractor ──────────────────────────────── */
-/*
- *  Finds the value of `key` in a flat JSON object (no nesting needed).
- *  Handles string values (quoted) and numeric values (unquoted).
- *  Returns 1 on success, 0 on missing/null.
- */
-static int json_get(const char *json, const char *key, char *out, size_t outlen) {
-    char pat[256];
-    /* match  "key"  followed by optional whitespace + colon */
-    snprintf(pat, sizeof(pat), "\"%s\"", key);
-    const char *p = json;
-    while ((p = strstr(p, pat)) != NULL) {
-        /* make sure it really is a key (preceded by '{' or ',') */
-        const char *before = p - 1;
-        while (before > json && (*before==' '||*before=='\t')) before--;
-        if (before >= json && *before != '{' && *before != ',') { p++; continue; }
-
-        p += strlen(pat);
-        while (*p==' '||*p=='\t') p++;
-        if (*p != ':') continue;
-        p++;
-        while (*p==' '||*p=='\t') p++;
-
-        if (*p == '"') {
-            /* string value */
-            p++;
-            size_t i = 0;
-            while (*p && *p!='"' && i<outlen-1) {
-                if (*p=='\\' && *(p+1)) {
-                    p++;
-                    switch (*p) {
-                        case 'n':  out[i++]='\n'; break;
-                        case 't':  out[i++]='\t'; break;
-                        case '\\': out[i++]='\\'; break;
-                        case '"':  out[i++]='"';  break;
-                        case '/':  out[i++]='/';  break;
-                        default:   out[i++]='?';  break;
-                    }
-                    p++;
-                } else out[i++] = *p++;
+/* ─── Single-pass JSON field extractor ───────────────────────── */
+/*
+ *  Walks one JSON object front to back exactly once and copies the
+ *  values of the wanted *top-level* keys into caller buffers. Nested
+ *  objects/arrays are skipped wholesale, so a "title" inside
+ *  "thumbnails" can never shadow the real one.
+ *
+ *  String values are unescaped, including \uXXXX and surrogate pairs
+ *  (encoded as UTF-8); numbers are copied verbatim; null/true/false
+ *  count as missing. Skipping strings and nested containers is where
+ *  nearly all the bytes of a yt-dlp line go ("formats" alone is most of
+ *  it), so on x86-64 CPUs with AVX2 that runs 64 bytes per step; the
+ *  portable path leans on memchr.
+ */
+typedef struct {
+    const char *key;
+    char       *out;
+    size_t      outlen;
+    int         found;
+} JsonField;
+
+/* First '"' or '\\' in [p,end), or end. */
+static const char *json_scan_special(const char *p, const char *end) {
+    const char *q=(const char*)memchr(p,'"',(size_t)(end-p)), *b;
+    if (!q) q=end;
+    b=(const char*)memchr(p,'\\',(size_t)(q-p));
+    return b ? b : q;
+}
+
+#ifdef HAVE_JSON_AVX2
+/*
+ *  Mask of the quotes in a 64-byte block that a backslash escapes, given
+ *  the backslash mask bs. carry: the previous block ended in an odd run.
+ */
+static unsigned long long json_escaped(unsigned long long bs, unsigned long long *carry) {
+    const unsigned long long even=0x5555555555555555ULL;
+    unsigned long long follows, starts, sum;
+    bs&=~*carry;
+    follows=bs<<1|*carry;
+    starts=bs&~even&~follows;
+    sum=starts+bs;
+    *carry=sum<starts;
+    return (even^(sum<<1))&follows;
+}
+
+#define JSON_MASK64(a,b) ((unsigned long long)(unsigned)_mm256_movemask_epi8(a) | \
+                          (unsigned long long)(unsigned)_mm256_movemask_epi8(b)<<32)
+
+/*
+ *  in_str: p is just past an opening quote, find the closing one;
+ *  otherwise p is at an opening bracket, find its partner. Each 64-byte
+ *  block yields quote/backslash/bracket masks; escaped quotes are
+ *  dropped, and a carry-less multiply turns the quote mask into an
+ *  in-string mask so brackets inside strings don't count. The last
+ *  partial block is scanned from a zero-padded copy.
+ */
+__attribute__((target("avx2,pclmul,popcnt")))
+static const char *json_skip_avx2(const char *p, const char *end, int in_str) {
+    const __m256i q=_mm256_set1_epi8('"'), bsl=_mm256_set1_epi8('\\'),
+                  op=_mm256_set1_epi8('{'), cl=_mm256_set1_epi8('}'), lo=_mm256_set1_epi8(0x20);
+    unsigned long long carry=0, instr=0, mq, mb, ms, inside;
+    int depth=0;
+    char pad[64];
+    for (; p<end; p+=64) {
+        const char *b=p;
+        if (end-p<64) { memset(pad,0,sizeof(pad)); memcpy(pad,p,(size_t)(end-p)); b=pad; }
+        __m256i v0=_mm256_loadu_si256((const __m256i*)b), v1=_mm256_loadu_si256((const __m256i*)(b+32));
+        mq=JSON_MASK64(_mm256_cmpeq_epi8(v0,q),_mm256_cmpeq_epi8(v1,q));
+        mb=JSON_MASK64(_mm256_cmpeq_epi8(v0,bsl),_mm256_cmpeq_epi8(v1,bsl));
+        if (mb|carry) mq&=~json_escaped(mb,&carry);
+        if (in_str) {
+            if (mq) return p+__builtin_ctzll(mq)+1;
+            continue;
+        }
+        v0=_mm256_or_si256(v0,lo); v1=_mm256_or_si256(v1,lo);   /* [ ] -> { } */
+        ms=JSON_MASK64(_mm256_cmpeq_epi8(v0,op),_mm256_cmpeq_epi8(v1,op))
+          |JSON_MASK64(_mm256_cmpeq_epi8(v0,cl),_mm256_cmpeq_epi8(v1,cl));
+        if (!ms) { instr^=0-(unsigned long long)(__builtin_popcountll(mq)&1); continue; }
+        inside=(unsigned long long)_mm_cvtsi128_si64(
+                   _mm_clmulepi64_si128(_mm_cvtsi64_si128((long long)mq),_mm_set1_epi8(-1),0))^instr;
+        instr=0-(inside>>63);
+        for (ms&=~inside; ms; ms&=ms-1) {
+            int i=__builtin_ctzll(ms);
+            if ((b[i]|0x20)=='{') depth++;
+            else if (--depth<=0) return p+i+1;
+        }
+    }
+    return end;
+}
+
+static int json_have_avx2(void) {
+    static int have=-1;
+    if (have<0) have=__builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul")
+                     && __builtin_cpu_supports("popcnt");
+    return have;
+}
+#endif
+
+/*
+ *  p points just past an opening quote; returns just past the closing
+ *  one. Escapes other than \" can't end a string, so only the quotes are
+ *  searched for, and a quote is real when an even run of backslashes
+ *  precedes it.
+ */
+static const char *json_skip_string(const char *p, const char *end) {
+    const char *s=p;
+#ifdef HAVE_JSON_AVX2
+    if (json_have_avx2()) return json_skip_avx2(p,end,1);
+#endif
+    for (;;) {
+        const char *q=(const char*)memchr(p,'"',(size_t)(end-p)), *b;
+        if (!q) return end;
+        for (b=q; b>s && b[-1]=='\\'; b--) ;
+        if (!((q-b)&1)) return q+1;
+        p=q+1;
+    }
+}
+
+static const char *json_skip_ws(const char *p, const char *end) {
+    while (p<end && (*p==' '||*p=='\t'||*p=='\n'||*p=='\r')) p++;
+    return p;
+}
+
+/* p at an opening bracket; returns just past its closing one. */
+static const char *json_skip_container(const char *p, const char *end) {
+    int depth=0;
+#ifdef HAVE_JSON_AVX2
+    if (json_have_avx2()) return json_skip_avx2(p,end,0);
+#endif
+    while (p<end) {
+        char ch=*p++;
+        if (ch=='"') p=json_skip_string(p,end);
+        else if (ch=='{' || ch=='[') depth++;
+        else if ((ch=='}' || ch==']') && --depth<=0) return p;
+    }
+    return end;
+}
+
+/* Skip any value: string, number, literal, or a whole nested container. */
+static const char *json_skip_value(const char *p, const char *end) {
+    if (p>=end) return end;
+    if (*p=='"') return json_skip_string(p+1,end);
+    if (*p=='{' || *p=='[') return json_skip_container(p,end);
+    while (p<end && *p!=',' && *p!='}' && *p!=']') p++;
+    return p;
+}
+
+static int json_hex4(const char *p, const char *end) {
+    int v=0;
+    if (end-p<4) return -1;
+    for (int i=0; i<4; i++) {
+        char ch=p[i]; v<<=4;
+        if      (ch>='0'&&ch<='9') v|=ch-'0';
+        else if (ch>='a'&&ch<='f') v|=ch-'a'+10;
+        else if (ch>='A'&&ch<='F') v|=ch-'A'+10;
+        else return -1;
+    }
+    return v;
+}
+
+static int utf8_put(char *o, unsigned long cp) {
+    if (cp<0x80)    { o[0]=(char)cp; return 1; }
+    if (cp<0x800)   { o[0]=(char)(0xC0|cp>>6);  o[1]=(char)(0x80|(cp&0x3F)); return 2; }
+    if (cp<0x10000) { o[0]=(char)(0xE0|cp>>12); o[1]=(char)(0x80|((cp>>6)&0x3F)); o[2]=(char)(0x80|(cp&0x3F)); return 3; }
+    o[0]=(char)(0xF0|cp>>18); o[1]=(char)(0x80|((cp>>12)&0x3F));
+    o[2]=(char)(0x80|((cp>>6)&0x3F)); o[3]=(char)(0x80|(cp&0x3F)); return 4;
+}
+
+/*
+ *  Decode the string starting just past its opening quote into out
+ *  (always NUL-terminated, never split mid-UTF-8 when truncating).
+ *  Returns the position just past the closing quote.
+ */
+static const char *json_decode_string(const char *p, const char *end, char *out, size_t outlen) {
+    size_t i=0, cap=outlen-1;
+    int full=0;
+    for (;;) {
+        const char *q=json_scan_special(p,end);
+        if (!full) {
+            size_t run=(size_t)(q-p);
+            if (run>cap-i) { run=cap-i; full=1; }
+            memcpy(out+i,p,run); i+=run;
+        }
+        if (q>=end) { p=end; break; }
+        if (*q=='"') { p=q+1; break; }
+        /* escape */
+        char e = q+1<end ? q[1] : '\0', u[4];
+        int ul=1;
+        p=q+2;
+        switch (e) {
+            case 'n': u[0]='\n'; break;
+            case 't': u[0]='\t'; break;
+            case 'r': u[0]='\r'; break;
+            case 'b': u[0]='\b'; break;
+            case 'f': u[0]='\f'; break;
+            case 'u': {
+                long cp=json_hex4(p,end);
+                if (cp>=0) p+=4;
+                if (cp>=0xD800 && cp<=0xDBFF && end-p>=6 && p[0]=='\\' && p[1]=='u') {
+                    long lo=json_hex4(p+2,end);
+                    if (lo>=0xDC00 && lo<=0xDFFF) { cp=0x10000+((cp-0xD800)<<10)+(lo-0xDC00); p+=6; }
+                }
+                if (cp<0 || (cp>=0xD800 && cp<=0xDFFF)) cp=0xFFFD;
+                ul=utf8_put(u,(unsigned long)cp);
+                break;
             }
-            out[i] = '\0';
-            return 1;
-        } else if (isdigit((unsigned char)*p) || *p=='-') {
-            /* numeric value */
-            size_t i = 0;
-            while ((*p=='-'||isdigit((unsigned char)*p)) && i<outlen-1)
-                out[i++] = *p++;
-            out[i] = '\0';
-            return 1;
-        } else if (strncmp(p,"null",4)==0 || strncmp(p,"false",5)==0 ||
-                   strncmp(p,"true",4)==0) {
-            out[0] = '\0';
-            return 0;
+            default:  u[0]=e; break;            /* \" \\ \/ and anything odd */
+        }
+        if (!full) {
+            if ((size_t)ul<=cap-i) { memcpy(out+i,u,(size_t)ul); i+=(size_t)ul; }
+            else full=1;
         }
-        return 0;
     }
-    return 0;
+    /* a raw run may have been cut inside a multi-byte sequence */
+    if (full && i>0) {
+        size_t k=i;
+        while (k>0 && ((unsigned char)out[k-1]&0xC0)==0x80) k--;
+        if (k>0 && ((unsigned char)out[k-1]&0x80)) {
+            unsigned char lead=(unsigned char)out[k-1];
+            size_t need = lead>=0xF0?4 : lead>=0xE0?3 : lead>=0xC0?2 : 1;
+            if (i-(k-1)<need) i=k-1;
+        }
+    }
+    out[i]='\0';
+    return p;
+}
+
+/*
+ *  Fill every field in f[0..nf) whose key appears at the top level of
+ *  the object in json[0..len). Fields from f[need] on are fallbacks:
+ *  picked up if seen on the way, but the walk stops as soon as the
+ *  first need are in. Returns how many were found.
+ */
+static int json_fields(const char *json, size_t len, JsonField *f, int nf, int need) {
+    const char *p=json, *end=json+len;
+    int found=0, req=0;
+    for (int i=0; i<nf; i++) { f[i].found=0; if (f[i].outlen) f[i].out[0]='\0'; }
+
+    p=json_skip_ws(p,end);
+    if (p>=end || *p++!='{') return 0;
+    while (req<need) {
+        p=json_skip_ws(p,end);
+        if (p<end && *p==',') p=json_skip_ws(p+1,end);
+        if (p>=end || *p!='"') break;
+
+        const char *k=++p;
+        p=json_skip_string(p,end);
+        size_t klen=(size_t)(p-1-k);
+        p=json_skip_ws(p,end);
+        if (p>=end || *p!=':') break;
+        p=json_skip_ws(p+1,end);
+        if (p>=end) break;
+
+        JsonField *want=NULL;
+        for (int i=0; i<nf; i++)
+            if (!f[i].found && !strncmp(f[i].key,k,klen) && f[i].key[klen]=='\0') { want=&f[i]; break; }
+
+        if (!want || !want->outlen) { p=json_skip_value(p,end); continue; }
+        if (*p=='"') {
+            p=json_decode_string(p+1,end,want->out,want->outlen);
+            want->found=1; found++; req+=want<f+need;
+        } else if (*p=='-' || isdigit((unsigned char)*p)) {
+            size_t i=0;
+            while (p<end && (isdigit((unsigned char)*p)||*p=='-'||*p=='+'||*p=='.'||*p=='e'||*p=='E')) {
+                if (i<want->outlen-1) want->out[i++]=*p;
+                p++;
+            }
+            want->out[i]='\0';
+            want->found=1; found++; req+=want<f+need;
+        } else {
+            p=json_skip_value(p,end);          /* null / true / false */
+        }
+    }
+    return found;
 }
 
 /* ─── Duration formatter ─────────────────────────────────────── */
@@ -216,15 +541,6 @@ static void fmt_views(long v, char *out, size_t n) {
 }
 
 /* ─── Misc utils ─────────────────────────────────────────────── */
-static int cmd_exists(const char *c) {
-#ifdef PLATFORM_WINDOWS
-    char b[512]; snprintf(b,sizeof(b),"where \"%s\" >NUL 2>&1",c);
-#else
-    char b[512]; snprintf(b,sizeof(b),"command -v '%s' >/dev/null 2>&1",c);
-#endif
-    return system(b)==0;
-}
-
 static void get_tmpdir(char *out, size_t n) {
 #ifdef PLATFORM_WINDOWS
     GetTempPathA((DWORD)n, out);
@@ -235,357 +551,6181 @@ static void get_tmpdir(char *out, size_t n) {
 #endif
 }
 
-/* ─── Banner ─────────────────────────────────────────────────── */
-static void print_banner(void) {
-    printf("\n");
-    printf("%s"
-"  ██╗   ██╗████████╗██████╗ ██╗      █████╗ ██╗   ██╗\n"
-"  ╚██╗ ██╔╝╚══██╔══╝██╔══██╗██║     ██╔══██╗╚██╗ ██╔╝\n"
-"   ╚████╔╝    ██║   ██████╔╝██║     ███████║ ╚████╔╝ \n"
-"    ╚██╔╝     ██║   ██╔═══╝ ██║     ██╔══██║  ╚██╔╝  \n"
-"     ██║      ██║   ██║     ███████╗██║  ██║   ██║   \n"
-"     ╚═╝      ╚═╝   ╚═╝     ╚══════╝╚═╝  ╚═╝   ╚═╝   \n"
-    "%s", C_CYN, C_RST);
-    printf("  %sStream · Search · Download  —  v%s%s\n\n",
-           C_DIM, YTPLAY_VERSION, C_RST);
+/*
+ *  Per-user cache directory, created on demand:
+ *    Linux   $XDG_CACHE_HOME/ytplay  or  ~/.cache/ytplay
+ *    macOS   $XDG_CACHE_HOME/ytplay  or  ~/Library/Caches/ytplay
+ *    Windows %LOCALAPPDATA%\ytplay
+ *  Returns 0 when no suitable location exists.
+ */
+static int get_cachedir(char *out, size_t n) {
+    char base[768];
+#ifdef PLATFORM_WINDOWS
+    const char *l=getenv("LOCALAPPDATA");
+    if (!l||!*l) return 0;
+    snprintf(base,sizeof(base),"%s",l);
+#else
+    const char *x=getenv("XDG_CACHE_HOME"), *h=getenv("HOME");
+    if (x&&*x)       snprintf(base,sizeof(base),"%s",x);
+    else if (!h||!*h) return 0;
+#  ifdef PLATFORM_MACOS
+    else             snprintf(base,sizeof(base),"%s/Library/Caches",h);
+#  else
+    else             snprintf(base,sizeof(base),"%s/.cache",h);
+#  endif
+    MKDIR(base);
+#endif
+    snprintf(out,n,"%s%sytplay",base,PATH_SEP);
+    MKDIR(out);
+    return 1;
+}
 
-    /*
-     * Box inner text (between │ and │), visible chars:
-     * "  Linux · macOS · Windows  —  yt-dlp  " = 40 visible chars
-     * Box border uses "────────────────────────────────────────" = 40 dashes
-     * So │ + 40 chars + │ is perfectly flush.
-     */
-    printf("  %s┌────────────────────────────────────┐%s\n",C_MAG,C_RST);
-    printf("  %s│%s  %sLinux%s - %smacOS%s - %sWindows%s - yt-dlp  %s│%s\n",
-           C_MAG,C_RST, C_GRN,C_RST, C_YLW,C_RST, C_CYN,C_RST, C_MAG,C_RST);
-    printf("  %s└────────────────────────────────────┘%s\n\n",C_MAG,C_RST);
+/* Monotonic clock, for measuring durations only. */
+static long long mono_us(void) {
+#ifdef PLATFORM_WINDOWS
+    static LARGE_INTEGER f;
+    LARGE_INTEGER t;
+    if (!f.QuadPart) QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&t);
+    return (long long)(t.QuadPart/f.QuadPart*1000000 + t.QuadPart%f.QuadPart*1000000/f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+#endif
 }
 
-/* ─── Help ───────────────────────────────────────────────────── */
-static void print_help(const char *prog) {
-    print_banner();
-    printf("  %sUSAGE%s\n    %s [OPTIONS] <search query>\n\n", C_BLD, C_RST, prog);
+static long long mono_ms(void) { return mono_us()/1000; }
 
-    printf("  %sSEARCH%s\n", C_YLW, C_RST);
-    printf("    %-28s  Results to show (default %d, max %d)\n","-n, --results <N>",DEFAULT_RESULTS,MAX_RESULTS);
-    printf("    %-28s  Auto-play first result, skip menu\n",   "-1, --first");
-    printf("    %-28s  Suppress ASCII banner\n\n",             "--no-banner");
+/* ─── Tracing ────────────────────────────────────────────────── */
+/*
+ *  --timings / --trace FILE. Phases are recorded as spans (name, lane,
+ *  start, duration) against the clock reading taken first thing in
+ *  main(). Names are string literals; lane 0 is the main thread of
+ *  control, background workers get their own so they show up as
+ *  separate rows in a trace viewer. When neither flag is given
+ *  trace_now() returns 0 and trace_span()/trace_mark() return at once,
+ *  so the instrumented paths cost one well-predicted branch.
+ *
+ *  --trace writes Chrome trace-event JSON (chrome://tracing, Perfetto,
+ *  speedscope); --timings prints a per-phase summary on exit.
+ */
+typedef struct {
+    const char *name;
+    int         lane;
+    long long   ts, dur;        /* µs since g_trace_t0; dur -1 = instant */
+} TraceEv;
 
-    printf("  %sPLAYBACK%s\n", C_YLW, C_RST);
-    printf("    %-28s  Stream — no file saved [default]\n",    "-s, --stream");
-    printf("    %-28s  Download to temp dir then play\n",      "-d, --download");
-    printf("    %-28s  Keep downloaded file\n",                 "-k, --keep");
-    printf("    %-28s  Audio only\n",                           "-a, --audio-only");
-    printf("    %-28s  yt-dlp format string\n",                 "-q, --quality <FMT>");
-    printf("    %-28s  Preset: 4K\n",                           "    --4k");
-    printf("    %-28s  Preset: 1080p [default]\n",              "    --1080");
-    printf("    %-28s  Preset: 720p\n",                         "    --720");
-    printf("    %-28s  Preset: 480p\n",                         "    --480");
-    printf("    %-28s  Preset: 360p\n",                         "    --360");
-    printf("    %-28s  Worst quality / fastest\n",              "    --worst");
-    printf("    %-28s  Subtitles language  e.g. en, pl\n\n",   "    --subs <LANG>");
+static int        g_trace;      /* 1: --timings, 2: --trace, 3: both */
+static char       g_trace_file[1024];
+static long long  g_trace_t0;
+static TraceEv   *g_trace_ev;
+static int        g_trace_n, g_trace_cap;
 
-    printf("  %sPLAYER%s\n", C_YLW, C_RST);
-    printf("    %-28s  mpv  vlc  ffplay  iina  mplayer\n", "-p, --player <NAME>");
-    printf("    %-28s  Extra flags for player\n",          "    --player-args <ARGS>");
-    printf("    %-28s  Extra flags for yt-dlp\n\n",        "    --ytdlp-args <ARGS>");
+static long long trace_now(void) { return g_trace ? mono_us() : 0; }
 
-    printf("  %sOUTPUT%s\n", C_YLW, C_RST);
-    printf("    %-28s  Download directory (default: /tmp/ytplay)\n","-o, --output <DIR>");
-    printf("    %-28s  Disable colours\n",                          "    --no-color");
-    printf("    %-28s  Minimal output\n",                           "    --quiet");
-    printf("    %-28s  Show raw yt-dlp / player commands\n\n",      "-v, --verbose");
+static void trace_add(const char *name, int lane, long long ts, long long dur) {
+    if (g_trace_n==g_trace_cap) {
+        int nc = g_trace_cap ? g_trace_cap*2 : 256;
+        TraceEv *ne=(TraceEv*)realloc(g_trace_ev,(size_t)nc*sizeof(TraceEv));
+        if (!ne) { g_trace=0; return; }
+        g_trace_ev=ne; g_trace_cap=nc;
+    }
+    g_trace_ev[g_trace_n].name=name;
+    g_trace_ev[g_trace_n].lane=lane;
+    g_trace_ev[g_trace_n].ts=ts-g_trace_t0;
+    g_trace_ev[g_trace_n].dur=dur;
+    g_trace_n++;
+}
 
-    printf("  %sEXAMPLES%s\n", C_GRN, C_RST);
-    printf("    %s \"lofi hip hop\"\n",                prog);
-    printf("    %s -1 \"rick astley\"\n",              prog);
-    printf("    %s -d -k --1080 \"big buck bunny\"\n", prog);
-    printf("    %s -a \"beethoven moonlight\"\n",      prog);
-    printf("    %s -p vlc -n 15 \"documentaries\"\n",  prog);
-    printf("    %s --subs pl \"ted talk\"\n\n",         prog);
+/* Span from `start` (a trace_now() value) until now. */
+static void trace_span(const char *name, int lane, long long start) {
+    if (!g_trace) return;
+    long long now=mono_us();
+    trace_add(name,lane,start,now-start);
 }
 
-/* ─── Player detection ───────────────────────────────────────── */
-static void detect_player(char *out, size_t n) {
-#ifdef PLATFORM_MACOS
-    static const char *order[]={"iina","mpv","vlc","ffplay",NULL};
-#elif defined(PLATFORM_WINDOWS)
-    static const char *order[]={"mpv","vlc","ffplay",NULL};
-#else
-    static const char *order[]={"mpv","vlc","ffplay","mplayer",NULL};
-#endif
-    for (int i=0; order[i]; i++) {
-        if (cmd_exists(order[i])) { strncpy(out,order[i],n-1); out[n-1]='\0'; return; }
+static void trace_mark(const char *name, int lane) {
+    if (!g_trace) return;
+    trace_add(name,lane,mono_us(),-1);
+}
+
+static void trace_write(void) {
+    FILE *f=fopen(g_trace_file,"w");
+    if (!f) { fprintf(stderr,"  [!] Cannot write trace to %s\n",g_trace_file); return; }
+    fprintf(f,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ytplay\"}}");
+    for (int i=0; i<g_trace_n; i++) {
+        TraceEv *e=&g_trace_ev[i];
+        if (e->dur<0)
+            fprintf(f,",\n{\"name\":\"%s\",\"cat\":\"ytplay\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":1,\"tid\":%d}",
+                    e->name,e->ts,e->lane);
+        else
+            fprintf(f,",\n{\"name\":\"%s\",\"cat\":\"ytplay\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d}",
+                    e->name,e->ts,e->dur,e->lane);
     }
-    strncpy(out,"mpv",n-1); out[n-1]='\0';
+    fprintf(f,"\n]}\n");
+    fclose(f);
 }
 
-/* ─── Config defaults ────────────────────────────────────────── */
-static void config_defaults(Config *c) {
-    memset(c,0,sizeof(*c));
-    c->num_results = DEFAULT_RESULTS;
-    c->stream      = 1;
-    strncpy(c->quality,DEFAULT_QUALITY,sizeof(c->quality)-1);
-    char tmp[512];
-    get_tmpdir(tmp,sizeof(tmp));
-    snprintf(c->output_dir,sizeof(c->output_dir),"%s%sytplay",tmp,PATH_SEP);
+/* One row per phase name, in order of first start: count, total and max duration. */
+typedef struct { const char *name; int instant, count; long long first, total, max; } TraceRow;
+
+static int trace_row_cmp(const void *a, const void *b) {
+    long long d=((const TraceRow*)a)->first-((const TraceRow*)b)->first;
+    return d<0 ? -1 : d>0;
 }
 
-/* ─── Argument parsing ───────────────────────────────────────── */
-static void parse_args(int argc, char **argv, Config *c) {
-    if (argc<2) { print_help(argv[0]); exit(0); }
-#define NEED() do{ if(++i>=argc) die("'%s' needs an argument",a); }while(0)
-    for (int i=1; i<argc; i++) {
-        const char *a=argv[i];
-        if (!strcmp(a,"--help")||!strcmp(a,"-h"))      { print_help(argv[0]); exit(0); }
-        else if (!strcmp(a,"--version"))                { printf("ytplay %s\n",YTPLAY_VERSION); exit(0); }
-        else if (!strcmp(a,"-n")||!strcmp(a,"--results")){ NEED(); c->num_results=atoi(argv[i]); if(c->num_results<1)c->num_results=1; if(c->num_results>MAX_RESULTS)c->num_results=MAX_RESULTS; }
-        else if (!strcmp(a,"-1")||!strcmp(a,"--first")) { c->direct_play=1; c->num_results=1; }
-        else if (!strcmp(a,"-s")||!strcmp(a,"--stream"))   c->stream=1;
-        else if (!strcmp(a,"-d")||!strcmp(a,"--download")) c->stream=0;
-        else if (!strcmp(a,"-k")||!strcmp(a,"--keep"))     c->keep=1;
-        else if (!strcmp(a,"-a")||!strcmp(a,"--audio-only")){ c->audio_only=1; strncpy(c->quality,"bestaudio",sizeof(c->quality)-1); }
-        else if (!strcmp(a,"-q")||!strcmp(a,"--quality"))  { NEED(); strncpy(c->quality,argv[i],sizeof(c->quality)-1); }
-        else if (!strcmp(a,"--4k"))   strncpy(c->quality,"bestvideo[height<=2160]+bestaudio/best",sizeof(c->quality)-1);
-        else if (!strcmp(a,"--1080")) strncpy(c->quality,"bestvideo[height<=1080]+bestaudio/best[height<=1080]",sizeof(c->quality)-1);
-        else if (!strcmp(a,"--720"))  strncpy(c->quality,"bestvideo[height<=720]+bestaudio/best[height<=720]",sizeof(c->quality)-1);
-        else if (!strcmp(a,"--480"))  strncpy(c->quality,"bestvideo[height<=480]+bestaudio/best[height<=480]",sizeof(c->quality)-1);
-        else if (!strcmp(a,"--360"))  strncpy(c->quality,"bestvideo[height<=360]+bestaudio/best[height<=360]",sizeof(c->quality)-1);
-        else if (!strcmp(a,"--worst"))strncpy(c->quality,"worst",sizeof(c->quality)-1);
-        else if (!strcmp(a,"--subs")) { NEED(); strncpy(c->subtitle_lang,argv[i],sizeof(c->subtitle_lang)-1); }
-        else if (!strcmp(a,"-p")||!strcmp(a,"--player"))     { NEED(); strncpy(c->player,argv[i],sizeof(c->player)-1); }
-        else if (!strcmp(a,"--player-args"))                  { NEED(); strncpy(c->extra_player,argv[i],sizeof(c->extra_player)-1); }
-        else if (!strcmp(a,"--ytdlp-args"))                   { NEED(); strncpy(c->extra_ytdlp,argv[i],sizeof(c->extra_ytdlp)-1); }
-        else if (!strcmp(a,"-o")||!strcmp(a,"--output"))     { NEED(); strncpy(c->output_dir,argv[i],sizeof(c->output_dir)-1); }
-        else if (!strcmp(a,"--no-color"))  g_color=0;
-        else if (!strcmp(a,"--quiet"))     c->quiet=1;
-        else if (!strcmp(a,"-v")||!strcmp(a,"--verbose")) c->verbose=1;
-        else if (!strcmp(a,"--no-banner")) c->no_banner=1;
-        else if (a[0]=='-')                die("Unknown option: %s  (use --help)",a);
-        else {
-            size_t qlen=strlen(c->query);
-            if (qlen>0 && qlen<sizeof(c->query)-2) { c->query[qlen]=' '; c->query[qlen+1]='\0'; }
-            strncat(c->query,a,sizeof(c->query)-strlen(c->query)-1);
-        }
+static void trace_summary(void) {
+    TraceRow *row=(TraceRow*)calloc((size_t)g_trace_n+1,sizeof(TraceRow));
+    int nrow=0;
+    if (!row) return;
+    for (int i=0; i<g_trace_n; i++) {
+        TraceEv *e=&g_trace_ev[i];
+        int k, instant=e->dur<0;
+        for (k=0; k<nrow; k++) if (row[k].instant==instant && !strcmp(row[k].name,e->name)) break;
+        if (k==nrow) { row[nrow].name=e->name; row[nrow].instant=instant; row[nrow].first=e->ts; nrow++; }
+        row[k].count++;
+        if (e->ts<row[k].first) row[k].first=e->ts;
+        if (!instant) { row[k].total+=e->dur; if (e->dur>row[k].max) row[k].max=e->dur; }
     }
-#undef NEED
-    if (!strlen(c->query)) die("No search query provided. Use --help.");
-}
+    qsort(row,(size_t)nrow,sizeof(TraceRow),trace_row_cmp);
 
-/* ─── YouTube search ─────────────────────────────────────────── */
-/*
- *  We use:
- *    yt-dlp --flat-playlist --dump-json "ytsearch<N>:<query>"
- *
- *  --flat-playlist  →  one compact JSON object per line, very fast
- *                       (does NOT hit each video page)
- *  --dump-json      →  structured JSON we can parse reliably
- *
- *  Fields we extract from the flat JSON:
- *    id, title, duration (seconds), view_count, channel / uploader
- *
- *  The full watch URL is reconstructed as:
- *    https://www.youtube.com/watch?v=<id>
- */
-static int search_youtube(Config *c) {
-    /* shell-safe query: wrap in single quotes, escape ' inside */
-    char safe_q[4096]; size_t j=0;
-    for (const char *s=c->query; *s && j<sizeof(safe_q)-5; s++) {
-        if (*s=='\'') { safe_q[j++]='\''; safe_q[j++]='\\'; safe_q[j++]='\''; safe_q[j++]='\''; }
-        else safe_q[j++]=*s;
+    fflush(stdout);
+    fprintf(stderr,"\n  %sTimings%s  (ms; start is relative to launch)\n",C_BLD,C_RST);
+    fprintf(stderr,"  %-22s %9s %9s %6s %9s\n","phase","start","total","count","max");
+    for (int k=0; k<nrow; k++) {
+        if (row[k].instant) fprintf(stderr,"  %-22s %9.1f %9s %6d\n",row[k].name,row[k].first/1000.0,"-",row[k].count);
+        else fprintf(stderr,"  %-22s %9.1f %9.1f %6d %9.1f\n",row[k].name,row[k].first/1000.0,
+                     row[k].total/1000.0,row[k].count,row[k].max/1000.0);
     }
-    safe_q[j]='\0';
+    fprintf(stderr,"\n");
+    free(row);
+}
 
-    char cmd[MAX_CMD];
-    snprintf(cmd,sizeof(cmd),
-             "yt-dlp --no-warnings --flat-playlist --dump-json"
-             " 'ytsearch%d:%s'"
-             " 2>" DEVNULL,
-             c->num_results, safe_q);
+static void trace_finish(void) {
+    if (!g_trace) return;
+    trace_span("total",0,g_trace_t0);
+    if (g_trace&2) trace_write();
+    if (g_trace&1) trace_summary();
+}
 
-    if (c->verbose)
-        printf("%s[yt-dlp]%s %s\n\n",C_DIM,C_RST,cmd);
+/* Everything left in f, NUL-terminated (not counted in *len). */
+static unsigned char *read_all(FILE *f, size_t *len) {
+    size_t cap=4096, n=0, r;
+    unsigned char *b=(unsigned char*)malloc(cap);
+    while (b && (r=fread(b+n,1,cap-n,f))>0) {
+        n+=r;
+        if (n==cap) { unsigned char *nb=(unsigned char*)realloc(b,cap*2); if(!nb){free(b);b=NULL;break;} b=nb; cap*=2; }
+    }
+    if (b) b[n]='\0';
+    *len=n;
+    return b;
+}
 
-    FILE *fp = POPEN(cmd,"r");
-    if (!fp) die("Failed to launch yt-dlp. Is it installed and in PATH?");
+/* Slurp a whole file into a malloc'd buffer. Returns NULL on error. */
+static unsigned char *read_file(const char *path, size_t *len) {
+    FILE *f=fopen(path,"rb");
+    if (!f) return NULL;
+    unsigned char *b=read_all(f,len);
+    fclose(f);
+    return b;
+}
 
-    char *line = (char*)malloc(JSON_LINE_MAX);
-    if (!line) die("Out of memory");
+/* Next '\n'-terminated line of a NUL-terminated buffer, split in place. */
+static char *next_line(char **cur) {
+    char *s=*cur, *nl;
+    if (!s || !*s) return NULL;
+    nl=strchr(s,'\n');
+    if (nl) { *nl='\0'; *cur=nl+1; } else *cur=s+strlen(s);
+    return s;
+}
 
-    g_nresults=0;
-    while (fgets(line, JSON_LINE_MAX, fp) && g_nresults < MAX_RESULTS) {
-        if (line[0]!='{') continue;
+/* How many lines next_line() will return from s, at most. */
+static size_t count_lines(const char *s) {
+    size_t n=1;
+    while ((s=strchr(s,'\n'))) { s++; n++; }
+    return n;
+}
 
-        VideoResult *r = &g_results[g_nresults];
-        char tmp[64];
+/* Lower-case, trim and collapse runs of whitespace — "Lofi  Hip hop " == "lofi hip hop". */
+static void normalize_query(const char *q, char *out, size_t n) {
+    size_t j=0; int sp=0;
+    for (; *q && j<n-1; q++) {
+        if (isspace((unsigned char)*q)) { sp=(j>0); continue; }
+        if (sp && j<n-2) out[j++]=' ';
+        sp=0;
+        out[j++]=(char)tolower((unsigned char)*q);
+    }
+    out[j]='\0';
+}
 
-        if (!json_get(line,"title",  r->title,   sizeof(r->title)))   continue;
-        if (!json_get(line,"id",     r->id,       sizeof(r->id)))      continue;
+/* ─── Result store ───────────────────────────────────────────── */
+/*
+ *  g_results grows as results arrive; the strings they point to live in
+ *  a bump arena of ARENA_BLOCK chunks, each one allocated exactly once
+ *  and de-duplicated (channel names repeat a lot), so a search costs
+ *  one realloc now and then plus a few large mallocs — no per-result
+ *  fixed-size buffers. results_reset() drops everything at once.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used, cap;
+    char   data[];
+} ArenaBlock;
 
-        if (json_get(line,"duration",tmp,sizeof(tmp)) && tmp[0])
-            fmt_duration(atol(tmp), r->duration, sizeof(r->duration));
-        else
-            strncpy(r->duration,"?",sizeof(r->duration));
+static ArenaBlock  *g_arena;
+static const char **g_intern;           /* open-addressed set of arena strings */
+static size_t       g_nintern, g_intern_cap;
 
-        if (json_get(line,"view_count",tmp,sizeof(tmp)) && tmp[0])
-            fmt_views(atol(tmp), r->views, sizeof(r->views));
-        else
-            strncpy(r->views,"?",sizeof(r->views));
+static char *arena_alloc(size_t n) {
+    ArenaBlock *b=g_arena;
+    if (!b || b->cap-b->used < n) {
+        size_t cap = n>ARENA_BLOCK/4 ? n : ARENA_BLOCK;
+        b=(ArenaBlock*)malloc(sizeof(ArenaBlock)+cap);
+        if (!b) die("Out of memory");
+        b->used=0; b->cap=cap;
+        if (n>ARENA_BLOCK/4 && g_arena) { b->next=g_arena->next; g_arena->next=b; }   /* keep filling the current one */
+        else { b->next=g_arena; g_arena=b; }
+    }
+    b->used+=n;
+    return b->data+b->used-n;
+}
 
-        if (!json_get(line,"channel",  r->channel,sizeof(r->channel)))
-            if (!json_get(line,"uploader",r->channel,sizeof(r->channel)))
-                strncpy(r->channel,"Unknown",sizeof(r->channel));
+static size_t str_hash(const char *s, size_t n) {
+    size_t h=2166136261u;
+    while (n--) { h^=(unsigned char)*s++; h*=16777619u; }
+    return h;
+}
 
-        g_nresults++;
+/* The arena copy of s[0..n), shared with any earlier identical string. */
+static const char *intern(const char *s, size_t n) {
+    if (g_nintern*2 >= g_intern_cap) {
+        size_t nc = g_intern_cap ? g_intern_cap*2 : 256;
+        const char **nt=(const char**)calloc(nc,sizeof(char*));
+        if (!nt) die("Out of memory");
+        for (size_t i=0; i<g_intern_cap; i++) {
+            if (!g_intern[i]) continue;
+            size_t k=str_hash(g_intern[i],strlen(g_intern[i]))&(nc-1);
+            while (nt[k]) k=(k+1)&(nc-1);
+            nt[k]=g_intern[i];
+        }
+        free(g_intern); g_intern=nt; g_intern_cap=nc;
     }
+    size_t k=str_hash(s,n)&(g_intern_cap-1);
+    for (; g_intern[k]; k=(k+1)&(g_intern_cap-1))
+        if (!strncmp(g_intern[k],s,n) && g_intern[k][n]=='\0') return g_intern[k];
+    char *d=arena_alloc(n+1);
+    memcpy(d,s,n); d[n]='\0';
+    g_nintern++;
+    return g_intern[k]=d;
+}
 
-    free(line);
-    PCLOSE(fp);
-    return g_nresults;
+static VideoResult *results_add(void) {
+    if (g_nresults==g_rcap) {
+        int nc = g_rcap ? g_rcap*2 : 32;
+        VideoResult *nr=(VideoResult*)realloc(g_results,(size_t)nc*sizeof(VideoResult));
+        if (!nr) die("Out of memory");
+        g_results=nr; g_rcap=nc;
+    }
+    return &g_results[g_nresults++];
 }
 
-/* ─── Print results ──────────────────────────────────────────── */
-static void print_results(Config *c) {
-    printf("\n");
-    char qs[48]; strncpy(qs,c->query,46); qs[46]='\0';
-    if (strlen(c->query)>46) strcat(qs,"…");
+static void results_reset(void) {
+    while (g_arena) { ArenaBlock *n=g_arena->next; free(g_arena); g_arena=n; }
+    if (g_intern) memset(g_intern,0,g_intern_cap*sizeof(char*));
+    g_nintern=0;
+    g_nresults=0;
+}
 
-    printf("  %s┌────────────────────────────────────────────────────────────────┐%s\n",C_CYN,C_RST);
-    printf("  %s│%s  Search : %s%-53s%s %s│%s\n",C_CYN,C_RST,C_BLD,qs,C_RST,C_CYN,C_RST);
-    printf("  %s│%s  Results: %s%d%s%-54s%s│%s\n",C_CYN,C_RST,C_GRN,g_nresults,C_RST,"",C_CYN,C_RST);
-    printf("  %s└────────────────────────────────────────────────────────────────┘%s\n\n",C_CYN,C_RST);
+/* ─── Process layer ──────────────────────────────────────────── */
+/*
+ *  Every external program is started from an argv array — no /bin/sh
+ *  in between and no quoting to get wrong. posix_spawnp() on POSIX,
+ *  CreateProcess() on Windows. A Proc may have its stdout on a
+ *  non-blocking pipe (optionally with stderr merged in), and any of
+ *  stdin/stdout/stderr pointed at the null device. proc_wait() takes a
+ *  timeout; proc_kill() escalates from SIGTERM to SIGKILL.
+ *
+ *  On POSIX, when a `ytplay --daemon` is listening, "yt-dlp" runs in one
+ *  of its warm workers instead: the same descriptors are handed over the
+ *  socket, and the Proc waits on the connection rather than a pid (see
+ *  "Extractor daemon"). Callers can't tell the difference.
+ */
+typedef struct { char **v; int n, cap; } Argv;
+
+static char *xstrdup(const char *s) {
+    size_t n=strlen(s)+1;
+    char *d=(char*)malloc(n);
+    if (!d) die("Out of memory");
+    return (char*)memcpy(d,s,n);
+}
+
+static void argv_add(Argv *a, const char *s) {
+    if (a->n+2 > a->cap) {
+        int nc = a->cap ? a->cap*2 : 16;
+        char **nv=(char**)realloc(a->v,(size_t)nc*sizeof(char*));
+        if (!nv) die("Out of memory");
+        a->v=nv; a->cap=nc;
+    }
+    a->v[a->n++]=xstrdup(s);
+    a->v[a->n]=NULL;
+}
+
+static void argv_addf(Argv *a, const char *fmt, ...) {
+    char b[MAX_CMD];
+    va_list ap;
+    va_start(ap,fmt); vsnprintf(b,sizeof(b),fmt,ap); va_end(ap);
+    argv_add(a,b);
+}
+
+/*
+ *  Split user-supplied flags (--player-args / --ytdlp-args) the way a
+ *  shell would: whitespace separates, '…' and "…" group, \ escapes.
+ *  Nothing is expanded.
+ */
+static void argv_split(Argv *a, const char *s) {
+    char w[MAX_CMD];
+    for (;;) {
+        size_t n=0; int any=0; char q=0;
+        while (*s==' '||*s=='\t'||*s=='\n') s++;
+        if (!*s) return;
+        for (; *s && (q || (*s!=' '&&*s!='\t'&&*s!='\n')); s++) {
+            any=1;
+            if (q) { if (*s==q) { q=0; continue; } }
+            else if (*s=='\'' || *s=='"') { q=*s; continue; }
+            if (*s=='\\' && q!='\'' && s[1]) s++;
+            if (n<sizeof(w)-1) w[n++]=*s;
+        }
+        w[n]='\0';
+        if (any) argv_add(a,w);
+    }
+}
+
+static void argv_free(Argv *a) {
+    for (int i=0; i<a->n; i++) free(a->v[i]);
+    free(a->v);
+    memset(a,0,sizeof(*a));
+}
+
+/* -v output: the command as a copy-pasteable shell line. */
+static void argv_show(const char *tag, const Argv *a) {
+    printf("%s[%s]%s",C_DIM,tag,C_RST);
+    for (int i=0; i<a->n; i++) {
+        const char *s=a->v[i];
+        int plain = *s!='\0';
+        for (const char *p=s; *p; p++)
+            if (!isalnum((unsigned char)*p) && !strchr("-_./:=,@%+",*p)) { plain=0; break; }
+        if (plain) { printf(" %s",s); continue; }
+        fputs(" '",stdout);
+        for (const char *p=s; *p; p++) { if (*p=='\'') fputs("'\\''",stdout); else putchar(*p); }
+        putchar('\'');
+    }
+    putchar('\n');
+}
+
+#define PROC_STDOUT_PIPE  1
+#define PROC_STDOUT_NULL  2
+#define PROC_STDERR_NULL  4
+#define PROC_STDERR_OUT   8     /* stderr into the stdout pipe   */
+#define PROC_STDIN_NULL   16
+#define PROC_FOREGROUND   32    /* interactive: shield us from ^C */
+#define PROC_STDIN_PIPE   64    /* stdin from a pipe we write (POSIX) */
+
+#define PROC_TIMEOUT     (-2)
+
+typedef struct {
+#ifdef PLATFORM_WINDOWS
+    HANDLE h;
+#else
+    pid_t  pid;
+#endif
+    int    out;         /* read end of the stdout pipe, or -1 */
+    int    in;          /* write end of the stdin pipe, or -1 */
+    int    alive;
+    int    status;      /* exit code once reaped, -1 if killed by a signal */
+#ifndef PLATFORM_WINDOWS
+    int    ctl;         /* --daemon connection running it, or -1 */
+#endif
+} Proc;
+
+#ifdef PLATFORM_WINDOWS
+/* Append one argument to a CreateProcess command line, MSVC runtime quoting. */
+static void win_quote(char *d, size_t *n, size_t cap, const char *s) {
+#define WQ(ch) do { if (*n+1<cap) d[(*n)++]=(ch); } while (0)
+    if (*s && !strpbrk(s," \t\n\v\"")) { while (*s) WQ(*s++); return; }
+    WQ('"');
+    for (;; s++) {
+        size_t bs=0;
+        while (*s=='\\') { s++; bs++; }
+        if (!*s)      { for (size_t i=0; i<bs*2; i++) WQ('\\'); break; }
+        if (*s=='"')  { for (size_t i=0; i<bs*2+1; i++) WQ('\\'); }
+        else          { for (size_t i=0; i<bs; i++) WQ('\\'); }
+        WQ(*s);
+    }
+    WQ('"');
+#undef WQ
+}
+
+static int proc_spawn(Proc *p, const Argv *a, int flags) {
+    SECURITY_ATTRIBUTES sa={sizeof(sa),NULL,TRUE};
+    HANDLE rd=NULL, wr=NULL, nul=INVALID_HANDLE_VALUE;
+    STARTUPINFOA si; PROCESS_INFORMATION pi;
+    static char cl[32768];
+    size_t cn=0;
+    memset(p,0,sizeof(*p)); p->out=-1; p->in=-1;
+    for (int i=0; i<a->n; i++) { if (i) cl[cn++]=' '; win_quote(cl,&cn,sizeof(cl),a->v[i]); }
+    cl[cn]='\0';
+
+    if ((flags&PROC_STDOUT_PIPE) && !CreatePipe(&rd,&wr,&sa,0)) return -1;
+    if (rd) SetHandleInformation(rd,HANDLE_FLAG_INHERIT,0);
+    if (flags&(PROC_STDOUT_NULL|PROC_STDERR_NULL|PROC_STDIN_NULL))
+        nul=CreateFileA("NUL",GENERIC_READ|GENERIC_WRITE,FILE_SHARE_READ|FILE_SHARE_WRITE,&sa,OPEN_EXISTING,0,NULL);
+
+    memset(&si,0,sizeof(si)); si.cb=sizeof(si);
+    si.dwFlags=STARTF_USESTDHANDLES;
+    si.hStdInput  = (flags&PROC_STDIN_NULL)  ? nul : GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = wr ? wr : (flags&PROC_STDOUT_NULL) ? nul : GetStdHandle(STD_OUTPUT_HANDLE);
+    si.hStdError  = (wr && (flags&PROC_STDERR_OUT)) ? wr : (flags&PROC_STDERR_NULL) ? nul : GetStdHandle(STD_ERROR_HANDLE);
+
+    fflush(stdout);
+    BOOL ok=CreateProcessA(NULL,cl,NULL,NULL,TRUE,0,NULL,NULL,&si,&pi);
+    if (wr) CloseHandle(wr);
+    if (nul!=INVALID_HANDLE_VALUE) CloseHandle(nul);
+    if (!ok) { if (rd) CloseHandle(rd); return -1; }
+    CloseHandle(pi.hThread);
+    p->h=pi.hProcess;
+    if (rd) p->out=_open_osfhandle((intptr_t)rd,_O_RDONLY|_O_BINARY);
+    p->alive=1;
+    return 0;
+}
+
+static int proc_wait(Proc *p, int timeout_ms) {
+    DWORD code=0;
+    if (!p->alive) return p->status;
+    if (WaitForSingleObject(p->h, timeout_ms<0 ? INFINITE : (DWORD)timeout_ms)==WAIT_TIMEOUT)
+        return PROC_TIMEOUT;
+    GetExitCodeProcess(p->h,&code);
+    CloseHandle(p->h);
+    p->alive=0; p->status=(int)code;
+    return p->status;
+}
+
+static int proc_kill(Proc *p) {
+    if (p->alive) TerminateProcess(p->h,1);
+    return proc_wait(p,-1);
+}
+
+#else
+static int g_daemon;            /* 0: not tried yet, 1: in use, -1: spawn directly */
+static volatile sig_atomic_t g_fg_sig;
+
+static int daemon_spawn(Proc *p, const Argv *a, int flags);
+static int daemon_wait(Proc *p, int timeout_ms);
+
+static void sleep_ms(int ms) {
+    struct timespec ts;
+    ts.tv_sec=ms/1000; ts.tv_nsec=(long)(ms%1000)*1000000L;
+    while (nanosleep(&ts,&ts)<0 && errno==EINTR) {}
+}
+
+static int proc_spawn(Proc *p, const Argv *a, int flags) {
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t at;
+    sigset_t def;
+    int pfd[2]={-1,-1}, ifd[2]={-1,-1}, rc;
+
+    memset(p,0,sizeof(*p)); p->out=-1; p->in=-1; p->ctl=-1;
+    if (!strcmp(a->v[0],"yt-dlp") && !(flags&PROC_STDIN_PIPE) && daemon_spawn(p,a,flags)==0) return 0;
+    if (flags&PROC_STDOUT_PIPE) {
+        if (pipe(pfd)!=0) return -1;
+        fcntl(pfd[0],F_SETFD,FD_CLOEXEC);
+        fcntl(pfd[1],F_SETFD,FD_CLOEXEC);
+    }
+    if (flags&PROC_STDIN_PIPE) {
+        if (pipe(ifd)!=0) { if (pfd[0]>=0) { close(pfd[0]); close(pfd[1]); } return -1; }
+        fcntl(ifd[0],F_SETFD,FD_CLOEXEC);
+        fcntl(ifd[1],F_SETFD,FD_CLOEXEC);
+    }
+    posix_spawn_file_actions_init(&fa);
+    if (ifd[0]>=0)              posix_spawn_file_actions_adddup2(&fa,ifd[0],0);
+    else if (flags&PROC_STDIN_NULL) posix_spawn_file_actions_addopen(&fa,0,DEVNULL,O_RDONLY,0);
+    if (pfd[1]>=0)              posix_spawn_file_actions_adddup2(&fa,pfd[1],1);
+    else if (flags&PROC_STDOUT_NULL) posix_spawn_file_actions_addopen(&fa,1,DEVNULL,O_WRONLY,0);
+    if (pfd[1]>=0 && (flags&PROC_STDERR_OUT)) posix_spawn_file_actions_adddup2(&fa,pfd[1],2);
+    else if (flags&PROC_STDERR_NULL)          posix_spawn_file_actions_addopen(&fa,2,DEVNULL,O_WRONLY,0);
+
+    /* children start with default ^C / SIGPIPE handling whatever ours is */
+    posix_spawnattr_init(&at);
+    sigemptyset(&def);
+    sigaddset(&def,SIGINT); sigaddset(&def,SIGQUIT); sigaddset(&def,SIGPIPE);
+    posix_spawnattr_setsigdefault(&at,&def);
+    posix_spawnattr_setflags(&at,POSIX_SPAWN_SETSIGDEF);
+
+    fflush(stdout);
+    rc=posix_spawnp(&p->pid,a->v[0],&fa,&at,a->v,environ);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&at);
+    if (pfd[1]>=0) close(pfd[1]);
+    if (ifd[0]>=0) close(ifd[0]);
+    if (rc!=0) {
+        if (pfd[0]>=0) close(pfd[0]);
+        if (ifd[1]>=0) close(ifd[1]);
+        errno=rc; return -1;
+    }
+    if (pfd[0]>=0) fcntl(pfd[0],F_SETFL,fcntl(pfd[0],F_GETFL)|O_NONBLOCK);
+    if (ifd[1]>=0) fcntl(ifd[1],F_SETFL,fcntl(ifd[1],F_GETFL)|O_NONBLOCK);
+    p->out=pfd[0]; p->in=ifd[1];
+    p->alive=1;
+    return 0;
+}
+
+/* Reap, waiting up to timeout_ms (<0: forever). PROC_TIMEOUT if still running. */
+static int proc_wait(Proc *p, int timeout_ms) {
+    int st=0, waited=0, step=1;
+    if (!p->alive) return p->status;
+    if (p->ctl>=0) return daemon_wait(p,timeout_ms);
+    for (;;) {
+        pid_t r=waitpid(p->pid,&st,timeout_ms<0 ? 0 : WNOHANG);
+        if (r==p->pid) break;
+        if (r<0 && errno!=EINTR) { p->alive=0; return p->status=-1; }
+        if (r==0) {
+            if (waited>=timeout_ms) return PROC_TIMEOUT;
+            sleep_ms(step); waited+=step;
+            if (step<16) step*=2;           /* a killed child is usually gone in <1 ms */
+        }
+    }
+    p->alive=0;
+    p->status = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+    return p->status;
+}
+
+/* SIGTERM, then SIGKILL if it hasn't gone within a second; reaps. */
+static int proc_kill(Proc *p) {
+    if (!p->alive) return p->status;
+    if (p->ctl>=0) {                    /* hanging up makes the daemon kill it */
+        close(p->ctl); p->ctl=-1;
+        p->alive=0;
+        return p->status=-1;
+    }
+    kill(p->pid,SIGTERM);
+    if (proc_wait(p,1000)!=PROC_TIMEOUT) return p->status;
+    kill(p->pid,SIGKILL);
+    return proc_wait(p,-1);
+}
+
+#endif
+
+static void proc_close(Proc *p) {
+    if (p->out>=0) { close(p->out); p->out=-1; }
+    if (p->in>=0)  { close(p->in);  p->in=-1; }
+#ifndef PLATFORM_WINDOWS
+    if (p->ctl>=0) { close(p->ctl); p->ctl=-1; }
+#endif
+}
+
+/*
+ *  Run to completion with the terminal attached (players, downloads).
+ *  Like system(), ^C goes to the child while we wait instead of
+ *  killing ytplay mid-cleanup. Returns the exit code, -1 if it could
+ *  not be started or died from a signal. A daemon worker is not in our
+ *  process group, so ^C reaches it by way of g_fg_sig and a hang-up.
+ */
+#ifndef PLATFORM_WINDOWS
+static void on_fg_sig(int sig) { (void)sig; g_fg_sig=1; }
+
+static void set_cloexec(int fd) { fcntl(fd,F_SETFD,FD_CLOEXEC); }
+static void set_nonblock(int fd) { fcntl(fd,F_SETFL,fcntl(fd,F_GETFL)|O_NONBLOCK); }
+#endif
+
+static int proc_run(const Argv *a, int flags, int timeout_ms) {
+    Proc p;
+    int rc;
+#ifdef PLATFORM_WINDOWS
+    if (flags&PROC_FOREGROUND) SetConsoleCtrlHandler(NULL,TRUE);
+    rc = proc_spawn(&p,a,flags)==0 ? proc_wait(&p,timeout_ms) : -1;
+    if (rc==PROC_TIMEOUT) rc=proc_kill(&p);
+    if (flags&PROC_FOREGROUND) SetConsoleCtrlHandler(NULL,FALSE);
+#else
+    struct sigaction sa, oint, oquit;
+    memset(&sa,0,sizeof(sa)); sa.sa_handler=on_fg_sig;
+    g_fg_sig=0;
+    if (flags&PROC_FOREGROUND) { sigaction(SIGINT,&sa,&oint); sigaction(SIGQUIT,&sa,&oquit); }
+    rc = proc_spawn(&p,a,flags)==0 ? proc_wait(&p,timeout_ms) : -1;
+    if (rc==PROC_TIMEOUT) rc=proc_kill(&p);
+    if (flags&PROC_FOREGROUND) { sigaction(SIGINT,&oint,NULL); sigaction(SIGQUIT,&oquit,NULL); }
+#endif
+    return rc;
+}
+
+/* Executable regular file at path? Fills its mtime. */
+static int is_exec(const char *path, long long *mtime) {
+    struct stat st;
+    if (stat(path,&st)!=0 || (st.st_mode&S_IFMT)!=S_IFREG || access(path,X_OK)!=0) return 0;
+    if (mtime) *mtime=(long long)st.st_mtime;
+    return 1;
+}
+
+/*
+ *  Resolve a command name the way the spawner will: names with a
+ *  directory part are taken as-is, anything else is looked up in each
+ *  $PATH entry (trying %PATHEXT% suffixes on Windows). No process is
+ *  started. Returns 1 with the full path in out.
+ */
+static int path_lookup(const char *name, char *out, size_t n, long long *mtime) {
+    const char *p=getenv("PATH"), *e;
+#ifdef PLATFORM_WINDOWS
+    static const char *ext[]={"",".exe",".com",".bat",".cmd",NULL};
+    if (strpbrk(name,"\\/:")) {
+#else
+    static const char *ext[]={"",NULL};
+    if (strchr(name,'/')) {
+#endif
+        snprintf(out,n,"%s",name);
+        return is_exec(out,mtime);
+    }
+    if (!p) return 0;
+    for (; ; p=e+1) {
+        size_t dl;
+        e=strchr(p,PATH_LIST);
+        if (!e) e=p+strlen(p);
+        dl=(size_t)(e-p);
+        for (int i=0; ext[i]; i++) {
+            if (dl) snprintf(out,n,"%.*s" PATH_SEP "%s%s",(int)dl,p,name,ext[i]);
+            else    snprintf(out,n,"%s%s",name,ext[i]);   /* empty entry = cwd */
+            if (is_exec(out,mtime)) return 1;
+        }
+        if (!*e) break;
+    }
+    return 0;
+}
+
+static int cmd_exists(const char *name) {
+    char path[1024];
+    return path_lookup(name,path,sizeof(path),NULL);
+}
+
+/* ─── Line reader ────────────────────────────────────────────── */
+/*
+ *  Buffered line splitter over a raw fd, so the same descriptor can be
+ *  poll()ed: lr_fill() does at most one read() and copes with
+ *  non-blocking fds, lr_next() hands out complete lines in place. The
+ *  buffer doubles to fit lines of any length, and the largest buffer a
+ *  finished reader had is kept for the next one, so repeated searches
+ *  don't reallocate.
+ */
+typedef struct {
+    int    fd;
+    char  *buf;
+    size_t start, len, cap;
+    size_t scanned;             /* bytes after start known to hold no '\n' */
+    int    eof;
+} LineReader;
+
+static struct { char *buf; size_t cap; } g_lr_spare;
+
+static void lr_init(LineReader *lr, int fd, size_t cap) {
+    memset(lr,0,sizeof(*lr));
+    lr->fd=fd;
+    if (g_lr_spare.buf && g_lr_spare.cap>=cap) {
+        lr->buf=g_lr_spare.buf; lr->cap=g_lr_spare.cap;
+        g_lr_spare.buf=NULL; g_lr_spare.cap=0;
+        return;
+    }
+    lr->cap=cap;
+    lr->buf=(char*)malloc(cap+1);
+    if (!lr->buf) die("Out of memory");
+}
+
+static void lr_free(LineReader *lr) {
+    if (lr->cap>g_lr_spare.cap) {
+        free(g_lr_spare.buf);
+        g_lr_spare.buf=lr->buf; g_lr_spare.cap=lr->cap;
+    } else free(lr->buf);
+    lr->buf=NULL;
+}
+
+/* One read() worth of input. Returns 0 once the fd hits EOF. */
+static int lr_fill(LineReader *lr) {
+    if (lr->eof) return 0;
+    if (lr->start>0) {
+        memmove(lr->buf,lr->buf+lr->start,lr->len-lr->start);
+        lr->len-=lr->start; lr->start=0;
+    }
+    if (lr->len==lr->cap) {
+        char *nb=(char*)realloc(lr->buf,lr->cap*2+1);
+        if (!nb) die("Out of memory");
+        lr->buf=nb; lr->cap*=2;
+    }
+    long r;
+    do r=(long)READ(lr->fd,lr->buf+lr->len,lr->cap-lr->len);
+#ifndef PLATFORM_WINDOWS
+    while (r<0 && errno==EINTR);
+    if (r<0 && (errno==EAGAIN||errno==EWOULDBLOCK)) return 1;   /* nothing yet */
+#else
+    while (0);
+#endif
+    if (r<=0) { lr->eof=1; return 0; }
+    lr->len+=(size_t)r;
+    return 1;
+}
+
+/*
+ *  Block until the next lr_fill() has something to do (non-blocking
+ *  fds), for at most timeout_ms (<0: forever). 0 on timeout.
+ */
+static int lr_wait(LineReader *lr, int timeout_ms) {
+#ifndef PLATFORM_WINDOWS
+    struct pollfd pf;
+    int r;
+    pf.fd=lr->fd; pf.events=POLLIN; pf.revents=0;
+    if (lr->eof) return 1;
+    while ((r=poll(&pf,1,timeout_ms))<0 && errno==EINTR) {}
+    return r!=0;
+#else
+    (void)lr; (void)timeout_ms;
+    return 1;
+#endif
+}
+
+/* Next complete line, newline stripped and NUL-terminated, or NULL. */
+static char *lr_next(LineReader *lr, size_t *n) {
+    char *s=lr->buf+lr->start;
+    size_t avail=lr->len-lr->start;
+    char *nl=(char*)memchr(s+lr->scanned,'\n',avail-lr->scanned);
+    if (!nl) {
+        lr->scanned=avail;                  /* a long line: don't rescan it */
+        if (!lr->eof || !avail) return NULL;
+        nl=s+avail;                         /* unterminated last line */
+    }
+    *nl='\0';
+    lr->start=(size_t)(nl-lr->buf)+(nl<lr->buf+lr->len ? 1 : 0);
+    lr->scanned=0;
+    *n=(size_t)(nl-s);
+    if (*n && s[*n-1]=='\r') s[--*n]='\0';
+    return s;
+}
+
+/* ─── Banner ─────────────────────────────────────────────────── */
+static void print_banner(void) {
+    printf("\n");
+    printf("%s"
+"  ██╗   ██╗████████╗██████╗ ██╗      █████╗ ██╗   ██╗\n"
+"  ╚██╗ ██╔╝╚══██╔══╝██╔══██╗██║     ██╔══██╗╚██╗ ██╔╝\n"
+"   ╚████╔╝    ██║   ██████╔╝██║     ███████║ ╚████╔╝ \n"
+"    ╚██╔╝     ██║   ██╔═══╝ ██║     ██╔══██║  ╚██╔╝  \n"
+"     ██║      ██║   ██║     ███████╗██║  ██║   ██║   \n"
+"     ╚═╝      ╚═╝   ╚═╝     ╚══════╝╚═╝  ╚═╝   ╚═╝   \n"
+    "%s", C_CYN, C_RST);
+    printf("  %sStream · Search · Download  —  v%s%s\n\n",
+           C_DIM, YTPLAY_VERSION, C_RST);
+
+    /*
+     * Box inner text (between │ and │), visible chars:
+     * "  Linux · macOS · Windows  —  yt-dlp  " = 40 visible chars
+     * Box border uses "────────────────────────────────────────" = 40 dashes
+     * So │ + 40 chars + │ is perfectly flush.
+     */
+    printf("  %s┌────────────────────────────────────┐%s\n",C_MAG,C_RST);
+    printf("  %s│%s  %sLinux%s - %smacOS%s - %sWindows%s - yt-dlp  %s│%s\n",
+           C_MAG,C_RST, C_GRN,C_RST, C_YLW,C_RST, C_CYN,C_RST, C_MAG,C_RST);
+    printf("  %s└────────────────────────────────────┘%s\n\n",C_MAG,C_RST);
+}
+
+/* ─── Help ───────────────────────────────────────────────────── */
+static void print_help(const char *prog) {
+    print_banner();
+    printf("  %sUSAGE%s\n    %s [OPTIONS] <search query>\n\n", C_BLD, C_RST, prog);
+
+    printf("  %sSEARCH%s\n", C_YLW, C_RST);
+    printf("    %-28s  Results per page (default %d)\n",      "-n, --results <N>",DEFAULT_RESULTS);
+    printf("    %-28s  Auto-play first result, skip menu\n",   "-1, --first");
+    printf("    %-28s  Search as you type, pick with ↑/↓ Enter\n","-i, --interactive");
+    printf("    %-28s  Queries per line → NDJSON results, -j at once\n","    --batch <FILE|->");
+    printf("    %-28s  Fill in date, likes, formats as rows show\n","    --enrich");
+    printf("    %-28s  Search downloads on disk only, offline\n","    --local");
+    printf("    %-28s  Suppress ASCII banner\n",               "--no-banner");
+    printf("    %-28s  Bypass the search result cache\n",       "--no-cache");
+    printf("    %-28s  Re-run the search and startup probing\n",  "--refresh");
+    printf("    %-28s  Cache lifetime (default %d)\n\n",         "--cache-ttl <SEC>",SCACHE_TTL);
+
+    printf("  %sPLAYBACK%s\n", C_YLW, C_RST);
+    printf("    %-28s  Stream — no file saved [default]\n",    "-s, --stream");
+    printf("    %-28s  Download (or reuse a stored copy), then play\n","-d, --download");
+    printf("    %-28s  Keep downloaded file (pin it in the store)\n","-k, --keep");
+    printf("    %-28s  Download store budget (default %d)\n",   "    --store-size <MB>",DEFAULT_STORE_MB);
+    printf("    %-28s  Download to -o / temp dir, not the store\n","    --no-store");
+    printf("    %-28s  -d over N parallel range requests\n",   "    --connections <N>");
+    printf("    %-28s  Download, start playing while it runs\n", "-P, --progressive");
+    printf("    %-28s  Head start for -P (default %ds)\n",      "    --buffer <SEC|MB>",DEFAULT_BUFFER);
+    printf("    %-28s  Play ids / URLs / --batch lines in a row\n","    --queue <FILE|->");
+    printf("    %-28s  Continue an interrupted queue\n",        "    --resume");
+    printf("    %-28s  Download several results, no playback\n","-b, --bulk");
+    printf("    %-28s  Pick for --bulk: 1,3,5-9 or all\n",       "    --select <SPEC>");
+    printf("    %-28s  Parallel downloads / searches (default %d)\n","-j, --jobs <N>",DEFAULT_JOBS);
+    printf("    %-28s  Retries per item (default %d)\n",         "    --retries <N>",DEFAULT_RETRIES);
+    printf("    %-28s  Audio only\n",                           "-a, --audio-only");
+    printf("    %-28s  yt-dlp format string\n",                 "-q, --quality <FMT>");
+    printf("    %-28s  Preset: 4K\n",                           "    --4k");
+    printf("    %-28s  Preset: 1080p [default]\n",              "    --1080");
+    printf("    %-28s  Preset: 720p\n",                         "    --720");
+    printf("    %-28s  Preset: 480p\n",                         "    --480");
+    printf("    %-28s  Preset: 360p\n",                         "    --360");
+    printf("    %-28s  Worst quality / fastest\n",              "    --worst");
+    printf("    %-28s  Highest preset the link sustains\n",   "    --auto-quality");
+    printf("    %-28s  Subtitles language  e.g. en, pl\n\n",   "    --subs <LANG>");
+
+    printf("  %sPLAYER%s\n", C_YLW, C_RST);
+    printf("    %-28s  mpv  vlc  ffplay  iina  mplayer\n", "-p, --player <NAME>");
+    printf("    %-28s  Resolve top K stream URLs while you pick\n","    --prefetch <K>");
+    printf("    %-28s  No background resolving (metered links)\n", "    --no-prefetch");
+    printf("    %-28s  vlc/ffplay/mplayer read yt-dlp's stream\n",  "    --pipe");
+    printf("    %-28s  Serve warm yt-dlp workers to other runs\n",  "    --daemon");
+    printf("    %-28s  Run yt-dlp directly, not via a daemon\n",    "    --no-daemon");
+    printf("    %-28s  Extra flags for player\n",          "    --player-args <ARGS>");
+    printf("    %-28s  Extra flags for yt-dlp\n\n",        "    --ytdlp-args <ARGS>");
+
+    printf("  %sHISTORY%s\n", C_YLW, C_RST);
+    printf("    %-28s  Ready habitual plays and searches, exit\n","    --warm");
+    printf("    %-28s  Download budget of --warm (default %d)\n","    --warm-mb <MB>",DEFAULT_WARM_MB);
+    printf("    %-28s  Bandwidth cap for --warm, e.g. 2M\n",  "    --warm-rate <RATE>");
+    printf("    %-28s  Don't log searches and plays\n\n",     "    --no-history");
+
+    printf("  %sOUTPUT%s\n", C_YLW, C_RST);
+    printf("    %-28s  Download here, not to the store\n",      "-o, --output <DIR>");
+    printf("    %-28s  Disable colours\n",                          "    --no-color");
+    printf("    %-28s  Minimal output\n",                           "    --quiet");
+    printf("    %-28s  Show raw yt-dlp / player commands\n",        "-v, --verbose");
+    printf("    %-28s  Per-phase latency summary on exit\n",        "    --timings");
+    printf("    %-28s  Write a Chrome trace-event JSON file\n\n",   "    --trace <FILE>");
+
+    printf("  %sEXAMPLES%s\n", C_GRN, C_RST);
+    printf("    %s \"lofi hip hop\"\n",                prog);
+    printf("    %s -1 \"rick astley\"\n",              prog);
+    printf("    %s -d -k --1080 \"big buck bunny\"\n", prog);
+    printf("    %s -b --select 1-5 -j 4 \"podcast\"\n", prog);
+    printf("    %s -a \"beethoven moonlight\"\n",      prog);
+    printf("    %s -p vlc -n 15 \"documentaries\"\n",  prog);
+    printf("    %s --subs pl \"ted talk\"\n\n",         prog);
+}
+
+/* ─── Player detection ───────────────────────────────────────── */
+static void detect_player(char *out, size_t n) {
+#ifdef PLATFORM_MACOS
+    static const char *order[]={"iina","mpv","vlc","ffplay",NULL};
+#elif defined(PLATFORM_WINDOWS)
+    static const char *order[]={"mpv","vlc","ffplay",NULL};
+#else
+    static const char *order[]={"mpv","vlc","ffplay","mplayer",NULL};
+#endif
+    for (int i=0; order[i]; i++) {
+        if (cmd_exists(order[i])) { strncpy(out,order[i],n-1); out[n-1]='\0'; return; }
+    }
+    strncpy(out,"mpv",n-1); out[n-1]='\0';
+}
+
+/* ─── Config defaults ────────────────────────────────────────── */
+static void config_defaults(Config *c) {
+    memset(c,0,sizeof(*c));
+    c->num_results = DEFAULT_RESULTS;
+    c->stream      = 1;
+    c->cache_ttl   = SCACHE_TTL;
+    c->prefetch    = DEFAULT_PREFETCH;
+    c->buffer_secs = DEFAULT_BUFFER;
+    c->jobs        = DEFAULT_JOBS;
+    c->retries     = DEFAULT_RETRIES;
+    c->store_mb    = DEFAULT_STORE_MB;
+    c->warm_mb     = DEFAULT_WARM_MB;
+    strncpy(c->quality,DEFAULT_QUALITY,sizeof(c->quality)-1);
+    char tmp[512];
+    get_tmpdir(tmp,sizeof(tmp));
+    snprintf(c->output_dir,sizeof(c->output_dir),"%s%sytplay",tmp,PATH_SEP);
+}
+
+/* ─── Argument parsing ───────────────────────────────────────── */
+static void parse_args(int argc, char **argv, Config *c) {
+    int download=0;                     /* -d, -P, -b or --select given */
+    if (argc<2) { print_help(argv[0]); exit(0); }
+#define NEED() do{ if(++i>=argc) die("'%s' needs an argument",a); }while(0)
+    for (int i=1; i<argc; i++) {
+        const char *a=argv[i];
+        if (!strcmp(a,"--help")||!strcmp(a,"-h"))      { print_help(argv[0]); exit(0); }
+        else if (!strcmp(a,"--version"))                { printf("ytplay %s\n",YTPLAY_VERSION); exit(0); }
+        else if (!strcmp(a,"-n")||!strcmp(a,"--results")){ NEED(); c->num_results=atoi(argv[i]); if(c->num_results<1)c->num_results=1; }
+        else if (!strcmp(a,"-1")||!strcmp(a,"--first")) { c->direct_play=1; c->num_results=1; }
+        else if (!strcmp(a,"-i")||!strcmp(a,"--interactive")) c->interactive=1;
+        else if (!strcmp(a,"--enrich"))  c->enrich=1;
+        else if (!strcmp(a,"--local"))   c->local=1;
+        else if (!strcmp(a,"--batch"))  { NEED(); strncpy(c->batch,argv[i],sizeof(c->batch)-1); }
+        else if (!strcmp(a,"--queue"))  { NEED(); strncpy(c->queue,argv[i],sizeof(c->queue)-1); }
+        else if (!strcmp(a,"--resume"))  c->resume=1;
+        else if (!strcmp(a,"--no-history")) c->no_history=1;
+        else if (!strcmp(a,"--warm"))    c->warm=1;
+        else if (!strcmp(a,"--warm-mb")) { NEED(); c->warm_mb=atol(argv[i]); if(c->warm_mb<0)c->warm_mb=0; }
+        else if (!strcmp(a,"--warm-rate")) { NEED(); strncpy(c->warm_rate,argv[i],sizeof(c->warm_rate)-1); }
+        else if (!strcmp(a,"-s")||!strcmp(a,"--stream"))   c->stream=1;
+        else if (!strcmp(a,"-d")||!strcmp(a,"--download")) { c->stream=0; download=1; }
+        else if (!strcmp(a,"--pipe"))                      { c->stream=1; c->pipe=1; }
+        else if (!strcmp(a,"-k")||!strcmp(a,"--keep"))     c->keep=1;
+        else if (!strcmp(a,"--no-store"))                  c->no_store=1;
+        else if (!strcmp(a,"--connections")) { NEED(); c->connections=atoi(argv[i]); if(c->connections<0)c->connections=0; if(c->connections>MAX_CONNECTIONS)c->connections=MAX_CONNECTIONS; }
+        else if (!strcmp(a,"--store-size")) { NEED(); c->store_mb=atol(argv[i]); if(c->store_mb<0)c->store_mb=0; }
+        else if (!strcmp(a,"-P")||!strcmp(a,"--progressive")) { c->stream=0; c->progressive=1; download=1; }
+        else if (!strcmp(a,"-b")||!strcmp(a,"--bulk"))     { c->stream=0; c->bulk=1; download=1; }
+        else if (!strcmp(a,"--select"))  { NEED(); strncpy(c->select,argv[i],sizeof(c->select)-1); c->stream=0; c->bulk=1; download=1; }
+        else if (!strcmp(a,"-j")||!strcmp(a,"--jobs"))     { NEED(); c->jobs=atoi(argv[i]); if(c->jobs<1)c->jobs=1; }
+        else if (!strcmp(a,"--retries")) { NEED(); c->retries=atoi(argv[i]); if(c->retries<0)c->retries=0; }
+        else if (!strcmp(a,"--buffer")) {
+            char *end; double v;
+            NEED();
+            v=strtod(argv[i],&end);
+            if (end==argv[i] || v<0) die("Bad --buffer '%s' (e.g. 15, 15s, 20M)",argv[i]);
+            if (*end=='M'||*end=='m') { c->buffer_bytes=(long)(v*1024*1024); c->buffer_secs=0; }
+            else                      { c->buffer_secs=(long)v; c->buffer_bytes=0; }
+            c->stream=0; c->progressive=1;
+        }
+        else if (!strcmp(a,"-a")||!strcmp(a,"--audio-only")){ c->audio_only=1; strncpy(c->quality,"bestaudio",sizeof(c->quality)-1); }
+        else if (!strcmp(a,"-q")||!strcmp(a,"--quality"))  { NEED(); strncpy(c->quality,argv[i],sizeof(c->quality)-1); }
+        else if (!strcmp(a,"--4k"))   strncpy(c->quality,"bestvideo[height<=2160]+bestaudio/best",sizeof(c->quality)-1);
+        else if (!strcmp(a,"--1080")) strncpy(c->quality,"bestvideo[height<=1080]+bestaudio/best[height<=1080]",sizeof(c->quality)-1);
+        else if (!strcmp(a,"--720"))  strncpy(c->quality,"bestvideo[height<=720]+bestaudio/best[height<=720]",sizeof(c->quality)-1);
+        else if (!strcmp(a,"--480"))  strncpy(c->quality,"bestvideo[height<=480]+bestaudio/best[height<=480]",sizeof(c->quality)-1);
+        else if (!strcmp(a,"--360"))  strncpy(c->quality,"bestvideo[height<=360]+bestaudio/best[height<=360]",sizeof(c->quality)-1);
+        else if (!strcmp(a,"--worst"))strncpy(c->quality,"worst",sizeof(c->quality)-1);
+        else if (!strcmp(a,"--auto-quality")) c->auto_quality=1;
+        else if (!strcmp(a,"--subs")) { NEED(); strncpy(c->subtitle_lang,argv[i],sizeof(c->subtitle_lang)-1); }
+        else if (!strcmp(a,"-p")||!strcmp(a,"--player"))     { NEED(); strncpy(c->player,argv[i],sizeof(c->player)-1); }
+        else if (!strcmp(a,"--prefetch"))                     { NEED(); c->prefetch=atoi(argv[i]); if(c->prefetch<0)c->prefetch=0; if(c->prefetch>MAX_PREFETCH)c->prefetch=MAX_PREFETCH; }
+        else if (!strcmp(a,"--no-prefetch"))                  c->prefetch=0;
+        else if (!strcmp(a,"--daemon"))                       c->daemon=1;
+        else if (!strcmp(a,"--no-daemon"))                    c->no_daemon=1;
+        else if (!strcmp(a,"--player-args"))                  { NEED(); strncpy(c->extra_player,argv[i],sizeof(c->extra_player)-1); }
+        else if (!strcmp(a,"--ytdlp-args"))                   { NEED(); strncpy(c->extra_ytdlp,argv[i],sizeof(c->extra_ytdlp)-1); }
+        else if (!strcmp(a,"-o")||!strcmp(a,"--output"))     { NEED(); strncpy(c->output_dir,argv[i],sizeof(c->output_dir)-1); c->output_set=1; }
+        else if (!strcmp(a,"--no-color"))  g_color=0;
+        else if (!strcmp(a,"--quiet"))     c->quiet=1;
+        else if (!strcmp(a,"-v")||!strcmp(a,"--verbose")) c->verbose=1;
+        else if (!strcmp(a,"--no-banner")) c->no_banner=1;
+        else if (!strcmp(a,"--no-cache"))  c->no_cache=1;
+        else if (!strcmp(a,"--refresh"))   c->refresh=1;
+        else if (!strcmp(a,"--timings"))   g_trace|=1;
+        else if (!strcmp(a,"--trace"))     { NEED(); strncpy(g_trace_file,argv[i],sizeof(g_trace_file)-1); g_trace|=2; }
+        else if (!strcmp(a,"--cache-ttl")) { NEED(); c->cache_ttl=atol(argv[i]); if(c->cache_ttl<0)c->cache_ttl=0; }
+        else if (a[0]=='-')                die("Unknown option: %s  (use --help)",a);
+        else {
+            size_t qlen=strlen(c->query);
+            if (qlen>0 && qlen<sizeof(c->query)-2) { c->query[qlen]=' '; c->query[qlen+1]='\0'; }
+            strncat(c->query,a,sizeof(c->query)-strlen(c->query)-1);
+        }
+    }
+#undef NEED
+    if (c->pipe && download) die("--pipe streams; it can't be combined with -d, -P, -b or --select");
+    if (!strlen(c->query) && !c->interactive && !c->daemon && !c->batch[0] && !c->queue[0] && !c->resume && !c->warm) die("No search query provided. Use --help.");
+}
+
+/* ─── YouTube search ─────────────────────────────────────────── */
+/*
+ *  We use:
+ *    yt-dlp --flat-playlist --dump-json "ytsearch<N>:<query>"
+ *
+ *  --flat-playlist  →  one compact JSON object per line, very fast
+ *                       (does NOT hit each video page)
+ *  --dump-json      →  structured JSON we can parse reliably
+ *
+ *  Fields we extract from the flat JSON:
+ *    id, title, duration (seconds), view_count, channel / uploader
+ *
+ *  The full watch URL is reconstructed as:
+ *    https://www.youtube.com/watch?v=<id>
+ */
+typedef struct {
+    LineReader lr;
+    Proc proc;
+    int done;
+    int got;                /* first byte seen (tracing) */
+    int first;              /* index of the first result this fetch adds */
+    long long t0;
+} SearchStream;
+
+/* Parse one line of yt-dlp output into r. Returns 0 for non-results. */
+static int parse_result(const char *line, size_t len, VideoResult *r) {
+    if (!len || line[0]!='{') return 0;
+    char title[2048], id[64], dur[32], views[32], channel[512], uploader[512];
+    JsonField f[] = {
+        { "title",      title,    sizeof(title),    0 },
+        { "id",         id,       sizeof(id),       0 },
+        { "duration",   dur,      sizeof(dur),      0 },
+        { "view_count", views,    sizeof(views),    0 },
+        { "channel",    channel,  sizeof(channel),  0 },
+        { "uploader",   uploader, sizeof(uploader), 0 },
+    };
+    json_fields(line, len, f, (int)(sizeof(f)/sizeof(f[0])), 5);   /* uploader: fallback */
+    if (!f[0].found || !f[1].found) return 0;
+
+    const char *ch = f[4].found && channel[0] ? channel : f[5].found && uploader[0] ? uploader : "Unknown";
+    r->title    = intern(title,strlen(title));
+    r->id       = intern(id,strlen(id));
+    r->channel  = intern(ch,strlen(ch));
+    r->duration = f[2].found ? atol(dur)   : 0;
+    r->views    = f[3].found ? atol(views) : 0;
+    return 1;
+}
+
+/*
+ *  The search for query. With first>0 it fetches the page of num_results
+ *  hits starting there: the same ytsearch, widened, with -I selecting
+ *  the range.
+ */
+static void search_argv(Config *c, const char *query, int first, Argv *a) {
+    argv_add(a,"yt-dlp"); argv_add(a,"--no-warnings");
+    argv_add(a,"--flat-playlist"); argv_add(a,"--dump-json");
+    if (first>0) { argv_add(a,"-I"); argv_addf(a,"%d:%d",first+1,first+c->num_results); }
+    argv_addf(a,"ytsearch%d:%s",first+c->num_results,query);
+}
+
+/* Launch the search; results are collected with search_pump(). A page (first>0) is appended. */
+static void search_youtube(Config *c, SearchStream *ss, int first) {
+    Argv a={0};
+    search_argv(c,c->query,first,&a);
+
+    if (c->verbose && !first) { argv_show("yt-dlp",&a); putchar('\n'); }
+
+    memset(ss,0,sizeof(*ss));
+    if (!first) results_reset();
+    ss->first=first;
+    ss->t0=trace_now();
+    if (proc_spawn(&ss->proc,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL)!=0)
+        die("Failed to launch yt-dlp. Is it installed and in PATH?");
+    trace_span("search.spawn",0,ss->t0);
+    argv_free(&a);
+    lr_init(&ss->lr,ss->proc.out,64*1024);
+}
+
+/*
+ *  Read whatever yt-dlp has written so far and append the complete
+ *  results to g_results. Does at most one read(); sets ss->done
+ *  at end of output. Returns the number of new results.
+ */
+static int search_pump(SearchStream *ss) {
+    int before=g_nresults;
+    char *line; size_t len;
+    if (!lr_fill(&ss->lr)) ss->done=1;
+    if (!ss->got && ss->lr.len) { ss->got=1; trace_mark("search.first_byte",0); }
+    while ((line=lr_next(&ss->lr,&len))) {
+        VideoResult r;
+        long long t=trace_now();
+        int ok=parse_result(line,len,&r);
+        trace_span("json.parse",0,t);
+        if (!ok) continue;
+        *results_add()=r;
+        if (g_nresults==1) trace_mark("search.first_result",0);
+    }
+    if (ss->done && !ss->first) { trace_mark("search.last_line",0); trace_span("search",0,ss->t0); }
+    if (ss->done && ss->first) trace_span("search.page",0,ss->t0);
+    return g_nresults-before;
+}
+
+/* Reap the search, killing it first if it is still producing output. */
+static void search_stop(SearchStream *ss) {
+    if (!ss->done) trace_span(ss->first ? "search.page" : "search",0,ss->t0);
+    if (ss->lr.eof) proc_wait(&ss->proc,-1);
+    else            proc_kill(&ss->proc);
+    proc_close(&ss->proc);
+    lr_free(&ss->lr);
+}
+
+/* ─── Search result cache ────────────────────────────────────── */
+/*
+ *  <cachedir>/search.bin — a compact little-endian binary file:
+ *
+ *    header   "YTSC"  u32 version  u64 hits  u64 misses
+ *    record   u32 size-of-rest
+ *             u32 num_results  i64 stored  i64 expires  i64 last_access
+ *             str normalized-query   u32 count
+ *             count × { str title, id, channel  i64 duration, views }
+ *
+ *  where str = u16 length + bytes.  A hit rewrites only the 8-byte
+ *  access stamp (and the counters) in place; a store rewrites the file,
+ *  dropping expired records and the least recently used ones until the
+ *  whole thing fits in SCACHE_MAX_SIZE.
+ */
+#define SCACHE_MAGIC   "YTSC"
+#define SCACHE_VERSION 2u
+#define SCACHE_HDR     24
+
+typedef struct { unsigned char *p; size_t len, cap; } Buf;
+typedef struct { const unsigned char *p, *end; int ok; } Rd;
+
+static void buf_put(Buf *b, const void *d, size_t n) {
+    if (b->len+n > b->cap) {
+        size_t nc = b->cap ? b->cap*2 : 4096;
+        while (nc < b->len+n) nc*=2;
+        unsigned char *np=(unsigned char*)realloc(b->p,nc);
+        if (!np) die("Out of memory");
+        b->p=np; b->cap=nc;
+    }
+    memcpy(b->p+b->len,d,n); b->len+=n;
+}
+static void put_le(unsigned char *o, unsigned long long v, int n) {
+    for (int i=0; i<n; i++) o[i]=(unsigned char)(v>>(8*i));
+}
+static void buf_u32(Buf *b, unsigned long v)      { unsigned char o[4]; put_le(o,v,4); buf_put(b,o,4); }
+static void buf_i64(Buf *b, long long v)          { unsigned char o[8]; put_le(o,(unsigned long long)v,8); buf_put(b,o,8); }
+static void buf_str(Buf *b, const char *s) {
+    size_t n=strlen(s); if (n>0xffff) n=0xffff;
+    unsigned char o[2]; put_le(o,n,2); buf_put(b,o,2); buf_put(b,s,n);
+}
+
+static unsigned long long rd_le(Rd *r, int n) {
+    if (!r->ok || r->end-r->p < n) { r->ok=0; return 0; }
+    unsigned long long v=0;
+    for (int i=0; i<n; i++) v|=(unsigned long long)r->p[i]<<(8*i);
+    r->p+=n; return v;
+}
+static void rd_str(Rd *r, char *out, size_t n) {
+    size_t len=(size_t)rd_le(r,2);
+    if (!r->ok || (size_t)(r->end-r->p) < len) { r->ok=0; out[0]='\0'; return; }
+    size_t c = len<n-1 ? len : n-1;
+    memcpy(out,r->p,c); out[c]='\0';
+    r->p+=len;
+}
+/* A str straight into the result arena. */
+static const char *rd_intern(Rd *r) {
+    size_t len=(size_t)rd_le(r,2);
+    if (!r->ok || (size_t)(r->end-r->p) < len) { r->ok=0; return ""; }
+    r->p+=len;
+    return intern((const char*)r->p-len,len);
+}
+
+static struct { unsigned long long hits, misses; } g_scache_stats;
+
+static int scache_path(char *out, size_t n) {
+    char dir[1024];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%ssearch.bin",dir,PATH_SEP);
+    return 1;
+}
+
+static int scache_header_ok(const unsigned char *d, size_t len) {
+    Rd r={d+4,d+len,1};
+    return len>=SCACHE_HDR && !memcmp(d,SCACHE_MAGIC,4) && rd_le(&r,4)==SCACHE_VERSION;
+}
+
+/* Persist the lifetime hit/miss counters (header bytes 8..23) in place. */
+static void scache_bump(const char *path, int hit) {
+    FILE *f=fopen(path,"r+b");
+    unsigned char h[SCACHE_HDR];
+    if (hit) g_scache_stats.hits++; else g_scache_stats.misses++;
+    if (!f) return;
+    if (fread(h,1,sizeof(h),f)==sizeof(h) && scache_header_ok(h,sizeof(h))) {
+        Rd r={h+8,h+sizeof(h),1};
+        g_scache_stats.hits   = rd_le(&r,8) + (hit?1:0);
+        g_scache_stats.misses = rd_le(&r,8) + (hit?0:1);
+        put_le(h+8, g_scache_stats.hits,8);
+        put_le(h+16,g_scache_stats.misses,8);
+        fseek(f,8,SEEK_SET); fwrite(h+8,1,16,f);
+        fclose(f);
+        return;
+    }
+    fclose(f);
+}
+
+/*
+ *  Fill g_results from the cache. Returns the number of results, or 0
+ *  on a miss (unknown key, expired entry, unreadable file).
+ */
+static int scache_lookup(Config *c) {
+    char path[1100], key[2048];
+    if (!scache_path(path,sizeof(path))) return 0;
+    normalize_query(c->query,key,sizeof(key));
+
+    size_t len=0;
+    unsigned char *d=read_file(path,&len);
+    long long now=(long long)time(NULL);
+    int n=0;
+
+    if (d && scache_header_ok(d,len)) {
+        Rd r={d+SCACHE_HDR,d+len,1};
+        while (r.ok && r.p<r.end && !n) {
+            size_t size=(size_t)rd_le(&r,4);
+            if (!r.ok || (size_t)(r.end-r.p)<size) break;
+            Rd rec={r.p,r.p+size,1};
+            r.p+=size;
+
+            int nres=(int)rd_le(&rec,4);
+            rd_le(&rec,8);
+            long long expires=(long long)rd_le(&rec,8);
+            const unsigned char *atime=rec.p;
+            rd_le(&rec,8);
+            char k[2048]; rd_str(&rec,k,sizeof(k));
+            if (!rec.ok || nres!=c->num_results || expires<=now || strcmp(k,key)) continue;
+
+            int count=(int)rd_le(&rec,4);
+            results_reset();
+            for (int i=0; i<count && rec.ok; i++) {
+                VideoResult v;
+                v.title   = rd_intern(&rec);
+                v.id      = rd_intern(&rec);
+                v.channel = rd_intern(&rec);
+                v.duration= (long)rd_le(&rec,8);
+                v.views   = (long)rd_le(&rec,8);
+                if (rec.ok) { *results_add()=v; n=i+1; }
+            }
+            g_nresults=n;
+            if (n) {
+                FILE *f=fopen(path,"r+b");
+                unsigned char o[8]; put_le(o,(unsigned long long)now,8);
+                if (f) { fseek(f,(long)(atime-d),SEEK_SET); fwrite(o,1,8,f); fclose(f); }
+            }
+        }
+    }
+    free(d);
+    scache_bump(path,n>0);
+    return n;
+}
+
+typedef struct { const unsigned char *p; size_t size; long long atime; } ScRec;
+
+static int screc_newer(const void *a, const void *b) {
+    long long x=((const ScRec*)a)->atime, y=((const ScRec*)b)->atime;
+    return (x<y)-(x>y);
+}
+
+/* Insert/replace the entry for the current query, then evict to fit. */
+static void scache_store(Config *c) {
+    char path[1100], tmp[1200], key[2048];
+    if (!scache_path(path,sizeof(path)) || g_nresults<=0) return;
+    normalize_query(c->query,key,sizeof(key));
+    long long now=(long long)time(NULL);
+
+    Buf nr={0};
+    buf_u32(&nr,(unsigned long)c->num_results);
+    buf_i64(&nr,now); buf_i64(&nr,now+c->cache_ttl); buf_i64(&nr,now);
+    buf_str(&nr,key);
+    buf_u32(&nr,(unsigned long)g_nresults);
+    for (int i=0; i<g_nresults; i++) {
+        VideoResult *v=&g_results[i];
+        buf_str(&nr,v->title); buf_str(&nr,v->id); buf_str(&nr,v->channel);
+        buf_i64(&nr,v->duration); buf_i64(&nr,v->views);
+    }
+
+    /* collect surviving records from the old file */
+    size_t len=0, nrec=0, cap=0;
+    unsigned char *d=read_file(path,&len);
+    ScRec *recs=NULL;
+    if (d && scache_header_ok(d,len)) {
+        Rd r={d+8,d+len,1};
+        g_scache_stats.hits   = rd_le(&r,8);
+        g_scache_stats.misses = rd_le(&r,8);
+        while (r.ok && r.p<r.end) {
+            size_t size=(size_t)rd_le(&r,4);
+            if (!r.ok || (size_t)(r.end-r.p)<size) break;
+            Rd rec={r.p,r.p+size,1};
+            int nres=(int)rd_le(&rec,4);
+            rd_le(&rec,8);
+            long long expires=(long long)rd_le(&rec,8), atime=(long long)rd_le(&rec,8);
+            char k[2048]; rd_str(&rec,k,sizeof(k));
+            if (rec.ok && expires>now && !(nres==c->num_results && !strcmp(k,key))) {
+                if (nrec==cap) {
+                    cap = cap ? cap*2 : 32;
+                    ScRec *nrp=(ScRec*)realloc(recs,cap*sizeof(*recs));
+                    if (!nrp) die("Out of memory");
+                    recs=nrp;
+                }
+                recs[nrec].p=r.p; recs[nrec].size=size; recs[nrec].atime=atime; nrec++;
+            }
+            r.p+=size;
+        }
+    }
+    if (nrec) qsort(recs,nrec,sizeof(*recs),screc_newer);
+
+    Buf out={0};
+    buf_put(&out,SCACHE_MAGIC,4); buf_u32(&out,SCACHE_VERSION);
+    buf_i64(&out,(long long)g_scache_stats.hits); buf_i64(&out,(long long)g_scache_stats.misses);
+    buf_u32(&out,(unsigned long)nr.len); buf_put(&out,nr.p,nr.len);
+    for (size_t i=0; i<nrec && out.len+4+recs[i].size<=SCACHE_MAX_SIZE; i++) {
+        buf_u32(&out,(unsigned long)recs[i].size);
+        buf_put(&out,recs[i].p,recs[i].size);
+    }
+
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    FILE *f=fopen(tmp,"wb");
+    if (f) {
+        int ok = fwrite(out.p,1,out.len,f)==out.len;
+        if (fclose(f)!=0) ok=0;
+        if (!ok || RENAME(tmp,path)!=0) remove(tmp);
+    }
+    free(out.p); free(nr.p); free(recs); free(d);
+}
+
+/* ─── Result details ─────────────────────────────────────────── */
+/*
+ *  --enrich: flat search results often lack the duration, view count or
+ *  channel, and never carry more. For the rows on screen a full
+ *  extraction runs in the background (see "Detail workers") and what it
+ *  finds is kept per video id in <cachedir>/meta.tsv for META_TTL:
+ *
+ *    <fetched> \t <id> \t <duration> \t <views> \t <likes> \t <uploaded>
+ *              \t <heights> \t <channel> \t <description excerpt>
+ *
+ *  The file is read once per run into g_meta. New entries are appended;
+ *  it is rewritten without expired or superseded lines once those
+ *  outnumber the live ones or it holds more than META_MAX.
+ */
+typedef struct {
+    char      id[16];
+    long long at;
+    long      duration, views, likes;
+    char      uploaded[12];         /* YYYY-MM-DD */
+    char      heights[48];          /* "360,720,1080" */
+    char      channel[96];
+    char      excerpt[96];
+} Meta;
+
+static Meta *g_meta;
+static int   g_nmeta;
+
+static Meta *meta_find(const char *id) {
+    for (int i=g_nmeta-1; i>=0; i--) if (!strcmp(g_meta[i].id,id)) return &g_meta[i];
+    return NULL;
+}
+
+#ifndef PLATFORM_WINDOWS
+static int   g_meta_cap, g_meta_loaded;
+
+static int meta_path(char *out, size_t n) {
+    char dir[1024];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%smeta.tsv",dir,PATH_SEP);
+    return 1;
+}
+
+/* The entry for m->id, added if new, overwritten with m. */
+static Meta *meta_set(const Meta *m) {
+    Meta *d=meta_find(m->id);
+    if (!d) {
+        if (g_nmeta==g_meta_cap) {
+            int nc = g_meta_cap ? g_meta_cap*2 : 64;
+            Meta *nm=(Meta*)realloc(g_meta,(size_t)nc*sizeof(Meta));
+            if (!nm) return NULL;
+            g_meta=nm; g_meta_cap=nc;
+        }
+        d=&g_meta[g_nmeta++];
+    }
+    *d=*m;
+    return d;
+}
+
+static void meta_write(FILE *f, const Meta *m) {
+    fprintf(f,"%lld\t%s\t%ld\t%ld\t%ld\t%s\t%s\t%s\t%s\n",m->at,m->id,m->duration,m->views,m->likes,
+            m->uploaded,m->heights,m->channel,m->excerpt);
+}
+
+/* Split one line in place. Returns 0 if malformed. */
+static int meta_split(char *line, Meta *m) {
+    char *f[9]; int nf=0;
+    for (char *p=line; nf<9; ) {
+        f[nf++]=p;
+        if (!(p=strchr(p,'\t'))) break;
+        *p++='\0';
+    }
+    if (nf<9 || !*f[1]) return 0;
+    m->at=atoll(f[0]);
+    snprintf(m->id,sizeof(m->id),"%s",f[1]);
+    m->duration=atol(f[2]); m->views=atol(f[3]); m->likes=atol(f[4]);
+    snprintf(m->uploaded,sizeof(m->uploaded),"%s",f[5]);
+    snprintf(m->heights,sizeof(m->heights),"%s",f[6]);
+    snprintf(m->channel,sizeof(m->channel),"%s",f[7]);
+    snprintf(m->excerpt,sizeof(m->excerpt),"%s",f[8]);
+    return 1;
+}
+
+static void meta_load(void) {
+    char path[1100], tmp[1200], *cur, *line;
+    size_t len;
+    int lines=0;
+    long long now=(long long)time(NULL);
+    unsigned char *d;
+    if (g_meta_loaded) return;
+    g_meta_loaded=1;
+    if (!meta_path(path,sizeof(path)) || !(d=read_file(path,&len))) return;
+    for (cur=(char*)d; (line=next_line(&cur)); lines++) {
+        Meta m;
+        if (meta_split(line,&m) && now-m.at<META_TTL) meta_set(&m);
+    }
+    free(d);
+    if (lines<=2*g_nmeta && lines<=META_MAX) return;
+
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    FILE *f=fopen(tmp,"wb");
+    if (!f) return;
+    for (int i = g_nmeta>META_MAX/2 ? g_nmeta-META_MAX/2 : 0; i<g_nmeta; i++) meta_write(f,&g_meta[i]);
+    if (fclose(f)!=0 || RENAME(tmp,path)!=0) remove(tmp);
+}
+
+/* Remember m for this run and the next ones. */
+static void meta_put(const Meta *m) {
+    char path[1100];
+    FILE *f;
+    meta_set(m);
+    if (meta_path(path,sizeof(path)) && (f=fopen(path,"ab"))) { meta_write(f,m); fclose(f); }
+}
+#endif
+
+/* ─── Library ────────────────────────────────────────────────── */
+/*
+ *  Every download that stays on disk (filed in the store, kept with -k,
+ *  or fetched by --bulk) is recorded in <cachedir>/library.tsv, one
+ *  line appended per download:
+ *
+ *    <added> \t <id> \t <duration> \t <format> \t <path> \t <channel> \t <title>
+ *
+ *  --local answers a query from it alone. The file is loaded and an
+ *  inverted index from title and channel words to entries is built in
+ *  memory, once per load: a sorted word list, so the words a query word
+ *  is a prefix of are found by binary search. A query word matches a
+ *  word whole or as a prefix. Entries matching the most query words come
+ *  first, then the highest score: each title or channel word matched
+ *  adds 1, doubled for a title word and doubled again for a whole-word
+ *  match. Among equals the most recent comes first. Hits whose file has
+ *  gone are dropped from the file. A missing library.tsv, or --refresh,
+ *  rebuilds it by scanning the store and every directory a kept file
+ *  was seen in (plus -o). Known files keep their details. Store files
+ *  are recognized by their <id>-<hash> name, anything else by its file
+ *  name (id "-"). Online result rows of videos on disk are flagged 💾.
+ */
+typedef struct {
+    long long   added;
+    const char *id, *fmt, *path, *channel, *title;  /* into g_lib_data */
+    long        duration;
+    int         older;          /* previous entry with this id, -1 */
+} LibEntry;
+
+typedef struct { int i, has; } LibId;   /* newest entry with an id; has: on disk, -1 unchecked */
+typedef struct { const char *w; int *post, n, cap; } LibWord;       /* post: entry*2 + in channel */
+
+static LibEntry *g_lib;
+static int       g_nlib, g_lib_loaded;
+static char     *g_lib_data;
+static LibId    *g_lib_id;              /* by id, open addressing */
+static size_t    g_lib_idcap;
+static LibWord  *g_lib_vocab;           /* sorted; built by lib_vocab() on the first search */
+static size_t    g_lib_nvocab;
+static char     *g_lib_text;            /* g_lib_vocab's words */
+
+static long long file_size(const char *path) {
+    struct stat st;
+    return stat(path,&st)==0 && (st.st_mode&S_IFMT)==S_IFREG ? (long long)st.st_size : -1;
+}
+
+static int lib_file(char *out, size_t n) {
+    char dir[1024];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%slibrary.tsv",dir,PATH_SEP);
+    return 1;
+}
+
+static int abs_path(const char *p, char *out, size_t n) {
+#ifdef PLATFORM_WINDOWS
+    return _fullpath(out,p,n)!=NULL;
+#else
+    char *r=realpath(p,NULL);
+    if (!r) return 0;
+    snprintf(out,n,"%s",r);
+    free(r);
+    return 1;
+#endif
+}
+
+/* One TSV field, tabs and newlines flattened. */
+static void tsv_field(FILE *f, const char *s, int last) {
+    for (; *s; s++) fputc(*s=='\t' || *s=='\n' || *s=='\r' ? ' ' : *s,f);
+    fputc(last ? '\n' : '\t',f);
+}
+
+static void lib_line(FILE *f, long long added, const char *id, long dur, const char *fmt,
+                     const char *path, const char *channel, const char *title) {
+    fprintf(f,"%lld\t%s\t%ld\t",added,id,dur);
+    tsv_field(f,fmt,0); tsv_field(f,path,0); tsv_field(f,channel,0); tsv_field(f,title,1);
+}
+
+/* Record path, a download of r in format fmt, as being on disk. */
+static void lib_note(const VideoResult *r, const char *fmt, const char *path) {
+    char index[1100], abs[2048];
+    FILE *f;
+    if (!lib_file(index,sizeof(index)) || !abs_path(path,abs,sizeof(abs)) || !(f=fopen(index,"ab"))) return;
+    lib_line(f,(long long)time(NULL),r->id,r->duration,fmt,abs,r->channel,r->title);
+    fclose(f);
+}
+
+static void lib_save(void) {
+    char index[1100], tmp[1200];
+    FILE *f;
+    if (!lib_file(index,sizeof(index))) return;
+    snprintf(tmp,sizeof(tmp),"%s.tmp",index);
+    if (!(f=fopen(tmp,"wb"))) return;
+    for (int i=0; i<g_nlib; i++) {
+        LibEntry *e=&g_lib[i];
+        lib_line(f,e->added,e->id,e->duration,e->fmt,e->path,e->channel,e->title);
+    }
+    if (fclose(f)!=0 || RENAME(tmp,index)!=0) remove(tmp);
+}
+
+static LibId *lib_id_slot(const char *id) {
+    size_t h=str_hash(id,strlen(id))&(g_lib_idcap-1);
+    while (g_lib_id[h].i>=0 && strcmp(g_lib[g_lib_id[h].i].id,id)) h=(h+1)&(g_lib_idcap-1);
+    return &g_lib_id[h];
+}
+
+/*
+ *  Hash the entries by id, each chained to the older ones with the same
+ *  id. The word list refers to entries by position, so it goes too.
+ */
+static void lib_index(void) {
+    size_t cap=16;
+    for (size_t k=0; k<g_lib_nvocab; k++) free(g_lib_vocab[k].post);
+    free(g_lib_vocab); free(g_lib_text);
+    g_lib_vocab=NULL; g_lib_text=NULL; g_lib_nvocab=0;
+    while (cap<2*(size_t)g_nlib) cap*=2;
+    free(g_lib_id);
+    g_lib_idcap=0;
+    if (!(g_lib_id=(LibId*)malloc(cap*sizeof(LibId)))) return;
+    g_lib_idcap=cap;
+    for (size_t h=0; h<cap; h++) { g_lib_id[h].i=-1; g_lib_id[h].has=-1; }
+    for (int i=0; i<g_nlib; i++) {
+        LibId *s=lib_id_slot(g_lib[i].id);
+        g_lib[i].older=s->i; s->i=i;
+    }
+}
+
+/* Load library.tsv; a path listed twice keeps its last line. */
+static void lib_load(void) {
+    char index[1100], *cur, *line;
+    size_t len, cap=1;
+    int *seen, n=0, lines=0;
+    if (g_lib_loaded) return;
+    g_lib_loaded=1;
+    if (!lib_file(index,sizeof(index)) || !(g_lib_data=(char*)read_file(index,&len))) return;
+    size_t max=count_lines(g_lib_data);
+    if (!(g_lib=(LibEntry*)malloc(max*sizeof(LibEntry)))) return;
+    for (cur=g_lib_data; (line=next_line(&cur)) && (size_t)g_nlib<max; lines++) {
+        char *f[7]; int nf=0;
+        for (char *p=line; nf<7; ) {
+            f[nf++]=p;
+            if (!(p=strchr(p,'\t'))) break;
+            *p++='\0';
+        }
+        if (nf<7 || !*f[1] || !*f[4]) continue;
+        LibEntry *e=&g_lib[g_nlib++];
+        e->added=atoll(f[0]); e->id=f[1]; e->duration=atol(f[2]);
+        e->fmt=f[3]; e->path=f[4]; e->channel=f[5]; e->title=f[6];
+    }
+
+    while (cap<2*(size_t)g_nlib) cap*=2;
+    if (!(seen=(int*)malloc(cap*sizeof(int)))) return;
+    for (size_t i=0; i<cap; i++) seen[i]=-1;
+    for (int i=g_nlib-1; i>=0; i--) {
+        size_t h=str_hash(g_lib[i].path,strlen(g_lib[i].path))&(cap-1);
+        while (seen[h]>=0 && strcmp(g_lib[seen[h]].path,g_lib[i].path)) h=(h+1)&(cap-1);
+        if (seen[h]>=0) g_lib[i].path=NULL;
+        else seen[h]=i;
+    }
+    free(seen);
+    for (int i=0; i<g_nlib; i++) if (g_lib[i].path) g_lib[n++]=g_lib[i];
+    g_nlib=n;
+    lib_index();
+    if (lines>2*n) lib_save();
+}
+
+/* Is a download of this video on disk? Checked once per id. */
+static int lib_has(const char *id) {
+    LibId *s;
+    lib_load();
+    if (!g_lib_idcap || !strcmp(id,"-") || (s=lib_id_slot(id))->i<0) return 0;
+    if (s->has<0) {
+        s->has=0;
+        for (int i=s->i; i>=0 && !s->has; i=g_lib[i].older) s->has=file_size(g_lib[i].path)>=0;
+    }
+    return s->has;
+}
+
+/* The newest file on disk for r (by id, or by title when the id is unknown). */
+static int lib_path(const VideoResult *r, char *out, size_t n) {
+    int byid=strcmp(r->id,"-")!=0;
+    lib_load();
+    if (byid && !g_lib_idcap) return 0;
+    for (int i = byid ? lib_id_slot(r->id)->i : g_nlib-1; i>=0; i = byid ? g_lib[i].older : i-1) {
+        const LibEntry *e=&g_lib[i];
+        if (!byid && strcmp(e->title,r->title)) continue;
+        if (file_size(e->path)<0) continue;
+        snprintf(out,n,"%s",e->path);
+        return 1;
+    }
+    return 0;
+}
+
+static int media_file(const char *name) {
+    static const char *ext[]={".mp4",".mkv",".webm",".m4a",".mp3",".opus",".ogg",".flac",
+                              ".wav",".mov",".avi",".flv",".m4v",".aac",NULL};
+    const char *x=strrchr(name,'.');
+    if (!x) return 0;
+    for (int i=0; ext[i]; i++) {
+        const char *a=ext[i], *b=x;
+        while (*a && tolower((unsigned char)*b)==*a) { a++; b++; }
+        if (!*a && !*b) return 1;
+    }
+    return 0;
+}
+
+/* Names of the regular files in dir, NUL-separated. */
+static void dir_files(const char *dir, Buf *out) {
+#ifdef PLATFORM_WINDOWS
+    char pat[1100];
+    WIN32_FIND_DATAA fd;
+    snprintf(pat,sizeof(pat),"%s\\*",dir);
+    HANDLE h=FindFirstFileA(pat,&fd);
+    if (h==INVALID_HANDLE_VALUE) return;
+    do {
+        if (!(fd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY)) buf_put(out,fd.cFileName,strlen(fd.cFileName)+1);
+    } while (FindNextFileA(h,&fd));
+    FindClose(h);
+#else
+    char p[2048];
+    struct dirent *e;
+    DIR *d=opendir(dir);
+    if (!d) return;
+    while ((e=readdir(d))) {
+        if (snprintf(p,sizeof(p),"%s/%s",dir,e->d_name)<(int)sizeof(p) && file_size(p)>=0) buf_put(out,e->d_name,strlen(e->d_name)+1);
+    }
+    closedir(d);
+#endif
+}
+
+/* "<id>-<8 hex>.<ext>" (a store file) → id; 0 otherwise. */
+static int store_file_id(const char *name, char *id, size_t n) {
+    const char *x=strrchr(name,'.'), *h=x ? x-9 : NULL;
+    if (!h || h<=name || *h!='-') return 0;
+    for (int i=1; i<9; i++) if (!isxdigit((unsigned char)h[i])) return 0;
+    if ((size_t)(h-name)>=n) return 0;
+    snprintf(id,n,"%.*s",(int)(h-name),name);
+    return 1;
+}
+
+/* Rebuild library.tsv from what is on disk in the store and the known directories. */
+static void lib_rebuild(Config *c) {
+    char index[1100], tmp[1200], base[1000], sdir[1024];
+    char dirs[64][1024];
+    int nd=0, sk=-1;
+    FILE *f;
+    lib_load();
+    if (!lib_file(index,sizeof(index)) || !get_cachedir(base,sizeof(base))) return;
+    snprintf(sdir,sizeof(sdir),"%s%sstore",base,PATH_SEP);
+    if (abs_path(sdir,dirs[nd],sizeof(dirs[0]))) sk=nd++;
+    if (c->output_set && abs_path(c->output_dir,dirs[nd],sizeof(dirs[0]))) nd++;
+    for (int i=0; i<g_nlib && nd<64; i++) {
+        const char *s=strrchr(g_lib[i].path,PATH_SEP[0]);
+        int known=0;
+        if (!s) continue;
+        for (int k=0; k<nd && !known; k++)
+            known = strlen(dirs[k])==(size_t)(s-g_lib[i].path) && !strncmp(dirs[k],g_lib[i].path,(size_t)(s-g_lib[i].path));
+        if (!known) snprintf(dirs[nd++],sizeof(dirs[0]),"%.*s",(int)(s-g_lib[i].path),g_lib[i].path);
+    }
+
+    snprintf(tmp,sizeof(tmp),"%s.tmp",index);
+    if (!(f=fopen(tmp,"wb"))) return;
+    for (int k=0; k<nd; k++) {
+        Buf names={0};
+        dir_files(dirs[k],&names);
+        for (size_t off=0; off<names.len; off+=strlen((char*)names.p+off)+1) {
+            const char *name=(char*)names.p+off;
+            char path[2048], id[64], title[1024];
+            const LibEntry *e=NULL;
+            struct stat st;
+            if (!media_file(name) || snprintf(path,sizeof(path),"%s%s%s",dirs[k],PATH_SEP,name)>=(int)sizeof(path)) continue;
+            for (int i=g_nlib-1; i>=0 && !e; i--) if (!strcmp(g_lib[i].path,path)) e=&g_lib[i];
+            if (e) { lib_line(f,e->added,e->id,e->duration,e->fmt,e->path,e->channel,e->title); continue; }
+            if (stat(path,&st)!=0) continue;
+            if (k==sk && store_file_id(name,id,sizeof(id))) snprintf(title,sizeof(title),"%s",id);
+            else {
+                snprintf(id,sizeof(id),"-");
+                snprintf(title,sizeof(title),"%.*s",(int)(strrchr(name,'.')-name),name);
+            }
+            lib_line(f,(long long)st.st_mtime,id,0,"",path,"",title);
+        }
+        free(names.p);
+    }
+    if (fclose(f)!=0 || RENAME(tmp,index)!=0) { remove(tmp); return; }
+    free(g_lib); free(g_lib_data); free(g_lib_id);
+    g_lib=NULL; g_lib_data=NULL; g_lib_id=NULL; g_nlib=0; g_lib_idcap=0; g_lib_loaded=0;
+    lib_load();
+}
+
+/* Lower-cased words of s into buf (letters, digits and any UTF-8), pointers in w. */
+static int lib_words(const char *s, char *buf, size_t n, const char **w, int maxw) {
+    size_t j=0;
+    int nw=0;
+#define WORDCH(ch) (isalnum((unsigned char)(ch)) || (unsigned char)(ch)>=0x80)
+    while (nw<maxw && j+2<n) {
+        while (*s && !WORDCH(*s)) s++;
+        if (!*s) break;
+        w[nw++]=buf+j;
+        while (*s && WORDCH(*s) && j+2<n) buf[j++]=(char)tolower((unsigned char)*s++);
+        buf[j++]='\0';
+        while (WORDCH(*s)) s++;
+    }
+#undef WORDCH
+    return nw;
+}
+
+typedef struct { int i, mask, hits, score; } LibHit;   /* mask: query words matched */
+
+static int lib_hit_cmp(const void *a, const void *b) {
+    const LibHit *x=(const LibHit*)a, *y=(const LibHit*)b;
+    if (x->hits!=y->hits)   return y->hits-x->hits;
+    if (x->score!=y->score) return y->score-x->score;
+    return g_lib[y->i].added>g_lib[x->i].added ? 1 : g_lib[y->i].added<g_lib[x->i].added ? -1 : 0;
+}
+
+static int lib_word_cmp(const void *a, const void *b) {
+    return strcmp(((const LibWord*)a)->w,((const LibWord*)b)->w);
+}
+
+/* Every title and channel word with the entries it is in, sorted, into g_lib_vocab. */
+static void lib_vocab(void) {
+    size_t total=16, used=0, cap=1, n=0;
+    LibWord *tab;
+    if (g_lib_vocab) return;
+    for (int i=0; i<g_nlib; i++) total+=strlen(g_lib[i].title)+strlen(g_lib[i].channel)+2;
+    while (cap<total) cap*=2;
+    g_lib_text=(char*)malloc(total);
+    tab=(LibWord*)calloc(cap,sizeof(LibWord));
+    if (!g_lib_text || !tab) die("Out of memory");
+    for (int i=0; i<g_nlib; i++)
+        for (int fld=0; fld<2; fld++) {
+            const char *w[256];
+            int nw=lib_words(fld ? g_lib[i].channel : g_lib[i].title,g_lib_text+used,total-used,w,256);
+            for (int k=0; k<nw; k++) {
+                size_t h=str_hash(w[k],strlen(w[k]))&(cap-1);
+                while (tab[h].w && strcmp(tab[h].w,w[k])) h=(h+1)&(cap-1);
+                LibWord *lw=&tab[h];
+                if (!lw->w) lw->w=w[k];
+                if (lw->n && lw->post[lw->n-1]==i*2+fld) continue;
+                if (lw->n==lw->cap) {
+                    lw->cap = lw->cap ? lw->cap*2 : 4;
+                    if (!(lw->post=(int*)realloc(lw->post,(size_t)lw->cap*sizeof(int)))) die("Out of memory");
+                }
+                lw->post[lw->n++]=i*2+fld;
+            }
+            if (nw) used=(size_t)(w[nw-1]-g_lib_text)+strlen(w[nw-1])+1;
+        }
+    for (size_t h=0; h<cap; h++) if (tab[h].w) tab[n++]=tab[h];
+    qsort(tab,n,sizeof(LibWord),lib_word_cmp);
+    g_lib_vocab=tab; g_lib_nvocab=n;
+}
+
+/*
+ *  --local: the library entries matching c->query into g_results, best
+ *  first, one row per video. Returns the count.
+ */
+static int lib_search(Config *c) {
+    char index[1100], qbuf[1024];
+    const char *qw[16];
+    int nq, nhit=0, dropped=0;
+    size_t nwords;
+    long long t=trace_now(), t0=mono_us();
+    LibHit *hit;
+
+    if (c->refresh || !lib_file(index,sizeof(index)) || file_size(index)<0) lib_rebuild(c);
+    else lib_load();
+    results_reset();
+    nq=lib_words(c->query,qbuf,sizeof(qbuf),qw,16);
+    if (!g_nlib || !nq) return 0;
+
+    lib_vocab();
+    nwords=g_lib_nvocab;
+    if (!(hit=(LibHit*)calloc((size_t)g_nlib,sizeof(LibHit)))) die("Out of memory");
+
+    /* every indexed word a query word is a prefix of: a run from its lower bound */
+    for (int q=0; q<nq; q++) {
+        size_t ql=strlen(qw[q]), lo=0, hi=g_lib_nvocab;
+        while (lo<hi) {
+            size_t mid=lo+(hi-lo)/2;
+            if (strcmp(g_lib_vocab[mid].w,qw[q])<0) lo=mid+1; else hi=mid;
+        }
+        for (size_t k=lo; k<g_lib_nvocab && !strncmp(g_lib_vocab[k].w,qw[q],ql); k++) {
+            const LibWord *lw=&g_lib_vocab[k];
+            int exact = lw->w[ql]=='\0';
+            for (int p=0; p<lw->n; p++) {
+                LibHit *x=&hit[lw->post[p]/2];
+                if (!(x->mask & (1<<q))) { x->mask|=1<<q; x->hits++; }
+                x->score += (lw->post[p]&1 ? 1 : 2) * (exact ? 2 : 1);
+            }
+        }
+    }
+    for (int i=0; i<g_nlib; i++) if (hit[i].hits) { hit[nhit]=hit[i]; hit[nhit++].i=i; }
+    qsort(hit,(size_t)nhit,sizeof(LibHit),lib_hit_cmp);
+
+    for (int k=0; k<nhit; k++) {
+        LibEntry *e=&g_lib[hit[k].i];
+        int dup=0;
+        if (file_size(e->path)<0) { e->path=NULL; dropped++; continue; }
+        for (int j=0; j<g_nresults && !dup; j++) dup = strcmp(e->id,"-") && !strcmp(g_results[j].id,e->id);
+        if (dup) continue;
+        VideoResult *r=results_add();
+        r->title=intern(e->title,strlen(e->title));
+        r->id=intern(e->id,strlen(e->id));
+        r->channel = e->channel[0] ? intern(e->channel,strlen(e->channel)) : intern("Unknown",7);
+        r->duration=e->duration; r->views=0;
+    }
+    if (dropped) {
+        int n=0;
+        for (int i=0; i<g_nlib; i++) if (g_lib[i].path) g_lib[n++]=g_lib[i];
+        g_nlib=n;
+        lib_index();
+        lib_save();
+    }
+    free(hit);
+    trace_span("library",0,t);
+    if (c->verbose)
+        printf("%s[library]%s %d files, %lu words; %d matches in %.2f ms%s\n",C_DIM,C_RST,g_nlib,
+               (unsigned long)nwords,g_nresults,(mono_us()-t0)/1000.0,dropped ? " (dropped missing files)" : "");
+    return g_nresults;
+}
+
+/* ─── Watch history ──────────────────────────────────────────── */
+/*
+ *  <cachedir>/history.tsv logs every YouTube search and every play, one
+ *  line appended per event:
+ *
+ *    <time> \t S \t - \t - \t - \t <query> \t -
+ *    <time> \t P \t <mode> \t <format> \t <id> \t <query> \t <title>
+ *
+ *  mode is stream, download or library; query is what the video was
+ *  picked from (empty for --queue). When the file grows past HIST_BYTES
+ *  the older half is dropped, so replaying it stays a single small
+ *  read. --warm reads it; --no-history stops logging.
+ */
+static int hist_file(char *out, size_t n) {
+    char dir[1024];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%shistory.tsv",dir,PATH_SEP);
+    return 1;
+}
+
+/* Keep the newer half of an oversized log. */
+static void hist_trim(const char *path) {
+    char tmp[1200];
+    size_t len;
+    unsigned char *d=read_file(path,&len);
+    const char *keep;
+    FILE *f;
+    if (!d) return;
+    keep=strchr((char*)d+len/2,'\n');
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    if (keep && (f=fopen(tmp,"wb"))) {
+        fwrite(keep+1,1,len-(size_t)(keep+1-(char*)d),f);
+        if (fclose(f)!=0 || RENAME(tmp,path)!=0) remove(tmp);
+    }
+    free(d);
+}
+
+/* Log a search (r NULL) or a play of r. */
+static void hist_note(Config *c, const VideoResult *r) {
+    char path[1100];
+    FILE *f;
+    if (c->no_history || !hist_file(path,sizeof(path)) || !(f=fopen(path,"ab"))) return;
+    fprintf(f,"%lld\t%s\t",(long long)time(NULL),r ? "P" : "S");
+    if (r) {
+        tsv_field(f,c->local ? "library" : c->stream ? "stream" : "download",0);
+        tsv_field(f,c->quality,0); tsv_field(f,r->id,0);
+        tsv_field(f,g_queue ? "" : c->query,0); tsv_field(f,r->title,1);
+    } else {
+        fputs("-\t-\t-\t",f);
+        tsv_field(f,c->query,0); tsv_field(f,"-",1);
+    }
+    fclose(f);
+    if (file_size(path)>HIST_BYTES) hist_trim(path);
+}
+
+/* ─── Print results ──────────────────────────────────────────── */
+/*
+ *  Screen bookkeeping for --enrich: lines written since the list began
+ *  and the line each row of the page on screen starts at, so a row can
+ *  be redrawn in place when its details arrive. -1: not on screen.
+ */
+static long  g_scr_line;
+static long *g_row_line;
+static int   g_row_cap;
+
+static void rows_forget(void) {
+    for (int i=0; i<g_row_cap; i++) g_row_line[i]=-1;
+}
+
+static void row_at(int i, long line) {
+    if (i>=g_row_cap) {
+        int nc = g_row_cap ? g_row_cap*2 : 32;
+        while (nc<=i) nc*=2;
+        long *nr=(long*)realloc(g_row_line,(size_t)nc*sizeof(long));
+        if (!nr) return;
+        g_row_line=nr;
+        while (g_row_cap<nc) g_row_line[g_row_cap++]=-1;
+    }
+    g_row_line[i]=line;
+}
+
+/* Results first+1 .. first+count; just the count on the first page. */
+static void print_results_header(Config *c, int first, int count) {
+    printf("\n");
+    char qs[48]; strncpy(qs,c->query,46); qs[46]='\0';
+    if (strlen(c->query)>46) strcat(qs,"…");
+    char rs[32];
+    if (first) snprintf(rs,sizeof(rs),"%d-%d",first+1,first+count);
+    else       snprintf(rs,sizeof(rs),"%d",count);
+
+    printf("  %s┌────────────────────────────────────────────────────────────────┐%s\n",C_CYN,C_RST);
+    printf("  %s│%s  Search : %s%-53s%s %s│%s\n",C_CYN,C_RST,C_BLD,qs,C_RST,C_CYN,C_RST);
+    printf("  %s│%s  Results: %s%-53s%s%s│%s\n",C_CYN,C_RST,C_GRN,rs,C_RST,C_CYN,C_RST);
+    printf("  %s└────────────────────────────────────────────────────────────────┘%s\n\n",C_CYN,C_RST);
+    rows_forget();
+    g_scr_line+=6;
+}
+
+/* s cut to at most max characters (not bytes), "…" appended if cut. */
+static void utf8_cut(const char *s, int max, char *out, size_t n) {
+    size_t i=0;
+    int chars=0;
+    for (; s[i]; i++) {
+        if (((unsigned char)s[i]&0xC0)==0x80) continue;
+        if (chars++==max) break;
+    }
+    if (s[i]) snprintf(out,n,"%.*s…",(int)i,s);
+    else      snprintf(out,n,"%s",s);
+}
+
+/* "360,720,1080" → "360/720/1080p", or "144–2160p" for a long ladder. */
+static void fmt_heights(const char *h, char *out, size_t n) {
+    const char *last=strrchr(h,',');
+    int rungs=1;
+    for (const char *p=h; *p; p++) rungs += *p==',';
+    if (!last) snprintf(out,n,"%sp",h);
+    else if (rungs>4) snprintf(out,n,"%ld–%sp",atol(h),last+1);
+    else {
+        size_t j=0;
+        for (; *h && j+2<n; h++) out[j++] = *h==',' ? '/' : *h;
+        snprintf(out+j,n-j,"p");
+    }
+}
+
+/*
+ *  The two lines under a row's title: channel, duration, views, then
+ *  the --enrich details (blank until they are known). eol goes before
+ *  each newline ("\033[K" when overwriting).
+ */
+static void print_row_detail(int i, const char *eol) {
+    VideoResult *r=&g_results[i];
+    const Meta *m=meta_find(r->id);
+    char ch[24]; strncpy(ch,r->channel,22); ch[22]='\0';
+    if (strlen(r->channel)>22) strcat(ch,"…");
+    char dur[24], views[16];
+    fmt_duration(r->duration,dur,sizeof(dur));
+    fmt_views(r->views,views,sizeof(views));
+    printf("       %s%-24s%s ⏱ %s%-9s%s 👁 %s%s%s%s\n",
+           C_DIM,ch,C_RST, C_GRN,dur,C_RST, C_MAG,views,C_RST,eol);
+    if (m) {
+        char likes[16], ladder[64], ex[160];
+        fmt_views(m->likes,likes,sizeof(likes));
+        fmt_heights(m->heights,ladder,sizeof(ladder));
+        utf8_cut(m->excerpt,30,ex,sizeof(ex));
+        printf("       %s📅 %s  👍 %s  ▣ %s%s%s%s%s%s\n",C_DIM,m->uploaded[0]?m->uploaded:"?",likes,
+               m->heights[0]?ladder:"?",ex[0]?"  “":"",ex,ex[0]?"”":"",C_RST,eol);
+    } else printf("%s\n",eol);
+}
+
+/* mark: draw the row as the current selection (search-as-you-type). */
+static void print_result_row(int i, int mark) {
+    VideoResult *r=&g_results[i];
+    char t[62]; strncpy(t,r->title,60); t[60]='\0';
+    if (strlen(r->title)>60) strcat(t,"…");
+
+    printf("%s%s[%2d]%s %s%s%s%s\n",   mark?"▶ ":"  ",C_YLW,i+1,C_RST, C_BLD,t,C_RST, lib_has(r->id)?" 💾":"");
+    row_at(i,g_scr_line);
+    print_row_detail(i,"");
+    g_scr_line+=3;
+}
+
+/*
+ *  Header and the rows already loaded for a page of num_results hits.
+ *  Returns the index of the first row not drawn.
+ */
+static int print_page(Config *c, int page) {
+    int i=page*c->num_results, end=i+c->num_results;
+    print_results_header(c,i,c->num_results);
+    for (; i<end && i<g_nresults; i++) print_result_row(i,0);
+    fflush(stdout);
+    return i;
+}
+
+/* ─── Interactive prompt ─────────────────────────────────────── */
+#ifndef PLATFORM_WINDOWS
+static LineReader g_stdin;              /* shared with the select loop */
+#endif
+
+static void print_prompt(void) {
+    printf("  %s╔══════════════════════════════════════╗%s\n",C_CYN,C_RST);
+    printf("  %s║%s  Enter number to play  [0 = quit]    %s║%s\n",C_CYN,C_RST,C_CYN,C_RST);
+    printf("  %s║%s  n = next page   p = previous page   %s║%s\n",C_CYN,C_RST,C_CYN,C_RST);
+    printf("  %s║%s  3,1,5-7 = play them in that order   %s║%s\n",C_CYN,C_RST,C_CYN,C_RST);
+    printf("  %s╚══════════════════════════════════════╝%s\n",C_CYN,C_RST);
+    printf("  %s▶%s  ",C_GRN,C_RST); fflush(stdout);
+    g_scr_line+=5;
+}
+
+/*
+ *  An answer at the prompt: a 1-based result number, 0 or a page
+ *  command. A list ("3,1,5-7") is kept in g_pick for the play queue and
+ *  answers with its highest number, so the search runs until that
+ *  result is in.
+ */
+enum { CHOICE_NEXT=-1000, CHOICE_PREV=-1001 };
+
+static char g_pick[256];
+
+static int parse_choice(const char *line) {
+    while (*line==' ' || *line=='\t') line++;
+    if (*line=='n' || *line=='N') return CHOICE_NEXT;
+    if (*line=='p' || *line=='P') return CHOICE_PREV;
+    if (isdigit((unsigned char)*line) && strpbrk(line,",-")) {
+        long hi=0;
+        snprintf(g_pick,sizeof(g_pick),"%s",line);
+        for (const char *p=line; *p; ) {
+            char *end;
+            long v=strtol(p,&end,10);
+            if (end==p) { p++; continue; }
+            if (v>hi) hi=v;
+            p=end;
+        }
+        return (int)hi;
+    }
+    return atoi(line);
+}
+
+#ifdef PLATFORM_WINDOWS
+static int prompt_choice(void) {
+    char buf[256];
+    print_prompt();
+    if (!fgets(buf,sizeof(buf),stdin)) return 0;
+    return parse_choice(buf);
+}
+#endif
+
+/* ─── Stream URLs ────────────────────────────────────────────── */
+/*
+ *  `yt-dlp -g` prints one URL per requested format: a single line for
+ *  muxed formats, video + audio lines for "bestvideo+bestaudio".
+ *  Players that can take a separate audio track get both; the rest get
+ *  the format's first single-file alternative instead, so they never
+ *  end up with a silent video-only stream.
+ */
+typedef struct {
+    int  n;
+    char url[2][4096];
+} StreamUrls;
+
+static int player_is_native(const char *player) {
+    return !strcmp(player,"mpv") || !strcmp(player,"iina");
+}
+
+/* In a queue mpv gets resolved URLs too, so the next item's can be ready in time. */
+static int queue_raw(Config *c) {
+    return g_queue && !strcmp(c->player,"mpv") && !c->subtitle_lang[0];
+}
+
+/* --pipe: the player reads yt-dlp's output, nothing to resolve. */
+static int pipe_mode(Config *c) {
+#ifdef PLATFORM_WINDOWS
+    (void)c;
+    return 0;
+#else
+    return c->stream && c->pipe && !player_is_native(c->player);
+#endif
+}
+
+/* Flag that attaches an external audio URL, or NULL if unsupported. */
+static const char *player_audio_flag(const char *player) {
+    if (player_is_native(player))  return "--audio-file=";
+    if (!strcmp(player,"vlc"))     return "--input-slave=";
+    if (!strcmp(player,"mplayer")) return "-audiofile ";
+    return NULL;
+}
+
+/*
+ *  First alternative of a format string that needs no merging
+ *  ("bestvideo+bestaudio/best[height<=720]" → "best[height<=720]").
+ *  stream_format() is what `yt-dlp -g` gets: the configured format, or
+ *  that single-file alternative for players without player_audio_flag().
+ */
+static void single_format(const char *q, char *out, size_t n) {
+    const char *alt=q;
+    int depth=0, merged=0;
+    for (const char *p=q;; p++) {
+        if (*p=='[') depth++;
+        else if (*p==']') depth--;
+        else if (*p=='+' && !depth) merged=1;
+        else if ((*p=='/' && !depth) || !*p) {
+            if (!merged) { snprintf(out,n,"%.*s",(int)(p-alt),alt); return; }
+            if (!*p) break;
+            alt=p+1; merged=0;
+        }
+    }
+    snprintf(out,n,"best");
+}
+
+static void stream_format(Config *c, char *out, size_t n) {
+    if (player_audio_flag(c->player)) snprintf(out,n,"%s",c->quality);
+    else                              single_format(c->quality,out,n);
+}
+
+static void geturl_argv(const char *fmt, const char *url, Argv *a) {
+    argv_add(a,"yt-dlp"); argv_add(a,"--no-warnings");
+    argv_add(a,"-g"); argv_add(a,"-f"); argv_add(a,fmt);
+    argv_add(a,url);
+}
+
+/* Add one line of `yt-dlp -g` output. */
+static void urls_add(StreamUrls *u, const char *line, size_t len) {
+    if (u->n<2 && len>0 && len<sizeof(u->url[0])) memcpy(u->url[u->n++],line,len+1);
+}
+
+/* Run `yt-dlp -g -f fmt` for url, at most RESOLVE_TIMEOUT. Returns su->n. */
+static int resolve_urls(Config *c, const char *url, const char *fmt, StreamUrls *su) {
+    Proc p;
+    LineReader lr;
+    Argv a={0};
+    char *line; size_t len;
+    long long t=trace_now();
+    geturl_argv(fmt,url,&a);
+    if (c->verbose) argv_show("yt-dlp -g",&a);
+    su->n=0;
+    if (proc_spawn(&p,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL)!=0) { argv_free(&a); return 0; }
+    argv_free(&a);
+    lr_init(&lr,p.out,4096);
+    time_t until=time(NULL)+RESOLVE_TIMEOUT/1000;
+    while (lr_wait(&lr,RESOLVE_TIMEOUT) && time(NULL)<until) {
+        int more=lr_fill(&lr);
+        while ((line=lr_next(&lr,&len))) urls_add(su,line,len);
+        if (!more) break;
+    }
+    lr_free(&lr);
+    if (!lr.eof) { su->n=0; proc_kill(&p); warn_msg("yt-dlp -g timed out."); }
+    else proc_wait(&p,-1);
+    proc_close(&p);
+    trace_span("resolve",0,t);
+    return su->n;
+}
+
+/* ─── Resolved URL cache ─────────────────────────────────────── */
+/*
+ *  googlevideo URLs carry their own expiry (`expire=<unix time>` in the
+ *  query, `/expire/<t>/` in manifest paths) and stay valid for hours,
+ *  so <cachedir>/urls.tsv keeps them per video id + format:
+ *
+ *    <expire> \t <id> \t <format> \t <url> [\t <audio url>]
+ *
+ *  An entry is served only while it outlives the video's duration plus
+ *  UCACHE_MARGIN; a player that dies within PLAYER_FAIL_FAST seconds on
+ *  a cached URL gets the entry dropped and a fresh `yt-dlp -g`.
+ */
+static struct { unsigned hits, misses, stale; } g_ucache_stats;
+
+static long long url_expiry(const char *u) {
+    const char *p=strstr(u,"expire=");
+    if (p) return atoll(p+7);
+    p=strstr(u,"/expire/");
+    return p ? atoll(p+8) : 0;
+}
+
+static long long urls_expiry(const StreamUrls *u) {
+    long long e=0;
+    for (int i=0; i<u->n; i++) {
+        long long x=url_expiry(u->url[i]);
+        if (!x) return 0;
+        if (!e || x<e) e=x;
+    }
+    return e;
+}
+
+static int ucache_path(char *out, size_t n) {
+    char dir[1024];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%surls.tsv",dir,PATH_SEP);
+    return 1;
+}
+
+/* Split one cache line in place. Returns 0 if malformed. */
+static int ucache_split(char *line, long long *exp, char **id, char **fmt, StreamUrls *u) {
+    char *f[5]; int nf=0;
+    for (char *p=line; nf<5; ) {
+        f[nf++]=p;
+        p=strchr(p,'\t');
+        if (!p) break;
+        *p++='\0';
+    }
+    if (nf<4) return 0;
+    *exp=atoll(f[0]); *id=f[1]; *fmt=f[2];
+    if (u) {
+        u->n=0;
+        for (int i=3; i<nf; i++) urls_add(u,f[i],strlen(f[i]));
+    }
+    return 1;
+}
+
+/* Cached URLs for id+fmt valid for at least `need` more seconds. */
+static int ucache_get(const char *id, const char *fmt, long need, StreamUrls *out) {
+    char path[1100];
+    size_t len=0;
+    unsigned char *d;
+    if (!ucache_path(path,sizeof(path)) || !(d=read_file(path,&len))) { g_ucache_stats.misses++; return 0; }
+
+    long long now=(long long)time(NULL);
+    int found=0, stale=0;
+    char *cur, *line, *nd=(char*)realloc(d,len+1);
+    if (!nd) { free(d); return 0; }
+    d=(unsigned char*)nd; nd[len]='\0'; cur=nd;
+    while ((line=next_line(&cur))) {
+        long long exp; char *lid, *lfmt;
+        StreamUrls u;
+        if (!ucache_split(line,&exp,&lid,&lfmt,&u) || strcmp(lid,id) || strcmp(lfmt,fmt)) continue;
+        if (exp-now > need) { *out=u; found=1; } else stale=1;
+    }
+    free(d);
+    if (found)      g_ucache_stats.hits++;
+    else if (stale) g_ucache_stats.stale++;
+    else            g_ucache_stats.misses++;
+    return found;
+}
+
+/*
+ *  Rewrite the cache with id+fmt replaced by u (or dropped if u is
+ *  NULL), expired entries purged and at most UCACHE_MAX lines kept.
+ */
+static void ucache_update(const char *id, const char *fmt, const StreamUrls *u) {
+    char path[1100], tmp[1200];
+    long long exp = u ? urls_expiry(u) : 0, now=(long long)time(NULL);
+    if (!ucache_path(path,sizeof(path)) || (u && exp<=now)) return;
+
+    size_t len=0;
+    unsigned char *d=read_file(path,&len);
+    char **keep=NULL; int nkeep=0;
+    char *nd = d ? (char*)realloc(d,len+1) : NULL;
+    if (nd) {
+        char *cur=nd, *line;
+        d=(unsigned char*)nd; nd[len]='\0';
+        size_t max=count_lines(nd);
+        keep=(char**)malloc(max*sizeof(char*));
+        while (keep && (size_t)nkeep<max && (line=next_line(&cur))) {
+            char copy[16384]; long long lexp; char *lid, *lfmt;
+            snprintf(copy,sizeof(copy),"%s",line);
+            if (!ucache_split(copy,&lexp,&lid,&lfmt,NULL) || lexp<=now) continue;
+            if (!strcmp(lid,id) && !strcmp(lfmt,fmt)) continue;
+            keep[nkeep++]=line;
+        }
+    }
+
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    FILE *f=fopen(tmp,"wb");
+    if (f) {
+        int first = nkeep-(UCACHE_MAX-1) > 0 ? nkeep-(UCACHE_MAX-1) : 0;
+        for (int i=first; i<nkeep; i++) fprintf(f,"%s\n",keep[i]);
+        if (u) {
+            fprintf(f,"%lld\t%s\t%s",exp,id,fmt);
+            for (int i=0; i<u->n; i++) fprintf(f,"\t%s",u->url[i]);
+            fputc('\n',f);
+        }
+        if (fclose(f)!=0 || RENAME(tmp,path)!=0) remove(tmp);
+    }
+    free(keep); free(d);
+}
+
+static void ucache_report(Config *c, const char *what) {
+    if (c->verbose)
+        printf("%s[url-cache]%s %s  (this run: %u hits / %u misses / %u expired)\n",
+               C_DIM,C_RST, what, g_ucache_stats.hits, g_ucache_stats.misses, g_ucache_stats.stale);
+}
+
+/* ─── Stream URL prefetch ────────────────────────────────────── */
+/*
+ *  Players without built-in YouTube support need `yt-dlp -g` before
+ *  they can start — another interpreter start plus extraction. While the
+ *  user is still reading the list we run it for the top --prefetch
+ *  results, PREFETCH_JOBS at a time, so the pick usually launches
+ *  instantly. Workers for results that weren't picked are killed and
+ *  reaped once the choice is made. Fresh entries in the URL cache
+ *  complete a slot without spawning anything. Slot i holds result
+ *  g_pf_base+i; turning the page moves the window to its top results.
+ */
+enum { PF_IDLE, PF_RUNNING, PF_DONE, PF_FAILED };
+
+typedef struct {
+    int        state;
+    int        cached;
+    Proc       proc;
+    LineReader lr;
+    StreamUrls urls;
+    long long  t0;
+} Prefetch;
+
+static Prefetch g_prefetch[MAX_PREFETCH];
+static int      g_pf_base;
+
+#ifndef PLATFORM_WINDOWS
+static int prefetch_enabled(Config *c) {
+    return c->stream && c->prefetch>0 && !c->local && !pipe_mode(c) && (!player_is_native(c->player) || queue_raw(c));
+}
+
+static void prefetch_cancel(int keep);
+
+/*
+ *  Start workers for the top results from `base` on that have arrived,
+ *  up to the cap. A new base cancels the slots of the old one.
+ */
+static void prefetch_schedule(Config *c, int base) {
+    int running=0, top=g_nresults-base<c->prefetch ? g_nresults-base : c->prefetch;
+    char fmt[256];
+    if (!prefetch_enabled(c)) return;
+    if (base!=g_pf_base) {
+        prefetch_cancel(-1);
+        for (int i=0; i<MAX_PREFETCH; i++) g_prefetch[i].state=PF_IDLE;
+        g_pf_base=base;
+    }
+    stream_format(c,fmt,sizeof(fmt));
+    for (int i=0; i<MAX_PREFETCH; i++) running += g_prefetch[i].state==PF_RUNNING;
+    for (int i=0; i<top; i++) {
+        Prefetch *pf=&g_prefetch[i];
+        VideoResult *r=&g_results[base+i];
+        if (pf->state!=PF_IDLE) continue;
+        if (!c->no_cache && ucache_get(r->id,fmt,r->duration+UCACHE_MARGIN,&pf->urls)) {
+            pf->state=PF_DONE; pf->cached=1;
+            continue;
+        }
+        if (running>=PREFETCH_JOBS) continue;
+        char url[128];
+        Argv a={0};
+        snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",r->id);
+        geturl_argv(fmt,url,&a);
+        pf->t0=trace_now();
+        int rc=proc_spawn(&pf->proc,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL);
+        argv_free(&a);
+        if (rc!=0) { pf->state=PF_FAILED; continue; }
+        lr_init(&pf->lr,pf->proc.out,4096);
+        pf->urls.n=0; pf->cached=0;
+        pf->state=PF_RUNNING;
+        running++;
+    }
+}
+
+/* Consume output from a running worker; finalize it at EOF. */
+static void prefetch_pump(Config *c, int i) {
+    Prefetch *pf=&g_prefetch[i];
+    char *line; size_t len;
+    int more=lr_fill(&pf->lr);
+    while ((line=lr_next(&pf->lr,&len))) urls_add(&pf->urls,line,len);
+    if (more) return;
+    int rc=proc_wait(&pf->proc,-1);
+    proc_close(&pf->proc); lr_free(&pf->lr);
+    trace_span("prefetch",1+i,pf->t0);
+    pf->state = (rc==0 && pf->urls.n) ? PF_DONE : PF_FAILED;
+    if (pf->state==PF_DONE && !c->no_cache) {
+        char fmt[256];
+        stream_format(c,fmt,sizeof(fmt));
+        ucache_update(g_results[g_pf_base+i].id,fmt,&pf->urls);
+    }
+}
+
+/* Forget every slot: g_results was reordered or the format changed. */
+static void prefetch_drop(void) {
+    prefetch_cancel(-1);
+    for (int i=0; i<MAX_PREFETCH; i++) g_prefetch[i].state=PF_IDLE;
+}
+
+/* Kill and reap every running worker except the one for result `keep` (or -1). */
+static void prefetch_cancel(int keep) {
+    for (int i=0; i<MAX_PREFETCH; i++) {
+        Prefetch *pf=&g_prefetch[i];
+        if (g_pf_base+i==keep || pf->state!=PF_RUNNING) continue;
+        proc_kill(&pf->proc);
+        proc_close(&pf->proc); lr_free(&pf->lr);
+        trace_span("prefetch",1+i,pf->t0);
+        pf->state=PF_IDLE;
+    }
+}
+#endif
+
+/*
+ *  The stream URLs resolved in the background for result i, waiting for
+ *  its worker if it is still running. NULL if there are none.
+ */
+static const Prefetch *prefetch_take(Config *c, int i) {
+#ifndef PLATFORM_WINDOWS
+    i-=g_pf_base;
+    if (i<0 || i>=MAX_PREFETCH) return NULL;
+    Prefetch *pf=&g_prefetch[i];
+    while (pf->state==PF_RUNNING) { lr_wait(&pf->lr,-1); prefetch_pump(c,i); }
+    if (pf->state==PF_DONE) return pf;
+#else
+    (void)c; (void)i;
+#endif
+    return NULL;
+}
+
+/* ─── Detail workers ─────────────────────────────────────────── */
+/*
+ *  --enrich: once a row is on screen, a fresh meta.tsv entry fills it
+ *  at once; otherwise a full extraction of that video runs, ENRICH_JOBS
+ *  at a time, inside the prompt's poll() loop like the prefetch
+ *  workers. yt-dlp prints just the fields we show (-O with a field
+ *  selection, then the format heights), so nothing large is read. When
+ *  one finishes, its row's '?' are filled in and the details line is
+ *  written under it in place — the cursor is saved and restored, so
+ *  anything being typed at the prompt is undisturbed. Rows that have
+ *  scrolled out of the terminal, or output that is not a terminal, are
+ *  just cached. Turning the page stops the workers for the old one.
+ */
+#ifndef PLATFORM_WINDOWS
+typedef struct {
+    int        busy;
+    int        row;             /* result index */
+    Proc       proc;
+    LineReader lr;
+    Meta       m;
+    int        got;             /* output lines parsed */
+    long long  t0;
+} Enrich;
+
+static Enrich g_enrich[ENRICH_JOBS];
+static char  *g_enriched;       /* per result: 0 to do, 1 running or done */
+static int    g_enriched_cap;
+
+static int tty_rows(void) {
+#ifdef TIOCGWINSZ
+    struct winsize w;
+    if (ioctl(STDOUT_FILENO,TIOCGWINSZ,&w)==0 && w.ws_row>0) return w.ws_row;
+#endif
+    return 24;
+}
+
+/* Take m's numbers where the flat result had none, and redraw row i. */
+static void enrich_apply(int i, const Meta *m) {
+    VideoResult *r=&g_results[i];
+    long up;
+    if (m->duration>0) r->duration=m->duration;
+    if (m->views>0)    r->views=m->views;
+    if (m->channel[0] && (!r->channel[0] || !strcmp(r->channel,"Unknown")))
+        r->channel=intern(m->channel,strlen(m->channel));
+    if (i>=g_row_cap || g_row_line[i]<0 || !isatty(STDOUT_FILENO)) return;
+    up=g_scr_line-g_row_line[i]-1;                      /* to the line under the title */
+    if (up<=0 || up>=tty_rows()) return;
+    printf("\0337\033[%ldA\r",up);
+    print_row_detail(i,"\033[K");
+    printf("\0338");
+    fflush(stdout);
+}
+
+static void enrich_stop(Enrich *e) {
+    proc_kill(&e->proc);
+    proc_close(&e->proc); lr_free(&e->lr);
+    trace_span("enrich",1+MAX_PREFETCH+(int)(e-g_enrich),e->t0);
+    g_enriched[e->row]=0;
+    e->busy=0;
+}
+
+/* Forget which rows were done: g_results holds a new search. */
+static void enrich_reset(void) {
+    if (g_enriched) memset(g_enriched,0,(size_t)g_enriched_cap);
+}
+
+/* Work on rows [base,end), the ones of the page on screen. */
+static void enrich_schedule(Config *c, int base, int end) {
+    if (!c->enrich || c->local) return;
+    meta_load();
+    if (end>g_enriched_cap) {
+        int nc = g_enriched_cap ? g_enriched_cap : 32;
+        while (nc<end) nc*=2;
+        char *ne=(char*)realloc(g_enriched,(size_t)nc);
+        if (!ne) return;
+        memset(ne+g_enriched_cap,0,(size_t)(nc-g_enriched_cap));
+        g_enriched=ne; g_enriched_cap=nc;
+    }
+    for (int k=0; k<ENRICH_JOBS; k++)
+        if (g_enrich[k].busy && (g_enrich[k].row<base || g_enrich[k].row>=end)) enrich_stop(&g_enrich[k]);
+    for (int i=base; i<end; i++) {
+        const Meta *m;
+        Enrich *e=NULL;
+        if (g_enriched[i]) continue;
+        if ((m=meta_find(g_results[i].id))) { g_enriched[i]=1; enrich_apply(i,m); continue; }
+        for (int k=0; k<ENRICH_JOBS && !e; k++) if (!g_enrich[k].busy) e=&g_enrich[k];
+        if (!e) return;
+
+        Argv a={0};
+        argv_add(&a,"yt-dlp"); argv_add(&a,"--no-warnings");
+        argv_add(&a,"--skip-download"); argv_add(&a,"--no-playlist");
+        argv_add(&a,"-O"); argv_add(&a,"%(.{duration,view_count,like_count,upload_date,channel,uploader,description})j");
+        argv_add(&a,"-O"); argv_add(&a,"%(formats.:.height)j");
+        argv_addf(&a,"https://www.youtube.com/watch?v=%s",g_results[i].id);
+        e->t0=trace_now();
+        int rc=proc_spawn(&e->proc,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL);
+        argv_free(&a);
+        g_enriched[i]=1;
+        if (rc!=0) continue;
+        lr_init(&e->lr,e->proc.out,16*1024);
+        memset(&e->m,0,sizeof(e->m));
+        snprintf(e->m.id,sizeof(e->m.id),"%s",g_results[i].id);
+        e->got=0;
+        e->row=i; e->busy=1;
+    }
+}
+
+/* First line of a description, tabs flattened, at most 90 bytes of whole characters. */
+static void meta_excerpt(const char *d, char *out, size_t n) {
+    size_t j=0, cut=0;
+    while (*d=='\n' || *d==' ') d++;
+    for (; *d && *d!='\n' && j+1<n && j<90; d++) {
+        if (((unsigned char)*d&0xC0)!=0x80) cut=j;
+        out[j++] = *d=='\t' || *d=='\r' ? ' ' : *d;
+    }
+    if (*d && *d!='\n' && (j+1>=n || j>=90)) j=cut;    /* don't split a character */
+    out[j]='\0';
+}
+
+/* "[null, 360, 720, 720, 1080]" → "360,720,1080" */
+static void meta_heights(const char *line, char *out, size_t n) {
+    long h[32], v;
+    int nh=0;
+    size_t j=0;
+    for (const char *p=line; *p; ) {
+        char *end;
+        if (!isdigit((unsigned char)*p)) { p++; continue; }
+        v=strtol(p,&end,10); p=end;
+        int k=0;
+        while (k<nh && h[k]<v) k++;
+        if ((k<nh && h[k]==v) || nh==32) continue;
+        memmove(h+k+1,h+k,(size_t)(nh-k)*sizeof(long));
+        h[k]=v; nh++;
+    }
+    out[0]='\0';
+    for (int k=0; k<nh; k++) {
+        int w=snprintf(out+j,n-j,"%s%ld",k?",":"",h[k]);
+        if (w<0 || (size_t)w>=n-j) { out[j]='\0'; break; }
+        j+=(size_t)w;
+    }
+}
+
+/* Consume a worker's output; at EOF store what it found and update the row. */
+static void enrich_pump(int k) {
+    Enrich *e=&g_enrich[k];
+    char *line; size_t len;
+    int more=lr_fill(&e->lr);
+    while ((line=lr_next(&e->lr,&len))) {
+        if (e->got++==0) {
+            char dur[32], views[32], likes[32], up[16], ch[96], upl[96], desc[1024];
+            JsonField f[] = {
+                { "duration",    dur,   sizeof(dur),   0 },
+                { "view_count",  views, sizeof(views), 0 },
+                { "like_count",  likes, sizeof(likes), 0 },
+                { "upload_date", up,    sizeof(up),    0 },
+                { "channel",     ch,    sizeof(ch),    0 },
+                { "description", desc,  sizeof(desc),  0 },
+                { "uploader",    upl,   sizeof(upl),   0 },
+            };
+            json_fields(line,len,f,(int)(sizeof(f)/sizeof(f[0])),6);
+            if (f[0].found) e->m.duration=(long)atof(dur);
+            if (f[1].found) e->m.views=atol(views);
+            if (f[2].found) e->m.likes=atol(likes);
+            if (f[3].found && strlen(up)==8)
+                snprintf(e->m.uploaded,sizeof(e->m.uploaded),"%.4s-%.2s-%.2s",up,up+4,up+6);
+            snprintf(e->m.channel,sizeof(e->m.channel),"%s",f[4].found && ch[0] ? ch : f[6].found ? upl : "");
+            for (char *p=e->m.channel; *p; p++) if (*p=='\t') *p=' ';
+            if (f[5].found) meta_excerpt(desc,e->m.excerpt,sizeof(e->m.excerpt));
+        } else if (e->got==2) meta_heights(line,e->m.heights,sizeof(e->m.heights));
+    }
+    if (more) return;
+    int rc=proc_wait(&e->proc,-1), i=e->row;
+    proc_close(&e->proc); lr_free(&e->lr);
+    trace_span("enrich",1+MAX_PREFETCH+k,e->t0);
+    e->busy=0;
+    if (rc!=0 || !e->got) return;
+    e->m.at=(long long)time(NULL);
+    meta_put(&e->m);
+    enrich_apply(i,&e->m);
+}
+
+static void enrich_cancel(void) {
+    for (int k=0; k<ENRICH_JOBS; k++) if (g_enrich[k].busy) enrich_stop(&g_enrich[k]);
+}
+#endif
+
+/* ─── Result selection ───────────────────────────────────────── */
+/*
+ *  Search (or hit the cache) and let the user pick. Each result row is
+ *  drawn as soon as its JSON line arrives, and a number typed while the
+ *  search is still running is honoured right away: if that result is
+ *  already on screen the rest of the search is killed, otherwise we
+ *  keep reading until it shows up. With --first the search is killed as
+ *  soon as result #1 is parsed. Stream URL prefetch workers run inside
+ *  the same poll() loop.
+ *
+ *  Results come in pages of num_results. Once a page is complete the
+ *  next one is fetched in the background and appended to g_results, so
+ *  `n` usually shows it at once and `p` never waits. Numbers stay
+ *  absolute across pages. A page with fewer hits than asked for is the
+ *  last one.
+ *
+ *  Returns the 1-based choice, 0 to quit.
+ */
+static void search_finish(Config *c, SearchStream *ss) {
+    int complete=ss->done;
+    search_stop(ss);
+    if (complete && g_nresults>0 && !c->no_cache) scache_store(c);
+}
+
+static void no_results(Config *c) {
+    die("No results found for '%s'\n"
+        "  Tip: run with -v to print the exact yt-dlp command.",c->query);
+}
+
+static int select_result(Config *c) {
+    SearchStream ss;
+    int searching=1, exhausted=0, page=0, shown=0, N=c->num_results;
+
+    if (c->local) {
+        if (!lib_search(c)) die("Nothing in the library matches '%s'",c->query);
+        if (c->direct_play) return 1;
+        shown=print_page(c,0);
+        searching=0;
+        exhausted=1;
+    } else if (!c->no_cache && !c->refresh) {
+        long long t=trace_now();
+        int n=scache_lookup(c);
+        trace_span("cache.search",0,t);
+        if (c->verbose)
+            printf("%s[cache]%s search %s  (lifetime: %llu hits / %llu misses)\n\n",
+                   C_DIM,C_RST, n?"hit":"miss", g_scache_stats.hits, g_scache_stats.misses);
+        if (n) {
+            if (c->direct_play) return 1;
+            shown=print_page(c,0);
+            exhausted=n%N!=0;
+            searching=0;
+        }
+    }
+    if (searching) {
+        search_youtube(c,&ss,0);
+        if (!c->direct_play) { print_results_header(c,0,N); fflush(stdout); }
+    }
+
+#ifdef PLATFORM_WINDOWS
+    /* no background work here: a page is fetched when it is asked for */
+    (void)shown;
+    if (searching) {
+        while (!ss.done) {
+            int before=g_nresults;
+            search_pump(&ss);
+            if (c->direct_play) { if (g_nresults) break; continue; }
+            for (int i=before; i<g_nresults; i++) print_result_row(i,0);
+        }
+        search_finish(c,&ss);
+        if (!g_nresults) no_results(c);
+        if (c->direct_play) return 1;
+        exhausted=g_nresults<N;
+    }
+    for (;;) {
+        int choice=prompt_choice(), end=(page+1)*N;
+        if (choice==CHOICE_PREV) { if (page>0) page--; print_page(c,page); continue; }
+        if (choice!=CHOICE_NEXT) return choice;
+        if (g_nresults<=end && !exhausted) {
+            search_youtube(c,&ss,g_nresults);
+            while (!ss.done) search_pump(&ss);
+            search_finish(c,&ss);
+            exhausted=g_nresults-ss.first<N;
+        }
+        if (g_nresults>end) page++;
+        else info_msg("No more results");
+        print_page(c,page);
+    }
+#else
+    int choice=0, picked=0, prompted=0, cmd=0;   /* cmd: n/p waiting for the page */
+    enrich_reset();
+    for (;;) {
+        char *line; size_t len;
+        int end=(page+1)*N;
+        if (!c->direct_play && shown<end && shown<g_nresults) {
+            while (shown<end && shown<g_nresults) print_result_row(shown++,0);
+            fflush(stdout);
+        }
+        if (!picked && !cmd && (line=lr_next(&g_stdin,&len))) {
+            g_scr_line++;                                       /* the echoed Enter */
+            choice=parse_choice(line);
+            if (choice==CHOICE_NEXT || choice==CHOICE_PREV) cmd=choice;
+            else picked=1;
+        }
+        if (c->direct_play && g_nresults>0) { choice=1; picked=1; }
+        if (picked && choice<0) die("Invalid choice: %d",choice);
+        if (picked && choice<=g_nresults) break;
+        if (picked && !(searching && choice<=ss.first+N)) die("Invalid choice: %d",choice);
+
+        if (searching && ss.done) {
+            searching=0;
+            search_finish(c,&ss);
+            if (g_nresults-ss.first<N) exhausted=1;
+            if (!g_nresults) { if (picked && choice==0) break; no_results(c); }
+            if (picked) die("Invalid choice: %d",choice);
+            if (page>0 && page*N>=g_nresults) {
+                info_msg("No more results");
+                shown=print_page(c,--page);
+                prompted=0;
+            }
+            continue;
+        }
+        int ready = shown==end || (!searching && shown==g_nresults);
+        int settled = ready && !(searching && ss.first<end);    /* its fetch is over */
+        if (settled && cmd==CHOICE_PREV) {
+            if (page>0) { shown=print_page(c,--page); prompted=0; }
+            else print_prompt();
+            cmd=0;
+            continue;
+        }
+        if (settled && cmd==CHOICE_NEXT) {
+            if (!searching && !exhausted && g_nresults==end) { search_youtube(c,&ss,end); searching=1; }
+            if (g_nresults>end || (searching && ss.first>=end)) { shown=print_page(c,++page); prompted=0; }
+            else { info_msg("No more results"); g_scr_line++; print_prompt(); }
+            cmd=0;
+            continue;
+        }
+        if (ready && !prompted && !c->direct_play) {
+            if (shown<end && !c->quiet) {
+                printf("  %s(%d of %d results)%s\n\n",C_DIM,shown-page*N,N,C_RST);
+                g_scr_line+=2;
+            }
+            print_prompt();
+            prompted=1;
+        }
+        if (ready && !picked && !cmd && g_stdin.eof) { choice=0; picked=1; break; }
+        if (prompted && !searching && !exhausted && g_nresults==end) { search_youtube(c,&ss,end); searching=1; }
+
+        prefetch_schedule(c,page*N);
+        if (!c->direct_play) enrich_schedule(c,page*N,shown);
+
+        struct pollfd pf[2+MAX_PREFETCH+ENRICH_JOBS];
+        int who[2+MAX_PREFETCH+ENRICH_JOBS], nfd=0;
+        if (searching) { pf[nfd].fd=ss.lr.fd; who[nfd++]=-1; }
+        if (!c->direct_play && !g_stdin.eof) { pf[nfd].fd=STDIN_FILENO; who[nfd++]=-2; }
+        for (int i=0; i<MAX_PREFETCH; i++)
+            if (g_prefetch[i].state==PF_RUNNING) { pf[nfd].fd=g_prefetch[i].lr.fd; who[nfd++]=i; }
+        for (int k=0; k<ENRICH_JOBS; k++)
+            if (g_enrich[k].busy) { pf[nfd].fd=g_enrich[k].lr.fd; who[nfd++]=-3-k; }
+        for (int i=0; i<nfd; i++) { pf[i].events=POLLIN; pf[i].revents=0; }
+
+        if (poll(pf,(nfds_t)nfd,-1)<0) { if (errno==EINTR) continue; die("poll failed"); }
+        for (int i=0; i<nfd; i++) {
+            if (!pf[i].revents) continue;
+            if (who[i]==-2) lr_fill(&g_stdin);
+            else if (who[i]<=-3) enrich_pump(-3-who[i]);
+            else if (who[i]>=0) prefetch_pump(c,who[i]);
+            else search_pump(&ss);
+        }
+    }
+
+    if (searching) search_finish(c,&ss);
+    prefetch_cancel(picked && choice>0 ? choice-1 : -1);
+    enrich_cancel();
+    return choice;
+#endif
+}
+
+/* ─── Search as you type ────────────────────────────────────── */
+/*
+ *  --interactive: the terminal goes raw and the query is edited in
+ *  place. A search starts once typing pauses for DEBOUNCE_MS; changing
+ *  the query kills a yt-dlp that is still running for the old one.
+ *  Rows are drawn as they arrive, each at its own screen line, so
+ *  nothing already shown is redrawn.
+ *
+ *  Extending the query that produced the current results ("lofi" →
+ *  "lofi jazz") filters them locally instead: only the words that
+ *  weren't in the searched query are matched, case-insensitively,
+ *  against title and channel. Only when nothing matches does the
+ *  longer query go to YouTube. The search cache applies as usual, so
+ *  backspacing to an earlier query is instant too.
+ *
+ *  Keys: ↑/↓ (^P/^N) select, Enter plays, Esc or ^C quits, ^U clears,
+ *  ^W deletes a word. Returns the 1-based choice, 0 to quit.
+ */
+#ifndef PLATFORM_WINDOWS
+#define TY_HEAD 5                       /* screen lines above the first row */
+
+typedef struct {
+    char q[256];                        /* as typed */
+    char base[256];                     /* normalized query g_results belong to */
+    int *vis, nvis, vcap;               /* rows of g_results matching q */
+    int  seen;                          /* g_results already run through the filter */
+    int  sel, top;                      /* selected / first visible entry of vis */
+    long long due;                      /* ms: search for q then, 0 = nothing pending */
+    SearchStream ss;
+    int  searching;
+} TypeState;
+
+static struct termios g_tty_saved;
+static int g_tty_raw;
+
+static void tty_restore(void) {
+    if (!g_tty_raw) return;
+    tcsetattr(STDIN_FILENO,TCSAFLUSH,&g_tty_saved);
+    fputs("\033[?1049l",stdout); fflush(stdout);
+    g_tty_raw=0;
+}
+
+/* Raw input on the alternate screen; restored at exit, die() included. */
+static void tty_raw(void) {
+    static int hooked;
+    struct termios t;
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) || tcgetattr(STDIN_FILENO,&g_tty_saved)!=0)
+        die("--interactive needs a terminal");
+    t=g_tty_saved;
+    t.c_lflag &= ~(tcflag_t)(ICANON|ECHO|ISIG|IEXTEN);
+    t.c_iflag &= ~(tcflag_t)(IXON|ICRNL);
+    t.c_cc[VMIN]=1; t.c_cc[VTIME]=0;
+    if (!hooked) { atexit(tty_restore); hooked=1; }
+    tcsetattr(STDIN_FILENO,TCSAFLUSH,&t);
+    g_tty_raw=1;
+    fputs("\033[?1049h",stdout);
+}
+
+/* Result rows that fit below the query line. */
+static int ty_fit(void) {
+    int n=(tty_rows()-TY_HEAD-1)/3;
+    return n<1 ? 1 : n;
+}
+
+/* Case-insensitive (ASCII) search for the n bytes of w in s. */
+static int ci_has(const char *s, const char *w, size_t n) {
+    for (; *s; s++) {
+        size_t k=0;
+        while (k<n && s[k] && tolower((unsigned char)s[k])==(unsigned char)w[k]) k++;
+        if (k==n) return 1;
+    }
+    return 0;
+}
+
+/* Does every word of nq (normalized) that isn't a word of base occur in r? */
+static int ty_match(const VideoResult *r, const char *nq, const char *base) {
+    for (const char *w=nq; *w; ) {
+        size_t n=strcspn(w," ");
+        int known=0;
+        for (const char *b=base; *b; ) {
+            size_t m=strcspn(b," ");
+            if (m==n && !strncmp(b,w,n)) { known=1; break; }
+            b+=m; while (*b==' ') b++;
+        }
+        if (!known && !ci_has(r->title,w,n) && !ci_has(r->channel,w,n)) return 0;
+        w+=n; while (*w==' ') w++;
+    }
+    return 1;
+}
+
+/* The typed query extends the searched one, so filtering is enough. */
+static int ty_narrows(TypeState *st) {
+    char nq[256];
+    size_t bl=strlen(st->base);
+    normalize_query(st->q,nq,sizeof(nq));
+    return bl && !strncmp(nq,st->base,bl);
+}
+
+/* Run results from st->seen on through the filter. Returns the first new vis entry. */
+static int ty_filter(TypeState *st) {
+    char nq[256];
+    int first=st->nvis;
+    normalize_query(st->q,nq,sizeof(nq));
+    for (; st->seen<g_nresults; st->seen++) {
+        if (!ty_match(&g_results[st->seen],nq,st->base)) continue;
+        if (st->nvis==st->vcap) {
+            st->vcap = st->vcap ? st->vcap*2 : 64;
+            st->vis=(int*)realloc(st->vis,(size_t)st->vcap*sizeof(int));
+            if (!st->vis) die("Out of memory");
+        }
+        st->vis[st->nvis++]=st->seen;
+    }
+    return first;
+}
+
+static void ty_refilter(TypeState *st) {
+    st->nvis=st->seen=st->sel=st->top=0;
+    ty_filter(st);
+}
+
+static void ty_status(TypeState *st) {
+    printf("\033[4;1H\033[K  %s",C_DIM);
+    if (!st->q[0])                          printf("type to search");
+    else if (st->searching && !st->nvis)    printf("searching…");
+    else if (st->due && !st->nvis)          printf("…");
+    else if (st->nvis<g_nresults)           printf("%d of %d results match",st->nvis,g_nresults);
+    else printf("%d result%s%s",st->nvis,st->nvis==1?"":"s",st->searching?", searching…":"");
+    printf("%s",C_RST);
+}
+
+/* Put the cursor back at the end of the query. */
+static void ty_cursor(TypeState *st) {
+    int col=11;
+    for (const char *p=st->q; *p; p++) col += ((unsigned char)*p & 0xC0)!=0x80;
+    printf("\033[3;%dH",col);
+    fflush(stdout);
+}
+
+static void ty_row(TypeState *st, int k) {
+    printf("\033[%d;1H",TY_HEAD+1+3*(k-st->top));
+    print_result_row(st->vis[k],k==st->sel);
+}
+
+static void ty_draw(TypeState *st) {
+    int fit=ty_fit();
+    if (st->sel<st->top) st->top=st->sel;
+    if (st->sel>=st->top+fit) st->top=st->sel-fit+1;
+    printf("\033[H\033[2J");
+    printf("  %sytplay · ↑/↓ select · Enter play · Esc quit%s\n\n",C_DIM,C_RST);
+    printf("  %sSearch:%s %s",C_CYN,C_RST,st->q);
+    ty_status(st);
+    for (int k=st->top; k<st->nvis && k<st->top+fit; k++) ty_row(st,k);
+    ty_cursor(st);
+}
+
+/* Rows that arrived since the last call: draw the ones that fit. */
+static void ty_more(TypeState *st) {
+    int k=ty_filter(st), fit=ty_fit();
+    for (; k<st->nvis && k<st->top+fit; k++) ty_row(st,k);
+    ty_status(st);
+    ty_cursor(st);
+}
+
+/* Query edited: re-filter what we have, cancel or schedule the search. */
+static void ty_changed(TypeState *st) {
+    char nq[256];
+    normalize_query(st->q,nq,sizeof(nq));
+    if (ty_narrows(st)) {
+        ty_refilter(st);
+        st->due = (!st->nvis && !st->searching && strcmp(nq,st->base)) ? mono_ms()+DEBOUNCE_MS : 0;
+    } else {
+        if (st->searching) { search_stop(&st->ss); st->searching=0; }
+        ty_refilter(st);
+        st->due = nq[0] ? mono_ms()+DEBOUNCE_MS : 0;
+    }
+    ty_draw(st);
+}
+
+static void ty_search(Config *c, TypeState *st) {
+    st->due=0;
+    strncpy(c->query,st->q,sizeof(c->query)-1);
+    normalize_query(st->q,st->base,sizeof(st->base));
+    if (!c->no_cache && !c->refresh && scache_lookup(c)) {
+        ty_refilter(st);
+        ty_draw(st);
+        return;
+    }
+    search_youtube(c,&st->ss,0);
+    st->searching=1;
+    ty_refilter(st);
+    ty_draw(st);
+}
+
+/* Apply one read()'s worth of keys. Returns 1 with *choice set when done. */
+static int ty_keys(TypeState *st, const unsigned char *k, ssize_t n, int *choice) {
+    size_t len=strlen(st->q);
+    int edited=0, moved=0;
+    for (ssize_t i=0; i<n; i++) {
+        unsigned char ch=k[i];
+        if (ch==27 && i+2<n && (k[i+1]=='[' || k[i+1]=='O')) {
+            i+=2;
+            if (k[i]=='A') { if (st->sel>0) st->sel--, moved=1; }
+            else if (k[i]=='B') { if (st->sel<st->nvis-1) st->sel++, moved=1; }
+            else while (i<n && !(k[i]>='@' && k[i]<='~')) i++;   /* skip the rest */
+        }
+        else if (ch==27 || ch==3)  { *choice=0; return 1; }
+        else if (ch=='\r' || ch=='\n') { if (st->nvis) { *choice=st->vis[st->sel]+1; return 1; } }
+        else if (ch==16) { if (st->sel>0) st->sel--, moved=1; }
+        else if (ch==14) { if (st->sel<st->nvis-1) st->sel++, moved=1; }
+        else if (ch==127 || ch==8) {
+            while (len && ((unsigned char)st->q[len-1] & 0xC0)==0x80) len--;
+            if (len) len--;
+            st->q[len]='\0'; edited=1;
+        }
+        else if (ch==21) { len=0; st->q[0]='\0'; edited=1; }
+        else if (ch==23) {
+            while (len && st->q[len-1]==' ') len--;
+            while (len && st->q[len-1]!=' ') len--;
+            st->q[len]='\0'; edited=1;
+        }
+        else if (ch>=32 && len<sizeof(st->q)-1) { st->q[len++]=(char)ch; st->q[len]='\0'; edited=1; }
+    }
+    if (edited) ty_changed(st);
+    else if (moved) ty_draw(st);
+    return 0;
+}
+
+static int type_select(Config *c) {
+    TypeState st;
+    int choice=0;
+    size_t ql=strlen(c->query);
+    memset(&st,0,sizeof(st));
+    if (ql>=sizeof(st.q)) ql=sizeof(st.q)-1;
+    memcpy(st.q,c->query,ql);
+    tty_raw();
+    ty_draw(&st);
+    if (st.q[0]) ty_search(c,&st);
+
+    for (;;) {
+        struct pollfd pf[2];
+        int nfd=1, timeout=-1;
+        pf[0].fd=STDIN_FILENO; pf[0].events=POLLIN; pf[0].revents=0;
+        if (st.searching) { pf[1].fd=st.ss.lr.fd; pf[1].events=POLLIN; pf[1].revents=0; nfd=2; }
+        if (st.due) { long long d=st.due-mono_ms(); timeout = d>0 ? (int)d : 0; }
+
+        if (poll(pf,(nfds_t)nfd,timeout)<0) { if (errno==EINTR) continue; die("poll failed"); }
+        if (st.due && mono_ms()>=st.due) ty_search(c,&st);
+        if (pf[0].revents) {
+            unsigned char k[64];
+            ssize_t n=read(STDIN_FILENO,k,sizeof(k));
+            if (n<=0) break;
+            if (ty_keys(&st,k,n,&choice)) break;
+        }
+        if (nfd==2 && st.searching && pf[1].revents) {
+            search_pump(&st.ss);
+            if (st.ss.done) {
+                search_finish(c,&st.ss);
+                st.searching=0;
+                /* the narrowed query matched nothing here: ask YouTube */
+                if (!st.nvis && g_nresults && ty_narrows(&st)) st.due=mono_ms();
+            }
+            ty_more(&st);
+        }
+    }
+
+    if (st.searching) search_finish(c,&st.ss);
+    free(st.vis);
+    tty_restore();
+    return choice;
+}
+#endif
+
+/* ─── Download store ─────────────────────────────────────────── */
+/*
+ *  -d and -P download into <cachedir>/store, one file per video id +
+ *  format, named <id>-<hash of the format>.<ext>, so a video watched
+ *  again in the same quality plays straight from disk — no yt-dlp, no
+ *  network. store.tsv next to it indexes the files:
+ *
+ *    <last played> \t <bytes> \t <pinned> \t <id> \t <format> \t <file>
+ *
+ *  Every change is a line appended to it, never a rewrite, so ytplays
+ *  and prefetch workers filing downloads at the same time can't drop
+ *  each other's entries: the last line for an id + format wins, and
+ *  <bytes> -1 removes it. Loading compacts the file once superseded
+ *  lines dominate.
+ *
+ *  The format column is the -f selector (plus --ytdlp-args, which can
+ *  change what gets written). When the files add up to more than
+ *  --store-size MB, the least recently played unpinned ones are deleted;
+ *  --keep pins an entry instead of deleting anything after playback.
+ *  An explicit -o or --no-store downloads to that directory as before.
+ */
+typedef struct {
+    long long used, size;
+    int       pinned;
+    char     *id, *key, *file;          /* point into the loaded index */
+} StoreEntry;
+
+static int use_store(Config *c) { return !c->no_store && !c->output_set; }
+
+static int store_paths(char *dir, size_t dn, char *index, size_t in) {
+    char base[1000];
+    if (!get_cachedir(base,sizeof(base))) return 0;
+    snprintf(dir,dn,"%s%sstore",base,PATH_SEP);
+    snprintf(index,in,"%s%sstore.tsv",base,PATH_SEP);
+    MKDIR(dir);
+    return 1;
+}
+
+/* What a download of fmt is filed under: the format and any --ytdlp-args. */
+static void store_key(Config *c, const char *fmt, char *out, size_t n) {
+    if (c->extra_ytdlp[0]) snprintf(out,n,"%s %s",fmt,c->extra_ytdlp);
+    else                   snprintf(out,n,"%s",fmt);
+    for (char *p=out; *p; p++) if (*p=='\t' || *p=='\n') *p=' ';
+}
+
+/* File name without extension: <id>-<hash>. */
+static void store_name(const char *id, const char *key, char *out, size_t n) {
+    snprintf(out,n,"%s-%08lx",id,(unsigned long)(str_hash(key,strlen(key))&0xffffffffUL));
+}
+
+static void store_line(FILE *f, const StoreEntry *e) {
+    fprintf(f,"%lld\t%lld\t%d\t%s\t%s\t%s\n",e->used,e->size,e->pinned,e->id,e->key,e->file);
+}
+
+/* Rewrite store.tsv as e[0..n) unless it has grown past was bytes (appended to meanwhile). */
+static void store_save(const char *index, const StoreEntry *e, int n, long long was) {
+    char tmp[1200];
+    snprintf(tmp,sizeof(tmp),"%s.tmp",index);
+    FILE *f=fopen(tmp,"wb");
+    if (!f) return;
+    for (int i=0; i<n; i++) store_line(f,&e[i]);
+    if (fclose(f)!=0 || file_size(index)!=was || RENAME(tmp,index)!=0) remove(tmp);
+}
+
+/*
+ *  The live entries of store.tsv; *data owns the strings. Malformed
+ *  lines are skipped.
+ */
+static int store_load(const char *index, StoreEntry **out, char **data) {
+    size_t len=0, cap=16;
+    unsigned char *d=read_file(index,&len);
+    char *nd, *cur, *line;
+    int n=0, live=0, *seen;
+    *out=NULL; *data=NULL;
+    if (!d || !(nd=(char*)realloc(d,len+1))) { free(d); return 0; }
+    nd[len]='\0'; cur=nd; *data=nd;
+    size_t max=count_lines(nd);
+    if (!(*out=(StoreEntry*)malloc(max*sizeof(StoreEntry)))) return 0;
+    while ((size_t)n<max && (line=next_line(&cur))) {
+        char *f[6]; int nf=0;
+        for (char *p=line; nf<6; ) {
+            f[nf++]=p;
+            if (!(p=strchr(p,'\t'))) break;
+            *p++='\0';
+        }
+        if (nf<6 || !*f[3] || !*f[5]) continue;
+        StoreEntry *e=&(*out)[n++];
+        e->used=atoll(f[0]); e->size=atoll(f[1]); e->pinned=atoi(f[2]);
+        e->id=f[3]; e->key=f[4]; e->file=f[5];
+    }
+
+    StoreEntry *e=*out;                          /* the last line per id + format */
+    while (cap<2*(size_t)n) cap*=2;
+    if (!(seen=(int*)malloc(cap*sizeof(int)))) return 0;
+    for (size_t i=0; i<cap; i++) seen[i]=-1;
+    for (int i=n-1; i>=0; i--) {
+        size_t h=(str_hash(e[i].id,strlen(e[i].id))*31+str_hash(e[i].key,strlen(e[i].key)))&(cap-1);
+        while (seen[h]>=0 && (strcmp(e[seen[h]].id,e[i].id) || strcmp(e[seen[h]].key,e[i].key))) h=(h+1)&(cap-1);
+        if (seen[h]<0) seen[h]=i;
+        else e[i].size=-1;
+    }
+    free(seen);
+    for (int i=0; i<n; i++) if (e[i].size>=0) e[live++]=e[i];
+    if (n>2*live+16) store_save(index,e,live,(long long)len);
+    return live;
+}
+
+static int store_get(Config *c, const char *id, const char *key, char *path, size_t n) {
+    char dir[1024], index[1100], *data;
+    StoreEntry *e;
+    FILE *f;
+    int ne, found=0;
+    if (!store_paths(dir,sizeof(dir),index,sizeof(index))) return 0;
+    ne=store_load(index,&e,&data);
+    for (int i=0; i<ne; i++) {
+        if (strcmp(e[i].id,id) || strcmp(e[i].key,key)) continue;
+        snprintf(path,n,"%s%s%s",dir,PATH_SEP,e[i].file);
+        if (file_size(path)<0) e[i].size=-1;
+        else {
+            e[i].used=(long long)time(NULL);
+            if (c->keep) e[i].pinned=1;
+            found=1;
+        }
+        if ((f=fopen(index,"ab"))) { store_line(f,&e[i]); fclose(f); }
+        break;
+    }
+    free(e); free(data);
+    return found;
+}
+
+/*
+ *  File the just-downloaded path (inside the store) under id + key,
+ *  then delete least recently played unpinned files until the store
+ *  fits --store-size. The new entry itself is never evicted.
+ */
+static void store_put(Config *c, const char *id, const char *key, const char *path) {
+    char dir[1024], index[1100], p[2048], *data;
+    const char *file=strrchr(path,PATH_SEP[0]);
+    StoreEntry *e, mine;
+    FILE *f;
+    long long total=0, budget=(long long)c->store_mb*1024*1024;
+    int ne, evicted=0;
+    if (!store_paths(dir,sizeof(dir),index,sizeof(index))) return;
+    file = file ? file+1 : path;
+    ne=store_load(index,&e,&data);
+    if (!(f=fopen(index,"ab"))) { free(e); free(data); return; }
+    setvbuf(f,NULL,_IOLBF,BUFSIZ);               /* one write() per line: appends never interleave */
+    mine.used=(long long)time(NULL); mine.size=file_size(path); mine.pinned=c->keep;
+    mine.id=(char*)id; mine.key=(char*)key; mine.file=(char*)file;
+    if (mine.size<0) mine.size=0;
+    store_line(f,&mine);
+    total+=mine.size;
+    for (int i=0; i<ne; i++) {
+        if (!strcmp(e[i].id,id) && !strcmp(e[i].key,key)) { e[i].id=NULL; continue; }
+        snprintf(p,sizeof(p),"%s%s%s",dir,PATH_SEP,e[i].file);
+        if ((e[i].size=file_size(p))<0) { store_line(f,&e[i]); e[i].id=NULL; continue; }
+        total+=e[i].size;
+    }
+    while (total>budget) {
+        int lru=-1;
+        for (int i=0; i<ne; i++)
+            if (e[i].id && !e[i].pinned && (lru<0 || e[i].used<e[lru].used)) lru=i;
+        if (lru<0) break;
+        snprintf(p,sizeof(p),"%s%s%s",dir,PATH_SEP,e[lru].file);
+        remove(p);
+        total-=e[lru].size;
+        e[lru].size=-1; store_line(f,&e[lru]);
+        e[lru].id=NULL;
+        evicted++;
+    }
+    fclose(f);
+    if (c->verbose)
+        printf("%s[store]%s %.1f MB of %ld MB used%s\n",C_DIM,C_RST,total/1048576.0,c->store_mb,
+               evicted ? ", evicted the least recently played" : "");
+    free(e); free(data);
+}
+
+/* ─── Range downloader ───────────────────────────────────────── */
+/*
+ *  --connections N: -d fetches the URLs from `yt-dlp -g` itself instead
+ *  of leaving the transfer to yt-dlp's single stream. Each file is
+ *  preallocated and cut into ranges of at most RANGE_CHUNK bytes; N
+ *  range requests run at once and write what they receive at its offset
+ *  with pwrite(). A range that fails, comes up short or receives nothing
+ *  for RANGE_STALL seconds is requested again from where it stopped, up
+ *  to RANGE_RETRIES times. http:// is
+ *  spoken directly over a socket; https:// — every googlevideo URL —
+ *  goes through one `curl -r -D -` per range, as ytplay has no TLS of
+ *  its own, and the headers curl dumps ahead of the body are checked
+ *  like the socket's: anything but a 206 (or a 200 that is the whole
+ *  file) fails the attempt. Separate video and audio are then merged
+ *  with `ffmpeg -c copy` like yt-dlp does. If anything is missing or
+ *  fails, the caller falls back to a plain yt-dlp download. POSIX only.
+ */
+#ifndef PLATFORM_WINDOWS
+enum { RG_QUEUED, RG_RUNNING, RG_DONE, RG_FAILED };
+
+typedef struct {
+    const char *url;
+    char        authority[256], host[256], port[16];
+    const char *path;
+    int         https;
+    struct sockaddr_storage addr;   /* http: resolved once */
+    socklen_t   alen;
+    long long   size;
+    int         fd;                 /* destination */
+} RangeFile;
+
+typedef struct {
+    RangeFile *file;
+    long long  off, len, done;
+    int        state, tries;
+} RangeChunk;
+
+typedef struct {
+    RangeChunk *chunk;              /* NULL: idle */
+    int         fd;                 /* socket, or curl's stdout */
+    Proc        proc;               /* https */
+    int         connecting, head;   /* http: waiting for connect() / headers */
+    char        hdr[4096];
+    size_t      hlen;
+    long long   seen;               /* mono_ms() of the last progress */
+} RangeConn;
+
+/* Split an http(s) URL. 0 if it is neither. */
+static int range_url(RangeFile *f, const char *url) {
+    const char *a, *e;
+    memset(f,0,sizeof(*f));
+    f->url=url; f->fd=-1;
+    if      (!strncmp(url,"https://",8)) { f->https=1; a=url+8; }
+    else if (!strncmp(url,"http://",7))  a=url+7;
+    else return 0;
+    e=a+strcspn(a,"/?#");
+    if (e==a || (size_t)(e-a)>=sizeof(f->authority)) return 0;
+    snprintf(f->authority,sizeof(f->authority),"%.*s",(int)(e-a),a);
+    f->path = *e=='/' ? e : "/";
+    snprintf(f->host,sizeof(f->host),"%s",f->authority);
+    char *colon=strrchr(f->host,':');
+    if (colon && !strchr(colon,']')) { *colon='\0'; snprintf(f->port,sizeof(f->port),"%s",colon+1); }
+    else snprintf(f->port,sizeof(f->port),"%s",f->https ? "443" : "80");
+    return 1;
+}
+
+static int ci_prefix(const char *s, const char *p) {
+    while (*p) if (tolower((unsigned char)*s++)!=*p++) return 0;
+    return 1;
+}
+
+/* Start a non-blocking connect to f. Returns the socket or -1. */
+static int http_open(RangeFile *f) {
+    int fd=socket(f->addr.ss_family,SOCK_STREAM,0);
+    if (fd<0) return -1;
+    set_cloexec(fd); set_nonblock(fd);
+    if (connect(fd,(struct sockaddr*)&f->addr,f->alen)!=0 && errno!=EINPROGRESS) { close(fd); return -1; }
+    return fd;
+}
+
+static int http_request(int fd, const RangeFile *f, long long from, long long to) {
+    char req[4096+512];
+    int n=snprintf(req,sizeof(req),
+        "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%lld-%lld\r\nUser-Agent: ytplay/" YTPLAY_VERSION "\r\n"
+        "Accept-Encoding: identity\r\nConnection: close\r\n\r\n",f->path,f->authority,from,to);
+    if (n<=0 || (size_t)n>=sizeof(req)) return -1;
+    return write(fd,req,(size_t)n)==n ? 0 : -1;       /* fits the empty send buffer */
+}
+
+/*
+ *  Size of f in bytes, or -1: googlevideo URLs say it (clen=); anything
+ *  else is asked for its first byte and the total read off Content-Range.
+ */
+static long long range_probe(Config *c, RangeFile *f) {
+    char buf[8192]="";
+    size_t len=0;
+    const char *p=strstr(f->url,"clen=");
+    if (!f->https) {
+        struct addrinfo hints, *ai;
+        memset(&hints,0,sizeof(hints)); hints.ai_socktype=SOCK_STREAM;
+        if (getaddrinfo(f->host[0]=='[' ? f->host+1 : f->host,f->port,&hints,&ai)!=0) return -1;
+        memcpy(&f->addr,ai->ai_addr,ai->ai_addrlen); f->alen=ai->ai_addrlen;
+        freeaddrinfo(ai);
+    }
+    if (p && (p==f->url || p[-1]=='?' || p[-1]=='&') && atoll(p+5)>0) return atoll(p+5);
+
+    if (f->https) {
+        Proc pr;
+        Argv a={0};
+        argv_add(&a,"curl"); argv_add(&a,"-sS"); argv_add(&a,"-L"); argv_add(&a,"-r"); argv_add(&a,"0-0");
+        argv_add(&a,"-D"); argv_add(&a,"-"); argv_add(&a,"-o"); argv_add(&a,DEVNULL); argv_add(&a,f->url);
+        if (c->verbose) argv_show("range",&a);
+        int rc=proc_spawn(&pr,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL);
+        argv_free(&a);
+        if (rc!=0) return -1;
+        for (;;) {
+            struct pollfd pf={pr.out,POLLIN,0};
+            ssize_t r;
+            if (len==sizeof(buf)-1 || poll(&pf,1,RESOLVE_TIMEOUT)<=0) break;
+            if ((r=read(pr.out,buf+len,sizeof(buf)-1-len))<0 && (errno==EAGAIN || errno==EINTR)) continue;
+            if (r<=0) break;
+            len+=(size_t)r;
+        }
+        proc_kill(&pr); proc_close(&pr);
+    } else {
+        int fd=http_open(f);
+        struct pollfd pf;
+        if (fd<0) return -1;
+        pf.fd=fd; pf.events=POLLOUT; pf.revents=0;
+        if (poll(&pf,1,10000)<=0 || http_request(fd,f,0,0)!=0) { close(fd); return -1; }
+        while (len<sizeof(buf)-1 && !strstr(buf,"\r\n\r\n")) {
+            ssize_t r;
+            pf.events=POLLIN;
+            if (poll(&pf,1,10000)<=0) break;
+            if ((r=read(fd,buf+len,sizeof(buf)-1-len))<0 && (errno==EAGAIN || errno==EINTR)) continue;
+            if (r<=0) break;
+            len+=(size_t)r; buf[len]='\0';
+        }
+        close(fd);
+    }
+    buf[len]='\0';
+    long long size=-1;
+    for (char *cur=buf, *line; (line=next_line(&cur)); )      /* the last one wins (redirects) */
+        if (ci_prefix(line,"content-range:") && (p=strchr(line,'/'))) size=atoll(p+1);
+    return size>0 ? size : -1;
+}
+
+/* Put chunk k on connection cn. 0 on success. */
+static int range_start(Config *c, RangeConn *cn, RangeChunk *k) {
+    RangeFile *f=k->file;
+    long long from=k->off+k->done, to=k->off+k->len-1;
+    memset(cn,0,sizeof(*cn));
+    cn->fd=-1; cn->proc.out=-1;
+    if (f->https) {
+        Argv a={0};
+        argv_add(&a,"curl"); argv_add(&a,"-sS"); argv_add(&a,"-f"); argv_add(&a,"-L");
+        argv_add(&a,"--connect-timeout"); argv_addf(&a,"%d",RANGE_STALL);
+        argv_add(&a,"--speed-limit"); argv_add(&a,"1"); argv_add(&a,"--speed-time"); argv_addf(&a,"%d",RANGE_STALL);
+        argv_add(&a,"-r"); argv_addf(&a,"%lld-%lld",from,to);
+        argv_add(&a,"-D"); argv_add(&a,"-"); argv_add(&a,f->url);
+        if (c->verbose) argv_show("range",&a);
+        int rc=proc_spawn(&cn->proc,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL);
+        argv_free(&a);
+        if (rc!=0) return -1;
+        cn->fd=cn->proc.out;
+        cn->head=1;                     /* -D -: the headers come first here too */
+    } else {
+        if ((cn->fd=http_open(f))<0) return -1;
+        cn->connecting=cn->head=1;
+    }
+    cn->chunk=k;
+    cn->seen=mono_ms();
+    k->state=RG_RUNNING;
+    return 0;
+}
+
+/* Close cn; its chunk is done, requeued from where it stopped, or failed. */
+static void range_stop(Config *c, RangeConn *cn, int ok) {
+    RangeChunk *k=cn->chunk;
+    if (cn->proc.out>=0) {
+        if (proc_kill(&cn->proc)!=0 && k->done<k->len) ok=0;
+        proc_close(&cn->proc);
+    } else if (cn->fd>=0) close(cn->fd);
+    cn->fd=-1; cn->chunk=NULL;
+    if (ok && k->done==k->len) { k->state=RG_DONE; return; }
+    k->state = ++k->tries<=RANGE_RETRIES ? RG_QUEUED : RG_FAILED;
+    if (c->verbose)
+        printf("\n%s[range]%s bytes %lld-%lld: attempt %d stopped at %lld\n",C_DIM,C_RST,
+               k->off,k->off+k->len-1,k->tries,k->off+k->done);
+}
+
+/*
+ *  Bytes that arrived on cn: headers first, then the body at its offset.
+ *  Header blocks of redirects curl followed are passed over.
+ */
+static void range_data(Config *c, RangeConn *cn, char *d, size_t n) {
+    RangeChunk *k=cn->chunk;
+    if (cn->head) {
+        char *end;
+        size_t take = n<sizeof(cn->hdr)-1-cn->hlen ? n : sizeof(cn->hdr)-1-cn->hlen, hl;
+        int status;
+        memcpy(cn->hdr+cn->hlen,d,take); cn->hlen+=take; cn->hdr[cn->hlen]='\0';
+        for (;;) {
+            if (!(end=strstr(cn->hdr,"\r\n\r\n"))) {
+                if (cn->hlen==sizeof(cn->hdr)-1) range_stop(c,cn,0);
+                return;
+            }
+            status=0;
+            sscanf(cn->hdr,"HTTP/%*s %d",&status);
+            hl=(size_t)(end+4-cn->hdr);
+            if (status/100!=1 && status/100!=3) break;
+            memmove(cn->hdr,cn->hdr+hl,cn->hlen-hl+1); cn->hlen-=hl;
+        }
+        /* 206, or 200 with the whole file when that is what was asked for */
+        if (status!=206 && !(status==200 && k->off+k->done==0 && k->len==k->file->size)) { range_stop(c,cn,0); return; }
+        cn->head=0;
+        d+=take-(cn->hlen-hl); n-=take-(cn->hlen-hl);   /* what follows the headers is body */
+    }
+    if ((long long)n>k->len-k->done) n=(size_t)(k->len-k->done);
+    while (n) {
+        ssize_t w=pwrite(k->file->fd,d,n,(off_t)(k->off+k->done));
+        if (w<0 && errno==EINTR) continue;
+        if (w<=0) { range_stop(c,cn,0); return; }
+        d+=w; n-=(size_t)w; k->done+=w;
+    }
+    if (k->done==k->len) range_stop(c,cn,1);
+}
+
+static void range_status(RangeChunk *ks, int nk, long long total, int active, long long t0) {
+    long long got=0, ms=mono_ms()-t0;
+    for (int i=0; i<nk; i++) got+=ks[i].done;
+    printf("\r  %s::%s %.1f / %.1f MB   %d connection%s   %.2f MB/s   ",C_CYN,C_RST,got/1048576.0,total/1048576.0,
+           active,active==1?"":"s",ms>0 ? got/1048576.0/(ms/1000.0) : 0.0);
+    fflush(stdout);
+}
+
+/* Fetch every file over c->connections connections. 1 if all arrived. */
+static int range_fetch(Config *c, RangeFile *files, int nf) {
+    RangeConn conns[MAX_CONNECTIONS];
+    RangeChunk *ks;
+    long long step[2], total=0, t0=mono_ms(), shown=0, t=trace_now();
+    int nk=0, nconn=c->connections, failed=0;
+
+    for (int i=0; i<nf; i++) {          /* small files still use every connection */
+        step[i]=(files[i].size+nconn-1)/nconn;
+        if (step[i]>RANGE_CHUNK) step[i]=RANGE_CHUNK;
+        if (step[i]<64*1024)     step[i]=64*1024;
+        nk+=(int)((files[i].size+step[i]-1)/step[i]);
+        total+=files[i].size;
+    }
+    ks=(RangeChunk*)calloc((size_t)nk+1,sizeof(RangeChunk));
+    if (!ks) return 0;
+    nk=0;
+    for (int i=0; i<nf; i++)
+        for (long long off=0; off<files[i].size; off+=step[i]) {
+            ks[nk].file=&files[i]; ks[nk].off=off;
+            ks[nk].len = files[i].size-off<step[i] ? files[i].size-off : step[i];
+            nk++;
+        }
+    for (int i=0; i<nconn; i++) { conns[i].chunk=NULL; conns[i].fd=-1; }
+    if (c->verbose) printf("%s[range]%s %d ranges over %d connections\n",C_DIM,C_RST,nk,nconn);
+
+    for (;;) {
+        struct pollfd pf[MAX_CONNECTIONS];
+        int active=0, next=0;
+        for (int i=0; i<nconn && !failed; i++) {
+            if (conns[i].chunk) continue;
+            while (next<nk && ks[next].state!=RG_QUEUED) next++;
+            if (next==nk) break;
+            if (range_start(c,&conns[i],&ks[next])!=0) { ks[next].state = ++ks[next].tries<=RANGE_RETRIES ? RG_QUEUED : RG_FAILED; i--; }
+            for (int k=0; k<nk; k++) failed |= ks[k].state==RG_FAILED;
+        }
+        for (int i=0; i<nconn; i++) {
+            pf[i].fd = conns[i].chunk ? conns[i].fd : -1;
+            pf[i].events = conns[i].connecting ? POLLOUT : POLLIN;
+            pf[i].revents=0;
+            active += conns[i].chunk!=NULL;
+        }
+        if (!active) break;
+        if (poll(pf,(nfds_t)nconn,250)<0 && errno!=EINTR) break;
+        for (int i=0; i<nconn; i++) {
+            RangeConn *cn=&conns[i];
+            if (!cn->chunk) continue;
+            if (!pf[i].revents) {
+                if (mono_ms()-cn->seen>=RANGE_STALL*1000LL) range_stop(c,cn,0);   /* stalled */
+                continue;
+            }
+            cn->seen=mono_ms();
+            if (cn->connecting) {
+                int err=0; socklen_t el=sizeof(err);
+                getsockopt(cn->fd,SOL_SOCKET,SO_ERROR,&err,&el);
+                cn->connecting=0;
+                RangeChunk *k=cn->chunk;
+                if (err || http_request(cn->fd,k->file,k->off+k->done,k->off+k->len-1)!=0) range_stop(c,cn,0);
+                continue;
+            }
+            char buf[65536];
+            ssize_t r=read(cn->fd,buf,sizeof(buf));
+            if (r<0 && (errno==EAGAIN || errno==EINTR)) continue;
+            if (r<=0) range_stop(c,cn,0);        /* closed before the range was complete */
+            else range_data(c,cn,buf,(size_t)r);
+        }
+        for (int k=0; k<nk; k++) failed |= ks[k].state==RG_FAILED;
+        if (failed) {
+            for (int i=0; i<nconn; i++) if (conns[i].chunk) range_stop(c,&conns[i],0);
+            break;
+        }
+        if (!c->quiet && !c->verbose && mono_ms()-shown>=250) { range_status(ks,nk,total,active,t0); shown=mono_ms(); }
+    }
+    int ok=!failed;
+    for (int k=0; k<nk; k++) ok &= ks[k].state==RG_DONE;
+    if (!c->quiet && !c->verbose) { range_status(ks,nk,total,0,t0); putchar('\n'); }
+    long long ms=mono_ms()-t0;
+    if (ok && !c->quiet)
+        ok_msg("Fetched %.1f MB in %.1fs — %.2f MB/s over %d connection%s",total/1048576.0,ms/1000.0,
+               ms>0 ? total/1048576.0/(ms/1000.0) : 0.0,nconn,nconn==1?"":"s");
+    trace_span("download",0,t);
+    free(ks);
+    return ok;
+}
+
+/* A title made safe as a file name. */
+static void title_file(const char *title, char *out, size_t n) {
+    size_t o=0;
+    for (const char *p=title; *p && o+1<n; p++)
+        out[o++] = ((unsigned char)*p<0x20 || strchr("/\\:*?\"<>|",*p)) ? '_' : *p;
+    out[o]='\0';
+    if (!o || out[0]=='.') snprintf(out,n,"video");
+}
+
+/* "mime=video%2Fwebm" → webm (audio/mp4 → m4a). */
+static const char *range_ext(const char *url) {
+    const char *m=strstr(url,"mime=");
+    if (!m) return "mp4";
+    m+=5;
+    int audio=!strncmp(m,"audio",5);
+    const char *sub=strstr(m,"%2F");
+    sub = sub ? sub+3 : strchr(m,'/') ? strchr(m,'/')+1 : "";
+    if (!strncmp(sub,"webm",4)) return "webm";
+    return audio ? "m4a" : "mp4";
+}
+
+/*
+ *  Download su's one or two URLs to base.<ext> (merging video and
+ *  audio). Returns 1 with the file's path in out, 0 if the caller should
+ *  let yt-dlp do it.
+ */
+static int range_download(Config *c, const StreamUrls *su, const char *base, char *out, size_t n) {
+    RangeFile files[2];
+    char part[2][1500], tool[1024];
+    int ok=0;
+    for (int i=0; i<su->n; i++) {
+        if (!range_url(&files[i],su->url[i])) return 0;
+        if (files[i].https && !path_lookup("curl",tool,sizeof(tool),NULL)) { warn_msg("--connections needs curl for https."); return 0; }
+    }
+    if (su->n>1 && !path_lookup("ffmpeg",tool,sizeof(tool),NULL)) { warn_msg("--connections needs ffmpeg to merge video and audio."); return 0; }
+    for (int i=0; i<su->n; i++)
+        if ((files[i].size=range_probe(c,&files[i]))<0) { warn_msg("No size or no range support for a stream URL."); return 0; }
+
+    for (int i=0; i<su->n; i++) {
+        snprintf(part[i],sizeof(part[i]),"%s.f%d.%s",base,i,range_ext(files[i].url));
+        files[i].fd=open(part[i],O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+        if (files[i].fd<0) { while (i--) { close(files[i].fd); remove(part[i]); } return 0; }
+        /* preallocating is best effort: pwrite() grows the file as needed */
+#ifdef __linux__
+        if (posix_fallocate(files[i].fd,0,(off_t)files[i].size)==0) continue;
+#endif
+        if (ftruncate(files[i].fd,(off_t)files[i].size)!=0 && c->verbose)
+            printf("%s[range]%s could not preallocate %s: %s\n",C_DIM,C_RST,part[i],strerror(errno));
+    }
+    ok=range_fetch(c,files,su->n);
+    for (int i=0; i<su->n; i++) close(files[i].fd);
+
+    if (ok && su->n==1) {
+        snprintf(out,n,"%s.%s",base,range_ext(files[0].url));
+        ok = rename(part[0],out)==0;
+    } else if (ok) {
+        const char *ve=range_ext(files[0].url), *ae=range_ext(files[1].url);
+        Argv a={0};
+        snprintf(out,n,"%s.%s",base,!strcmp(ve,"mp4") && !strcmp(ae,"m4a") ? "mp4" : "mkv");
+        argv_add(&a,"ffmpeg"); argv_add(&a,"-v"); argv_add(&a,"error"); argv_add(&a,"-nostdin"); argv_add(&a,"-y");
+        argv_add(&a,"-i"); argv_add(&a,part[0]); argv_add(&a,"-i"); argv_add(&a,part[1]);
+        argv_add(&a,"-map"); argv_add(&a,"0:v:0"); argv_add(&a,"-map"); argv_add(&a,"1:a:0");
+        argv_add(&a,"-c"); argv_add(&a,"copy"); argv_add(&a,out);
+        if (c->verbose) argv_show("ffmpeg",&a);
+        long long t=trace_now();
+        ok = proc_run(&a,PROC_STDIN_NULL,-1)==0 && file_size(out)>0;
+        trace_span("merge",0,t);
+        argv_free(&a);
+        if (!ok) warn_msg("ffmpeg could not merge video and audio.");
+    }
+    for (int i=0; i<su->n; i++) remove(part[i]);
+    return ok;
+}
+#endif
+
+/* ─── Play a video ───────────────────────────────────────────── */
+static void queue_ahead(Config *c);
+
+/* argv for the player: name, --player-args, then the rest. */
+static void player_argv(Config *c, Argv *a) {
+    argv_add(a,c->player);
+    argv_split(a,c->extra_player);
+}
+
+/*
+ *  Newest regular file in dir, leaving out yt-dlp's .part/.ytdl
+ *  leftovers: what it just wrote. Empty if none.
+ */
+static int partial_file(const char *name) {
+    const char *x=strrchr(name,'.');
+    return x && (!strcmp(x,".part") || !strcmp(x,".ytdl"));
+}
+
+static void newest_file(const char *dir, char *out, size_t n) {
+    out[0]='\0';
+#ifdef PLATFORM_WINDOWS
+    char pat[1100];
+    WIN32_FIND_DATAA fd;
+    FILETIME best={0,0};
+    snprintf(pat,sizeof(pat),"%s\\*",dir);
+    HANDLE h=FindFirstFileA(pat,&fd);
+    if (h==INVALID_HANDLE_VALUE) return;
+    do {
+        if (fd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY) continue;
+        if (partial_file(fd.cFileName)) continue;
+        if (CompareFileTime(&fd.ftLastWriteTime,&best)>0) {
+            best=fd.ftLastWriteTime;
+            snprintf(out,n,"%s\\%s",dir,fd.cFileName);
+        }
+    } while (FindNextFileA(h,&fd));
+    FindClose(h);
+#else
+    char path[2048];
+    struct stat st;
+    time_t best=0;
+    struct dirent *e;
+    DIR *d=opendir(dir);
+    if (!d) return;
+    while ((e=readdir(d))) {
+        if (e->d_name[0]=='.' || partial_file(e->d_name)) continue;
+        snprintf(path,sizeof(path),"%s/%s",dir,e->d_name);
+        if (stat(path,&st)!=0 || !S_ISREG(st.st_mode)) continue;
+        if (!out[0] || st.st_mtime>best) { best=st.st_mtime; snprintf(out,n,"%s",path); }
+    }
+    closedir(d);
+#endif
+}
+
+/*
+ *  Every download runs in a staging directory of its own,
+ *  <dir>/.ytplay-<pid>-<n>, and yt-dlp reports where it put the final
+ *  file (after merging) with --print-to-file after_move:filepath. The
+ *  file is known exactly without listing a shared directory, and
+ *  concurrent runs can't play or delete each other's downloads. What is
+ *  kept is moved up into <dir> afterwards; the rest goes with the
+ *  staging directory.
+ */
+typedef struct {
+    char dir[1100];
+    char report[1200];          /* yt-dlp's after_move:filepath output */
+} Stage;
+
+static int stage_open(Stage *s, const char *dir) {
+    static int seq;
+    MKDIR(dir);
+    for (int tries=0; tries<100; tries++) {
+        snprintf(s->dir,sizeof(s->dir),"%s" PATH_SEP ".ytplay-%ld-%d",dir,GETPID(),seq++);
+        if (MKDIR(s->dir)==0) {
+            snprintf(s->report,sizeof(s->report),"%s" PATH_SEP "filepath",s->dir);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* -o into the staging directory plus the path report. */
+static void stage_argv(const Stage *s, Argv *a, const char *name) {
+    argv_add(a,"-o"); argv_addf(a,"%s" PATH_SEP "%s.%%(ext)s",s->dir,name);
+    argv_add(a,"--print-to-file"); argv_add(a,"after_move:filepath"); argv_add(a,s->report);
+}
+
+/*
+ *  The downloaded file: the last path yt-dlp reported, if it is inside
+ *  the staging directory; else (a yt-dlp too old for --print-to-file)
+ *  the one file in there.
+ */
+static int stage_result(const Stage *s, char *out, size_t n) {
+    size_t len=0, dl=strlen(s->dir);
+    unsigned char *d=read_file(s->report,&len);
+    char *cur, *line, *last=NULL;
+    out[0]='\0';
+    if (d) {
+        char *nd=(char*)realloc(d,len+1);
+        if (nd) {
+            nd[len]='\0'; cur=nd;
+            while ((line=next_line(&cur))) if (*line) last=line;
+            if (last && !strncmp(last,s->dir,dl) && last[dl]==PATH_SEP[0] && file_size(last)>=0)
+                snprintf(out,n,"%s",last);
+            d=(unsigned char*)nd;
+        }
+        free(d);
+        remove(s->report);
+    }
+    if (!out[0]) newest_file(s->dir,out,n);
+    return out[0]!=0;
+}
+
+/* Move path out of the staging directory into dir; out gets the new path. */
+static int stage_keep(const char *path, const char *dir, char *out, size_t n) {
+    const char *f=strrchr(path,PATH_SEP[0]);
+    snprintf(out,n,"%s" PATH_SEP "%s",dir,f ? f+1 : path);
+    if (RENAME(path,out)==0) return 1;
+    snprintf(out,n,"%s",path);
+    return 0;
+}
+
+/* Delete the staging directory and whatever is left in it. */
+static void stage_close(const Stage *s) {
+    char path[1400];
+#ifdef PLATFORM_WINDOWS
+    WIN32_FIND_DATAA fd;
+    snprintf(path,sizeof(path),"%s\\*",s->dir);
+    HANDLE h=FindFirstFileA(path,&fd);
+    if (h!=INVALID_HANDLE_VALUE) {
+        do {
+            if (fd.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY) continue;
+            snprintf(path,sizeof(path),"%s\\%s",s->dir,fd.cFileName);
+            remove(path);
+        } while (FindNextFileA(h,&fd));
+        FindClose(h);
+    }
+#else
+    struct dirent *e;
+    DIR *d=opendir(s->dir);
+    if (d) {
+        while ((e=readdir(d))) {
+            if (!strcmp(e->d_name,".") || !strcmp(e->d_name,"..")) continue;
+            snprintf(path,sizeof(path),"%s/%s",s->dir,e->d_name);
+            remove(path);
+        }
+        closedir(d);
+    }
+#endif
+    RMDIR(s->dir);
+}
+
+#ifndef PLATFORM_WINDOWS
+/*
+ *  -P: play while downloading. yt-dlp writes the final file directly
+ *  (--no-part) in a single-file format (the quality's first muxed
+ *  alternative — separately downloaded streams are only merged at the
+ *  end, far too late) and reports progress on stdout. Once the buffer
+ *  watermark is on disk the player is started on the growing file; mpv
+ *  gets appending:// so it keeps reading past the current end. The file
+ *  is removed only after both the download and the player are done.
+ */
+static const char *dl_progress(const char *line, long long *done, long long *total) {
+    static char dest[2048];
+    const char *p;
+    if (!strncmp(line,"[ytplay] ",9)) {
+        long long t, est;
+        char tb[32], eb[32];
+        if (sscanf(line+9,"%lld %31s %31s",done,tb,eb)!=3) return NULL;
+        t=atoll(tb); est=atoll(eb);          /* "NA" → 0 */
+        *total = t>0 ? t : est;
+        return NULL;
+    }
+    if (!strncmp(line,"[download] Destination: ",24)) {
+        snprintf(dest,sizeof(dest),"%s",line+24);
+        return dest;
+    }
+    if (!strncmp(line,"[download] ",11) && (p=strstr(line," has already been downloaded"))) {
+        snprintf(dest,sizeof(dest),"%.*s",(int)(p-line-11),line+11);
+        return dest;
+    }
+    return NULL;
+}
+
+static int play_progressive(Config *c, VideoResult *r, const char *url, const char *dir, const char *key) {
+    char fmt[256], name[128]="%(title)s", path[2048]="";
+    Stage st;
+    long long done=0, total=0, mark=0;
+    long dur=r->duration;
+    int ret=0, dl_rc=-1, dl_alive=1, started=0, pl_alive=0;
+    Argv a={0};
+    Proc dl, pl;
+    LineReader lr;
+    struct sigaction ign, oint, oquit;
+
+    single_format(c->quality,fmt,sizeof(fmt));
+    if (key) store_name(r->id,key,name,sizeof(name));
+    if (!stage_open(&st,dir)) die("Cannot create a staging directory in %s",dir);
+    argv_add(&a,"yt-dlp"); argv_add(&a,"--no-warnings");
+    argv_add(&a,"--newline"); argv_add(&a,"--no-part");
+    argv_add(&a,"--progress-template");
+    argv_add(&a,"download:[ytplay] %(progress.downloaded_bytes)s %(progress.total_bytes)s %(progress.total_bytes_estimate)s");
+    argv_add(&a,"-f"); argv_add(&a,fmt);
+    stage_argv(&st,&a,name);
+    argv_split(&a,c->extra_ytdlp);
+    argv_add(&a,url);
+    if (c->verbose) { argv_show("yt-dlp",&a); putchar('\n'); }
+
+    long long t_dl=trace_now(), t_pl=0;
+    if (proc_spawn(&dl,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE)!=0) { stage_close(&st); die("Failed to launch yt-dlp."); }
+    argv_free(&a);
+    lr_init(&lr,dl.out,4096);
+
+    /* ^C reaches yt-dlp and the player; we stay to clean up */
+    memset(&ign,0,sizeof(ign)); ign.sa_handler=SIG_IGN;
+    sigaction(SIGINT,&ign,&oint); sigaction(SIGQUIT,&ign,&oquit);
+
+    while (dl_alive || pl_alive) {
+        if (dl_alive) {
+            char *line; size_t len;
+            lr_wait(&lr,200);
+            int more=lr_fill(&lr);
+            while ((line=lr_next(&lr,&len))) {
+                const char *d=dl_progress(line,&done,&total);
+                if (d) snprintf(path,sizeof(path),"%s",d);
+                else if (c->verbose && strncmp(line,"[ytplay] ",9)) printf("%s%s%s\n",C_DIM,line,C_RST);
+            }
+            if (!more) {
+                dl_rc=proc_wait(&dl,-1);
+                trace_span("download",1,t_dl);
+                proc_close(&dl); lr_free(&lr);
+                dl_alive=0;
+                queue_ahead(c);                         /* the line is free now */
+                if (!started && !c->quiet) printf("\r%60s\r","");
+                if (dl_rc!=0) {
+                    if (!started) { stage_close(&st); die("yt-dlp download failed."); }
+                    warn_msg("Download stopped early (yt-dlp exit %d).",dl_rc);
+                }
+            }
+        } else {
+            sleep_ms(200);
+        }
+
+        if (!started && path[0]) {
+            if (!mark) {
+                if (c->buffer_bytes) mark=c->buffer_bytes;
+                else if (total>0 && dur>0) mark=(long long)c->buffer_secs*(total/dur);
+                else if (total>0 || !dl_alive) mark=(long long)c->buffer_secs*FALLBACK_BPS;
+            }
+            if (!c->quiet && dl_alive && mark)
+                printf("\r  %s::%s buffering %.1f / %.1f MB ",C_CYN,C_RST,done/1048576.0,mark/1048576.0), fflush(stdout);
+            if (!dl_alive || (mark && done>=mark)) {
+                if (!c->quiet && dl_alive) printf("\r%60s\r","");
+                player_argv(c,&a);
+                if (!strcmp(c->player,"mpv") && dl_alive) argv_addf(&a,"appending://%s",path);
+                else argv_add(&a,path);
+                if (c->verbose) { argv_show("player",&a); putchar('\n'); }
+                if (dl_alive) info_msg("Opening with %s%s%s while the download continues...",C_BLD,c->player,C_RST);
+                else          info_msg("Opening with %s%s%s ...",C_BLD,c->player,C_RST);
+                t_pl=trace_now();
+                trace_mark("player.launch",0);
+                if (proc_spawn(&pl,&a,0)!=0) warn_msg("Failed to start %s.",c->player);
+                else pl_alive=1;
+                argv_free(&a);
+                started=1;
+            }
+        }
+        if (pl_alive && (ret=proc_wait(&pl,0))!=PROC_TIMEOUT) {
+            pl_alive=0;
+            trace_span("player",0,t_pl);
+            if (dl_alive && !c->keep) {                 /* nobody needs the rest */
+                proc_kill(&dl);
+                trace_span("download",1,t_dl);
+                proc_close(&dl); lr_free(&lr);
+                dl_alive=0;
+            } else if (dl_alive && !c->quiet) info_msg("Player closed, finishing the download...");
+        }
+        if (!dl_alive && !pl_alive && !started) break;
+    }
+    if (ret==PROC_TIMEOUT) ret=0;
+
+    sigaction(SIGINT,&oint,NULL); sigaction(SIGQUIT,&oquit,NULL);
+
+    if (!path[0]) { stage_close(&st); die("Could not find downloaded file in %s",dir); }
+    if (dl_rc==0 && (key || c->keep)) {
+        char kept[2048];
+        stage_keep(path,dir,kept,sizeof(kept));
+        if (key) store_put(c,r->id,key,kept);
+        lib_note(r,key ? key : c->quality,kept);
+        if (c->keep) ok_msg("Saved: %s%s%s",C_GRN,kept,C_RST);
+    } else if (c->keep) warn_msg("Download incomplete, not kept.");   /* staged file goes below */
+    else if (!c->quiet) info_msg("Removing temp file...");
+    stage_close(&st);
+    return ret;
+}
+
+/*
+ *  --pipe: stream mode for players without YouTube support. Instead of
+ *  handing them googlevideo URLs, yt-dlp writes the stream (merged into
+ *  Matroska by its ffmpeg when video and audio are separate) to stdout
+ *  and the player reads it on stdin. Both pipes are grown to PIPE_SIZE
+ *  so a couple of MB can sit between them, and on Linux splice() moves
+ *  the pages from one to the other without copying them through us;
+ *  elsewhere a read/write loop does the same. The status line shows how
+ *  full the pipes are and the rate yt-dlp delivers at. The player
+ *  closing stops yt-dlp; yt-dlp finishing closes the player's stdin.
+ */
+typedef struct {
+    int       src, dst;
+    long long moved;
+#ifndef __linux__
+    char      buf[64*1024];
+    size_t    off, len;
+#endif
+} Relay;
+
+/* Grow a pipe towards PIPE_SIZE; returns its capacity in bytes. */
+static long pipe_grow(int fd) {
+#ifdef F_SETPIPE_SZ
+    for (long sz=PIPE_SIZE; sz>=65536; sz/=2)       /* capped by pipe-max-size */
+        if (fcntl(fd,F_SETPIPE_SZ,(int)sz)>=0) break;
+    long got=fcntl(fd,F_GETPIPE_SZ);
+    if (got>0) return got;
+#else
+    (void)fd;
+#endif
+    return 65536;
+}
+
+static long pipe_queued(int fd) {
+    int n=0;
+    return fd>=0 && ioctl(fd,FIONREAD,&n)==0 ? n : 0;
+}
+
+/*
+ *  Move what is ready from src to dst. Returns bytes moved, 0 at the end
+ *  of the input, -1 with errno set; on EAGAIN *full tells whether dst is
+ *  the side that is stuck.
+ */
+static long relay_move(Relay *rl, int *full) {
+    long n;
+#ifdef __linux__
+    n=(long)splice(rl->src,NULL,rl->dst,NULL,PIPE_SIZE,SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+#else
+    if (!rl->len) {
+        n=(long)read(rl->src,rl->buf,sizeof(rl->buf));
+        if (n<=0) { *full=0; return n; }
+        rl->off=0; rl->len=(size_t)n;
+    }
+    n=(long)write(rl->dst,rl->buf+rl->off,rl->len);
+    if (n>0) { rl->off+=(size_t)n; rl->len-=(size_t)n; }
+#endif
+    if (n>0) rl->moved+=n;
+    else if (n<0 && errno==EAGAIN) {
+        struct pollfd pf={rl->dst,POLLOUT,0};
+        *full = poll(&pf,1,0)==0;
+    }
+    return n;
+}
+
+static int play_pipe(Config *c, VideoResult *r, const char *url) {
+    Argv a={0};
+    Proc dl, pl;
+    Relay rl;
+    struct sigaction sa, oint, oquit, opipe;
+    long cap;
+    long long t_dl, t_pl, last_ms, last_moved=0, now;
+    double rate=0;
+    int ret=0, full=0, eof=0;
+
+    argv_add(&a,"yt-dlp"); argv_add(&a,"--no-warnings");
+    argv_add(&a,"-q"); argv_add(&a,"--no-progress");
+    argv_add(&a,"-f"); argv_add(&a,c->quality);
+    argv_add(&a,"--merge-output-format"); argv_add(&a,"mkv");
+    argv_add(&a,"-o"); argv_add(&a,"-");
+    argv_split(&a,c->extra_ytdlp);
+    argv_add(&a,url);
+    if (c->verbose) { argv_show("yt-dlp",&a); putchar('\n'); }
+    t_dl=trace_now();
+    if (proc_spawn(&dl,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE)!=0) die("Failed to launch yt-dlp.");
+    argv_free(&a);
+
+    player_argv(c,&a);
+    if (!strcmp(c->player,"vlc")) argv_addf(&a,"--meta-title=%s",r->title);
+    argv_add(&a,!strcmp(c->player,"ffplay") ? "pipe:0" : "-");
+    if (c->verbose) { argv_show("player",&a); putchar('\n'); }
+    info_msg("Opening with %s%s%s, fed by yt-dlp ...",C_BLD,c->player,C_RST);
+    t_pl=trace_now();
+    trace_mark("player.launch",0);
+    if (proc_spawn(&pl,&a,PROC_STDIN_PIPE)!=0) {
+        argv_free(&a);
+        proc_kill(&dl); proc_close(&dl);
+        die("Failed to start %s.",c->player);
+    }
+    argv_free(&a);
+    queue_ahead(c);
+
+    memset(&rl,0,sizeof(rl));
+    rl.src=dl.out; rl.dst=pl.in;
+    cap=pipe_grow(rl.src)+pipe_grow(rl.dst);
+
+    /* ^C reaches yt-dlp and the player; we note it for a queue and clean up */
+    memset(&sa,0,sizeof(sa)); sa.sa_handler=on_fg_sig;
+    g_fg_sig=0;
+    sigaction(SIGINT,&sa,&oint); sigaction(SIGQUIT,&sa,&oquit);
+    sa.sa_handler=SIG_IGN;
+    sigaction(SIGPIPE,&sa,&opipe);                      /* a closed player is EPIPE */
+
+    last_ms=mono_ms();
+    for (;;) {
+        struct pollfd pf;
+        int np=0;
+        if (rl.dst>=0) {
+            pf.fd = full ? rl.dst : rl.src;
+            pf.events = full ? POLLOUT : POLLIN;
+            np=1;
+        }
+        if (poll(&pf,(nfds_t)np,250)>0 && (pf.revents&(pf.events|POLLHUP|POLLERR))) {
+            for (;;) {
+                long n=relay_move(&rl,&full);
+                if (n>0) { full=0; if (rl.moved==n) trace_mark("pipe.first_byte",1); continue; }
+                if (n<0 && errno==EINTR) continue;
+                if (n<0 && errno==EAGAIN) break;
+                if (n==0) eof=1;                        /* yt-dlp is done */
+                proc_close(&pl);                        /* EOF for the player, or it is gone */
+                rl.dst=-1; full=0;
+                break;
+            }
+        }
+
+        now=mono_ms();
+        if (now-last_ms>=500) {
+            rate=(rl.moved-last_moved)*1000.0/(double)(now-last_ms);
+            last_moved=rl.moved; last_ms=now;
+            if (!c->quiet && rl.dst>=0)
+                printf("\r  %s::%s pipe %.1f / %.1f MB  %.1f MB in  %.2f MB/s ",C_CYN,C_RST,
+                       (pipe_queued(rl.src)+pipe_queued(rl.dst))/1048576.0,cap/1048576.0,
+                       rl.moved/1048576.0,rate/1048576.0), fflush(stdout);
+        }
+        if ((ret=proc_wait(&pl,0))!=PROC_TIMEOUT) break;
+    }
+    if (!c->quiet) printf("\r%60s\r",""), fflush(stdout);
+    trace_span("player",0,t_pl);
+
+    if (proc_wait(&dl,eof ? 1000 : 0)==PROC_TIMEOUT) proc_kill(&dl);  /* nobody reads the rest */
+    else if (dl.status!=0 && !g_fg_sig) warn_msg("yt-dlp stopped early (exit %d).",dl.status);
+    trace_span("pipe",1,t_dl);
+    proc_close(&dl); proc_close(&pl);
+
+    sigaction(SIGINT,&oint,NULL); sigaction(SIGQUIT,&oquit,NULL); sigaction(SIGPIPE,&opipe,NULL);
+    if (c->verbose) printf("%s[pipe]%s %.1f MB relayed\n",C_DIM,C_RST,rl.moved/1048576.0);
+    return ret;
+}
+#endif
+
+static int play_video(Config *c, VideoResult *r) {
+    char url[128];
+    snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",r->id);
+
+    Argv a={0};
+    int ret;
+
+    hist_note(c,r);
+    if (c->local) {
+        /* Library: the file on disk, whatever the mode */
+        char path[2048];
+        if (!lib_path(r,path,sizeof(path))) die("%s is no longer on disk.",r->title);
+        if (!c->quiet) info_msg("Playing from the library: %s%s%s",C_BLD,r->title,C_RST);
+        player_argv(c,&a);
+        argv_add(&a,path);
+        if (c->verbose) { argv_show("player",&a); putchar('\n'); }
+        long long t=trace_now();
+        trace_mark("player.launch",0);
+        ret=proc_run(&a,PROC_FOREGROUND,-1);
+        trace_span("player",0,t);
+        argv_free(&a);
+        return ret;
+    }
+
+    if (c->stream) {
+        /* Stream mode */
+        if (!c->quiet)
+            info_msg("Streaming: %s%s%s",C_BLD,r->title,C_RST);
+
+#ifndef PLATFORM_WINDOWS
+        if (pipe_mode(c)) return play_pipe(c,r,url);
+#else
+        if (c->pipe && !player_is_native(c->player)) warn_msg("--pipe is not supported on Windows, passing stream URLs.");
+#endif
+
+        char fmt[256];
+        StreamUrls su;
+        int cached=0, have=0;
+        stream_format(c,fmt,sizeof(fmt));
+
+        /* mpv resolves the watch URL itself, unless cached URLs (--warm) are at hand */
+        if (player_is_native(c->player) && !queue_raw(c) && (c->no_cache || c->subtitle_lang[0] ||
+            !(cached=have=ucache_get(r->id,fmt,r->duration+UCACHE_MARGIN,&su)))) {
+            argv_add(&a,c->player);
+            argv_addf(&a,"--ytdl-format=%s",c->quality);
+            if (strlen(c->subtitle_lang)) argv_add(&a,"--sub-auto=all");
+            argv_split(&a,c->extra_player);
+            argv_add(&a,url);
+            if (c->verbose) { argv_show("player",&a); putchar('\n'); }
+            long long t=trace_now();
+            trace_mark("player.launch",0);
+            queue_ahead(c);
+            ret=proc_run(&a,PROC_FOREGROUND,-1);
+            trace_span("player",0,t);
+            argv_free(&a);
+            return ret;
+        }
+
+        /* raw URLs: prefetched, cached, or via yt-dlp -g */
+        const Prefetch *pre = have ? NULL : prefetch_take(c,(int)(r-g_results));
+        if (have) ucache_report(c,"hit");
+        else if (pre) {
+            su=pre->urls; cached=pre->cached; have=1;
+            if (c->verbose)
+                printf("%s[prefetch]%s stream URL %s\n",C_DIM,C_RST,cached?"from cache":"resolved in the background");
+        } else if (!c->no_cache && ucache_get(r->id,fmt,r->duration+UCACHE_MARGIN,&su)) {
+            cached=have=1;
+            ucache_report(c,"hit");
+        } else {
+            if (!c->no_cache) ucache_report(c,"miss");
+            cached=0;
+        }
+
+        ret=0;
+        for (int attempt=0; attempt<2; attempt++) {
+            if (!have) {
+                resolve_urls(c,url,fmt,&su);
+                if (!su.n) die("yt-dlp returned no stream URL.");
+                if (!c->no_cache) ucache_update(r->id,fmt,&su);
+            }
+
+            const char *af=player_audio_flag(c->player);
+            player_argv(c,&a);
+            if (player_is_native(c->player)) argv_addf(&a,"--force-media-title=%s",r->title);
+            argv_add(&a,su.url[0]);
+            if (su.n>1 && af) {
+                size_t fl=strlen(af);
+                if (af[fl-1]==' ') { argv_addf(&a,"%.*s",(int)(fl-1),af); argv_add(&a,su.url[1]); }
+                else argv_addf(&a,"%s%s",af,su.url[1]);
+            }
+            if (c->verbose) { argv_show("player",&a); putchar('\n'); }
+
+            time_t t0=time(NULL);
+            long long t=trace_now();
+            trace_mark("player.launch",0);
+            queue_ahead(c);
+            ret=proc_run(&a,PROC_FOREGROUND,-1);
+            trace_span("player",0,t);
+            argv_free(&a);
+            if (ret==0 || !cached || time(NULL)-t0>=PLAYER_FAIL_FAST) break;
+
+            /* a cached URL the player choked on right away: re-resolve once */
+            warn_msg("Cached stream URL failed, resolving again...");
+            ucache_update(r->id,fmt,NULL);
+            cached=have=0;
+        }
+        return ret;
+
+    } else {
+        /* Download mode: from the store if we have it, else yt-dlp */
+        char dir[1024], index[1100], key[1024], name[128], dl_path[2048];
+        int store=use_store(c) && store_paths(dir,sizeof(dir),index,sizeof(index)), have=0;
+        if (store) {
+            char sfmt[256], skey[1024];
+            store_key(c,c->quality,key,sizeof(key));
+            have=store_get(c,r->id,key,dl_path,sizeof(dl_path));
+            single_format(c->quality,sfmt,sizeof(sfmt));
+            store_key(c,sfmt,skey,sizeof(skey));
+            if (!have && c->progressive) have=store_get(c,r->id,skey,dl_path,sizeof(dl_path));
+            if (c->progressive) snprintf(key,sizeof(key),"%s",skey);
+            if (have && !c->quiet) info_msg("Already downloaded: %s%s%s",C_BLD,r->title,C_RST);
+        } else snprintf(dir,sizeof(dir),"%s",c->output_dir);
+
+        Stage st;
+        int staged=0;
+        if (!have) {
+            if (!c->quiet)
+                info_msg("Downloading: %s%s%s  →  %s",C_BLD,r->title,C_RST,dir);
+
+#ifndef PLATFORM_WINDOWS
+            if (c->progressive) return play_progressive(c,r,url,dir,store ? key : NULL);
+#else
+            if (c->progressive) warn_msg("--progressive is not supported on Windows, downloading first.");
+#endif
+            if (store) store_name(r->id,key,name,sizeof(name));
+            else       snprintf(name,sizeof(name),"%%(title)s");
+            if (!stage_open(&st,dir)) die("Cannot create a staging directory in %s",dir);
+            staged=1;
+
+            char got[2048]="";
+#ifndef PLATFORM_WINDOWS
+            if (c->connections) {
+                StreamUrls su;
+                char base[1400], title[200];
+                if (store) snprintf(title,sizeof(title),"%s",name);
+                else       title_file(r->title,title,sizeof(title));
+                snprintf(base,sizeof(base),"%s" PATH_SEP "%s",st.dir,title);
+                if (c->no_cache || !ucache_get(r->id,c->quality,r->duration+UCACHE_MARGIN,&su))
+                    if (resolve_urls(c,url,c->quality,&su) && !c->no_cache) ucache_update(r->id,c->quality,&su);
+                if (!su.n || !range_download(c,&su,base,got,sizeof(got))) {
+                    got[0]='\0';
+                    if (!c->quiet) info_msg("Downloading with yt-dlp instead.");
+                }
+            }
+#endif
+            if (!got[0]) {
+                argv_add(&a,"yt-dlp"); argv_add(&a,"--no-warnings");
+                argv_add(&a,"-f"); argv_add(&a,c->quality);
+                stage_argv(&st,&a,name);
+                argv_split(&a,c->extra_ytdlp);
+                argv_add(&a,url);
+
+                if (c->verbose) { argv_show("yt-dlp",&a); putchar('\n'); }
+
+                long long t=trace_now();
+                if (proc_run(&a,PROC_FOREGROUND,-1)!=0) { stage_close(&st); die("yt-dlp download failed."); }
+                trace_span("download",0,t);
+                argv_free(&a);
+
+                if (!stage_result(&st,got,sizeof(got))) { stage_close(&st); die("Could not find downloaded file in %s",st.dir); }
+            }
+            if (store || c->keep) {
+                stage_keep(got,dir,dl_path,sizeof(dl_path));
+                if (store) store_put(c,r->id,key,dl_path);
+                lib_note(r,store ? key : c->quality,dl_path);
+                stage_close(&st);
+                staged=0;
+            } else snprintf(dl_path,sizeof(dl_path),"%s",got);
+        }
+
+        if (c->keep) ok_msg("Saved: %s%s%s",C_GRN,dl_path,C_RST);
+
+        player_argv(c,&a);
+        argv_add(&a,dl_path);
+        if (c->verbose) { argv_show("player",&a); putchar('\n'); }
+
+        info_msg("Opening with %s%s%s ...",C_BLD,c->player,C_RST);
+        long long t=trace_now();
+        trace_mark("player.launch",0);
+        queue_ahead(c);
+        ret=proc_run(&a,PROC_FOREGROUND,-1);
+        trace_span("player",0,t);
+        argv_free(&a);
+
+        if (staged) { if(!c->quiet) info_msg("Removing temp file..."); stage_close(&st); }
+        return ret;
+    }
+}
+
+/* ─── Bulk download ────────────────────────────────────────── */
+/*
+ *  -b / --select: download several results in one run, up to --jobs at
+ *  a time. Each yt-dlp reports progress through --progress-template on
+ *  a pipe (stderr merged, so the last ERROR line can be shown); we draw
+ *  one aggregated status line instead of interleaved output, retry
+ *  failures up to --retries times and end with a per-item summary.
+ *  Windows runs the same queue one job at a time.
+ */
+enum { JOB_QUEUED, JOB_RUNNING, JOB_OK, JOB_FAILED };
+
+typedef struct {
+    int        idx;             /* into g_results */
+    int        state, tries;
+    Proc       proc;
+    LineReader lr;
+    long long  base, done;      /* bytes of finished formats + current one */
+    long long  t0, t1;
+    long long  ts;              /* current attempt, for tracing */
+    char       path[1024];
+    char       err[160];
+} BulkJob;
+
+/* "1,3,5-9" or "all" → 0-based indices into sel. Returns the count. */
+static int parse_selection(const char *spec, int n, int *sel) {
+    int cnt=0;
+    char *seen=(char*)calloc((size_t)n,1);
+    if (!seen) die("Out of memory");
+    while (isspace((unsigned char)*spec)) spec++;
+    if (!strncmp(spec,"all",3)) {
+        for (int i=0; i<n; i++) sel[cnt++]=i;
+        free(seen);
+        return cnt;
+    }
+    for (const char *p=spec; *p; ) {
+        char *end;
+        long a, b;
+        if (*p==',' || isspace((unsigned char)*p)) { p++; continue; }
+        a=b=strtol(p,&end,10);
+        if (end==p) die("Bad selection '%s' (e.g. 1,3,5-9 or all)",spec);
+        p=end;
+        if (*p=='-') { b=strtol(p+1,&end,10); if (end==p+1) die("Bad selection '%s'",spec); p=end; }
+        if (a<1 || b>n || a>b) die("Selection %ld-%ld is outside 1-%d",a,b,n);
+        for (long i=a; i<=b; i++) if (!seen[i-1]) { seen[i-1]=1; sel[cnt++]=(int)i-1; }
+    }
+    free(seen);
+    return cnt;
+}
+
+/* Search (or hit the cache) to completion and show the list. */
+static void search_all(Config *c) {
+    int n = (!c->no_cache && !c->refresh) ? scache_lookup(c) : 0;
+    if (n) {
+        if (g_nresults>c->num_results) g_nresults=c->num_results;   /* cached later pages */
+        if (!c->quiet) print_page(c,0);
+        return;
+    }
+
+    SearchStream ss;
+    search_youtube(c,&ss,0);
+    if (!c->quiet) print_results_header(c,0,c->num_results);
+    while (!ss.done) {
+        int before=g_nresults;
+        lr_wait(&ss.lr,-1);
+        search_pump(&ss);
+        if (!c->quiet) { for (int i=before; i<g_nresults; i++) print_result_row(i,0); fflush(stdout); }
+    }
+    search_finish(c,&ss);
+    if (!g_nresults) no_results(c);
+}
+
+static void bulk_start(Config *c, BulkJob *j) {
+    char url[128];
+    Argv a={0};
+    snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",g_results[j->idx].id);
+    argv_add(&a,"yt-dlp"); argv_add(&a,"--no-warnings"); argv_add(&a,"--newline");
+    argv_add(&a,"--progress-template");
+    argv_add(&a,"download:[ytplay] %(progress.downloaded_bytes)s %(progress.total_bytes)s %(progress.total_bytes_estimate)s");
+    argv_add(&a,"-f"); argv_add(&a,c->quality);
+    argv_add(&a,"-o"); argv_addf(&a,"%s" PATH_SEP "%%(title)s.%%(ext)s",c->output_dir);
+    argv_split(&a,c->extra_ytdlp);
+    argv_add(&a,url);
+    if (c->verbose) argv_show("yt-dlp",&a);
+
+    j->tries++;
+    j->base=j->done=0; j->err[0]='\0';
+    if (!j->t0) j->t0=mono_ms();
+    j->ts=trace_now();
+    if (proc_spawn(&j->proc,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_OUT)!=0) {
+        snprintf(j->err,sizeof(j->err),"could not start yt-dlp");
+        j->state=JOB_FAILED;
+    } else {
+        lr_init(&j->lr,j->proc.out,4096);
+        j->state=JOB_RUNNING;
+    }
+    argv_free(&a);
+}
+
+/* Read a job's output; on EOF reap it and requeue or settle it. */
+static void bulk_pump(Config *c, BulkJob *j) {
+    char *line; size_t len;
+    int more=lr_fill(&j->lr);
+    while ((line=lr_next(&j->lr,&len))) {
+        long long d;
+        const char *p;
+        if (!strncmp(line,"[ytplay] ",9)) {
+            if (sscanf(line+9,"%lld",&d)!=1) continue;
+            if (d<j->done) j->base+=j->done;      /* next format of a merge */
+            j->done=d;
+        } else if (!strncmp(line,"[download] Destination: ",24))
+            snprintf(j->path,sizeof(j->path),"%s",line+24);
+        else if (!strncmp(line,"[Merger] Merging formats into \"",31) && (p=strrchr(line,'"')) && p>line+31)
+            snprintf(j->path,sizeof(j->path),"%.*s",(int)(p-line-31),line+31);
+        else if (!strncmp(line,"ERROR: ",7))
+            snprintf(j->err,sizeof(j->err),"%s",line+7);
+    }
+    if (more) return;
+
+    int rc=proc_wait(&j->proc,-1);
+    proc_close(&j->proc); lr_free(&j->lr);
+    j->t1=mono_ms();
+    trace_span("download",1+j->idx,j->ts);
+    if (rc==0) {
+        j->state=JOB_OK;
+        if (j->path[0]) lib_note(&g_results[j->idx],c->quality,j->path);
+        return;
+    }
+    if (!j->err[0]) snprintf(j->err,sizeof(j->err),"yt-dlp exited with %d",rc);
+    j->state = j->tries<=c->retries ? JOB_QUEUED : JOB_FAILED;
+    if (c->verbose)
+        printf("\n%s[bulk]%s #%d attempt %d failed: %s\n",C_DIM,C_RST,j->idx+1,j->tries,j->err);
+}
+
+static void bulk_status(BulkJob *jobs, int n, long long t0) {
+    int ok=0, run=0, bad=0;
+    long long bytes=0, ms=mono_ms()-t0;
+    for (int i=0; i<n; i++) {
+        ok  += jobs[i].state==JOB_OK;
+        run += jobs[i].state==JOB_RUNNING;
+        bad += jobs[i].state==JOB_FAILED;
+        bytes += jobs[i].base+jobs[i].done;
+    }
+    printf("\r  %s::%s %d/%d done  %d running  %d failed   %.1f MB  %.2f MB/s   ",
+           C_CYN,C_RST, ok,n, run, bad, bytes/1048576.0, ms>0 ? bytes/1048576.0/(ms/1000.0) : 0.0);
+    fflush(stdout);
+}
+
+static void bulk_summary(BulkJob *jobs, int n, long long wall, const char *dir) {
+    long long total=0;
+    int ok=0;
+    printf("\n\n  %s%-4s %-44s %10s %8s %11s%s\n",C_BLD,"#","Title","Size","Time","Speed",C_RST);
+    for (int i=0; i<n; i++) {
+        BulkJob *j=&jobs[i];
+        long long b=j->base+j->done, ms=j->t1-j->t0;
+        char t[48]; strncpy(t,g_results[j->idx].title,43); t[43]='\0';
+        if (strlen(g_results[j->idx].title)>43) strcat(t,"…");
+        if (j->state==JOB_OK) {
+            ok++; total+=b;
+            printf("  %s%-4d%s %-44s %7.1f MB %7.1fs %6.2f MB/s\n",C_YLW,j->idx+1,C_RST,t,
+                   b/1048576.0, ms/1000.0, ms>0 ? b/1048576.0/(ms/1000.0) : 0.0);
+        } else {
+            printf("  %s%-4d%s %-44s %sfailed%s after %d attempt%s: %s\n",C_YLW,j->idx+1,C_RST,t,
+                   C_RED,C_RST, j->tries, j->tries==1?"":"s", j->err);
+        }
+    }
+    printf("  %s%-4s %-44s %7.1f MB %7.1fs %6.2f MB/s%s\n\n",C_BLD,"",
+           ok==n ? "all downloaded" : "total", total/1048576.0, wall/1000.0,
+           wall>0 ? total/1048576.0/(wall/1000.0) : 0.0, C_RST);
+    if (ok<n) warn_msg("%d of %d downloads failed.",n-ok,n);
+    if (ok) ok_msg("Saved %d file%s to %s%s%s",ok,ok==1?"":"s",C_GRN,dir,C_RST);
+}
+
+static int bulk_download(Config *c) {
+    if (!c->quiet)
+        info_msg("Searching YouTube for: %s%s%s ...",C_BLD,c->query,C_RST);
+    long long t=trace_now();
+    search_all(c);
+    trace_span("select",0,t);
+
+    if (!c->select[0]) {
+        printf("  %s▶%s  Numbers to download (1,3,5-9 / all, empty = quit): ",C_GRN,C_RST);
+        fflush(stdout);
+        if (!fgets(c->select,sizeof(c->select),stdin) || !strspn(c->select,"0123456789al")) {
+            printf("\n  %sGoodbye!%s\n\n",C_CYN,C_RST);
+            return 0;
+        }
+    }
+
+    int *sel=(int*)malloc((size_t)g_nresults*sizeof(int));
+    if (!sel) die("Out of memory");
+    int n=parse_selection(c->select,g_nresults,sel);
+    if (!n) die("Nothing selected.");
+    BulkJob *jobs=(BulkJob*)calloc((size_t)n,sizeof(BulkJob));
+    if (!jobs) die("Out of memory");
+    for (int i=0; i<n; i++) jobs[i].idx=sel[i];
+    free(sel);
+
+#ifdef PLATFORM_WINDOWS
+    int maxjobs=1;
+#else
+    int maxjobs=c->jobs;
+#endif
+    MKDIR(c->output_dir);
+    if (!c->quiet)
+        info_msg("Downloading %d video%s, %d at a time  →  %s",n,n==1?"":"s",maxjobs<n?maxjobs:n,c->output_dir);
+
+    long long t0=mono_ms(), shown=0;
+    for (;;) {
+        int running=0, pending=0;
+        for (int i=0; i<n; i++) running += jobs[i].state==JOB_RUNNING;
+        for (int i=0; i<n && running<maxjobs; i++)
+            if (jobs[i].state==JOB_QUEUED) { bulk_start(c,&jobs[i]); running += jobs[i].state==JOB_RUNNING; }
+        for (int i=0; i<n; i++) pending += jobs[i].state==JOB_QUEUED || jobs[i].state==JOB_RUNNING;
+        if (!pending) break;
+
+#ifdef PLATFORM_WINDOWS
+        for (int i=0; i<n; i++) if (jobs[i].state==JOB_RUNNING) bulk_pump(c,&jobs[i]);
+#else
+        struct pollfd *pf=(struct pollfd*)malloc((size_t)running*sizeof(*pf));
+        int *who=(int*)malloc((size_t)running*sizeof(int)), nfd=0;
+        if (!pf || !who) die("Out of memory");
+        for (int i=0; i<n; i++)
+            if (jobs[i].state==JOB_RUNNING) { pf[nfd].fd=jobs[i].lr.fd; pf[nfd].events=POLLIN; pf[nfd].revents=0; who[nfd++]=i; }
+        if (poll(pf,(nfds_t)nfd,250)<0 && errno!=EINTR) die("poll failed");
+        for (int i=0; i<nfd; i++) if (pf[i].revents) bulk_pump(c,&jobs[who[i]]);
+        free(pf); free(who);
+#endif
+        if (!c->quiet && !c->verbose && mono_ms()-shown>=250) { bulk_status(jobs,n,t0); shown=mono_ms(); }
+    }
+    if (!c->quiet && !c->verbose) bulk_status(jobs,n,t0);
+
+    int failed=0;
+    for (int i=0; i<n; i++) failed += jobs[i].state!=JOB_OK;
+    if (!c->quiet) bulk_summary(jobs,n,mono_ms()-t0,c->output_dir);
+    free(jobs);
+    return failed ? 1 : 0;
+}
+
+/* ─── Play queue ─────────────────────────────────────────────── */
+/*
+ *  Several picks at the prompt ("3,1,5-7"), or --queue FILE|- with one
+ *  video per line — an id, a watch URL or a --batch record — play one
+ *  after another. As item N's player starts, item N+1 is readied in
+ *  the background: its stream URLs resolved (mpv then gets raw URLs as
+ *  well), or with -d its download started into the store, so the next
+ *  item follows at once. Progressive downloads wait for the current
+ *  one to finish first. The queue and the item being played are kept
+ *  in queue.tsv in the cache directory until the last one ends:
+ *
+ *    <position>
+ *    <id> \t <duration> \t <views> \t <channel> \t <title>
+ *
+ *  ^C in the player stops the queue; --resume continues with that
+ *  item. Windows plays the queue without readying ahead.
+ */
+static int g_queue_next=-1;             /* g_results index queue_ahead() readies */
+
+#ifndef PLATFORM_WINDOWS
+static struct {
+    int       busy, idx;                /* a download ahead of g_results[idx] */
+    Proc      proc;
+    Stage     st;
+    char      dir[1024], key[1024];
+    long long t0;
+} g_qdl;
+#endif
+
+static int queue_path(char *out, size_t n) {
+    char dir[1024];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%squeue.tsv",dir,PATH_SEP);
+    return 1;
+}
+
+static void queue_field(FILE *f, const char *s) {
+    for (; *s; s++) fputc(*s=='\t' || *s=='\n' || *s=='\r' ? ' ' : *s,f);
+}
+
+static void queue_save(int pos) {
+    char path[1100], tmp[1200];
+    if (!queue_path(path,sizeof(path))) return;
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    FILE *f=fopen(tmp,"wb");
+    if (!f) return;
+    fprintf(f,"%d\n",pos);
+    for (int i=0; i<g_nresults; i++) {
+        const VideoResult *r=&g_results[i];
+        fprintf(f,"%s\t%ld\t%ld\t",r->id,r->duration,r->views);
+        queue_field(f,r->channel); fputc('\t',f);
+        queue_field(f,r->title);   fputc('\n',f);
+    }
+    if (fclose(f)!=0 || RENAME(tmp,path)!=0) remove(tmp);
+}
+
+/* The saved queue into g_results. Returns the position, -1 if there is none. */
+static int queue_load(void) {
+    char path[1100], *cur, *line;
+    size_t len;
+    int pos;
+    if (!queue_path(path,sizeof(path))) return -1;
+    char *d=(char*)read_file(path,&len);
+    if (!d) return -1;
+    cur=d;
+    line=next_line(&cur);
+    pos = line ? atoi(line) : -1;
+    results_reset();
+    while ((line=next_line(&cur))) {
+        char *f[5]; int nf=0;
+        for (char *p=line; nf<5; ) {
+            f[nf++]=p;
+            if (!(p=strchr(p,'\t'))) break;
+            *p++='\0';
+        }
+        if (nf<5 || !*f[0]) continue;
+        VideoResult *r=results_add();
+        r->id=intern(f[0],strlen(f[0]));
+        r->duration=atol(f[1]); r->views=atol(f[2]);
+        r->channel=intern(f[3],strlen(f[3]));
+        r->title=intern(f[4],strlen(f[4]));
+    }
+    free(d);
+    return pos>=0 && pos<g_nresults ? pos : -1;
+}
+
+static void queue_clear(void) {
+    char path[1100];
+    if (queue_path(path,sizeof(path))) remove(path);
+}
+
+/* "dQw4w9WgXcQ", ".../watch?v=dQw4w9WgXcQ&t=1", "youtu.be/dQw4w9WgXcQ" → the id. */
+static int queue_id(const char *s, char *out, size_t n) {
+    const char *p;
+    size_t len;
+    if ((p=strstr(s,"v=")) && (p==s || p[-1]=='?' || p[-1]=='&')) p+=2;
+    else if ((p=strstr(s,"youtu.be/"))) p+=9;
+    else if ((p=strstr(s,"/shorts/"))) p+=8;
+    else p=s;
+    for (len=0; isalnum((unsigned char)p[len]) || p[len]=='-' || p[len]=='_'; len++) {}
+    if (!len || len>=n || (p==s && p[len])) return 0;
+    snprintf(out,n,"%.*s",(int)len,p);
+    return 1;
+}
+
+/* --queue FILE|-: one video per line into g_results. */
+static void queue_read(Config *c) {
+    FILE *f = strcmp(c->queue,"-") ? fopen(c->queue,"rb") : stdin;
+    size_t len;
+    if (!f) die("Cannot read %s",c->queue);
+    char *in=(char*)read_all(f,&len), *line;
+    if (f!=stdin) fclose(f);
+    if (!in) die("Out of memory");
+    results_reset();
+    for (char *cur=in; (line=next_line(&cur)); ) {
+        char *e=line+strlen(line), id[64];
+        VideoResult r;
+        while (isspace((unsigned char)*line)) line++;
+        while (e>line && isspace((unsigned char)e[-1])) *--e='\0';
+        if (!*line) continue;
+        if (*line=='{') { if (parse_result(line,(size_t)(e-line),&r)) *results_add()=r; continue; }
+        if (!queue_id(line,id,sizeof(id))) { warn_msg("Not a video id or URL: %s",line); continue; }
+        r.id=r.title=intern(id,strlen(id));
+        r.channel=intern("Unknown",7);
+        r.duration=r.views=0;
+        *results_add()=r;
+    }
+    free(in);
+    if (!g_nresults) die("Nothing to play in %s",c->queue);
+}
+
+/* Reorder g_results to the picks in sel. */
+static void queue_set(const int *sel, int n) {
+    VideoResult *q=(VideoResult*)malloc((size_t)n*sizeof(VideoResult));
+    if (!q) die("Out of memory");
+    for (int i=0; i<n; i++) q[i]=g_results[sel[i]];
+    memcpy(g_results,q,(size_t)n*sizeof(VideoResult));
+    g_nresults=n;
+    free(q);
+}
+
+/* Called as a player starts: ready the next item once. */
+static void queue_ahead(Config *c) {
+#ifndef PLATFORM_WINDOWS
+    int i=g_queue_next;
+    char index[1100], name[128], url[128], path[2048];
+    VideoResult *r;
+    Argv a={0};
+    if (i<0 || i>=g_nresults) return;
+    g_queue_next=-1;
+    if (c->stream) { prefetch_schedule(c,i); return; }
+
+    r=&g_results[i];
+    if (!use_store(c) || !store_paths(g_qdl.dir,sizeof(g_qdl.dir),index,sizeof(index))) return;
+    store_key(c,c->quality,g_qdl.key,sizeof(g_qdl.key));
+    if (store_get(c,r->id,g_qdl.key,path,sizeof(path))) return;
+    if (!stage_open(&g_qdl.st,g_qdl.dir)) return;
+    store_name(r->id,g_qdl.key,name,sizeof(name));
+    snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",r->id);
+    argv_add(&a,"yt-dlp"); argv_add(&a,"--no-warnings");
+    argv_add(&a,"-f"); argv_add(&a,c->quality);
+    stage_argv(&g_qdl.st,&a,name);
+    argv_split(&a,c->extra_ytdlp);
+    argv_add(&a,url);
+    if (c->verbose) argv_show("queue",&a);
+    g_qdl.t0=trace_now();
+    if (proc_spawn(&g_qdl.proc,&a,PROC_STDIN_NULL|PROC_STDOUT_NULL|PROC_STDERR_NULL)!=0) stage_close(&g_qdl.st);
+    else { g_qdl.busy=1; g_qdl.idx=i; }
+    argv_free(&a);
+#else
+    (void)c;
+#endif
+}
+
+/* After an item: file the download readied ahead in the store (waiting for it), or drop it. */
+static void queue_settle(Config *c, int keep) {
+#ifndef PLATFORM_WINDOWS
+    char got[2048], kept[2048];
+    if (!g_qdl.busy) return;
+    VideoResult *r=&g_results[g_qdl.idx];
+    if (!keep) proc_kill(&g_qdl.proc);
+    else if (g_qdl.proc.alive && proc_wait(&g_qdl.proc,0)==PROC_TIMEOUT && !c->quiet)
+        info_msg("Waiting for the download of %s%s%s ...",C_BLD,r->title,C_RST);
+    int rc=proc_wait(&g_qdl.proc,-1);
+    proc_close(&g_qdl.proc);
+    trace_span("download.ahead",1,g_qdl.t0);
+    if (keep && rc==0 && stage_result(&g_qdl.st,got,sizeof(got))) {
+        stage_keep(got,g_qdl.dir,kept,sizeof(kept));
+        store_put(c,r->id,g_qdl.key,kept);
+        lib_note(r,g_qdl.key,kept);
+    }
+    stage_close(&g_qdl.st);
+    g_qdl.busy=0;
+#else
+    (void)c; (void)keep;
+#endif
+}
+
+/* Play g_results from pos on. */
+static int play_queue(Config *c, int pos) {
+    int ret=0;
+    g_queue=1;
+    if (c->prefetch>1) c->prefetch=1;       /* just the next item */
+#ifndef PLATFORM_WINDOWS
+    prefetch_drop();                        /* slots of the old order */
+#endif
+    for (int i=pos; i<g_nresults; i++) {
+        VideoResult *r=&g_results[i];
+        queue_save(i);
+        printf("\n");
+        ok_msg("Queue %d/%d: %s%s%s",i+1,g_nresults,C_BLD,r->title,C_RST);
+        g_queue_next = i+1<g_nresults ? i+1 : -1;
+        ret=play_video(c,r);
+#ifndef PLATFORM_WINDOWS
+        if (g_fg_sig) {
+            queue_settle(c,0);
+            prefetch_cancel(-1);
+            warn_msg("Queue stopped at %d/%d; ytplay --resume continues there.",i+1,g_nresults);
+            return ret;
+        }
+#endif
+        queue_settle(c,1);
+    }
+    queue_clear();
+    printf("\n  %s[ytplay]%s Queue done. 🎬\n\n",C_CYN,C_RST);
+    return ret;
+}
+
+/* After the prompt: a picked list becomes the queue. 0 if there is none. */
+static int queue_picked(void) {
+    if (!g_pick[0]) return 0;
+    int *sel=(int*)malloc((size_t)g_nresults*sizeof(int));
+    if (!sel) die("Out of memory");
+    int n=parse_selection(g_pick,g_nresults,sel);
+    if (n) queue_set(sel,n);            /* none valid: leave the results to the caller */
+    free(sel);
+    return n;
+}
+
+/* ─── Batch search ───────────────────────────────────────────── */
+/*
+ *  --batch FILE|-: one query per line (blank lines skipped), searched
+ *  --jobs at a time, and one NDJSON record per result on stdout:
+ *
+ *    {"query":"…","rank":1,"id":"…","title":"…","channel":"…","duration":212,"view_count":1234}
+ *
+ *  duration and view_count are the raw numbers (0 if unknown). Each
+ *  job collects its records in a buffer that is written out once every
+ *  query before it has been, so the output is in input order however
+ *  the searches finish. The search cache is used as usual; a record
+ *  reads back with parse_result(), which is how a finished job is
+ *  stored. No banner, no colour, no player needed. A query whose
+ *  yt-dlp fails is reported on stderr and makes the exit code 1.
+ */
+typedef struct {
+    const char *query;
+    int         state;          /* JOB_* */
+    Proc        proc;
+    LineReader  lr;
+    int         n;              /* records so far */
+    Buf         out;
+    long long   ts;
+} BatchJob;
+
+/* s as a JSON string literal. */
+static void buf_json(Buf *b, const char *s) {
+    const char *run=s;
+    buf_put(b,"\"",1);
+    for (; *s; s++) {
+        unsigned char ch=(unsigned char)*s;
+        char e[8];
+        if (ch>=0x20 && ch!='"' && ch!='\\') continue;
+        buf_put(b,run,(size_t)(s-run));
+        run=s+1;
+        if (ch=='"' || ch=='\\') { e[0]='\\'; e[1]=(char)ch; buf_put(b,e,2); }
+        else buf_put(b,e,(size_t)snprintf(e,sizeof(e),"\\u%04x",ch));
+    }
+    buf_put(b,run,(size_t)(s-run));
+    buf_put(b,"\"",1);
+}
+
+static void batch_record(BatchJob *j, const VideoResult *r) {
+    char num[96];
+    buf_put(&j->out,"{\"query\":",9);   buf_json(&j->out,j->query);
+    buf_put(&j->out,num,(size_t)snprintf(num,sizeof(num),",\"rank\":%d,\"id\":",++j->n));
+    buf_json(&j->out,r->id);
+    buf_put(&j->out,",\"title\":",9);   buf_json(&j->out,r->title);
+    buf_put(&j->out,",\"channel\":",11); buf_json(&j->out,r->channel);
+    buf_put(&j->out,num,(size_t)snprintf(num,sizeof(num),",\"duration\":%ld,\"view_count\":%ld}\n",r->duration,r->views));
+}
+
+/* Answer j from the search cache. 1 on a hit. */
+static int batch_cached(Config *c, BatchJob *j) {
+    if (c->no_cache || c->refresh) return 0;
+    snprintf(c->query,sizeof(c->query),"%s",j->query);
+    int n=scache_lookup(c);
+    if (n>c->num_results) n=c->num_results;     /* cached later pages */
+    for (int i=0; i<n; i++) batch_record(j,&g_results[i]);
+    results_reset();
+    return n>0;
+}
+
+static void batch_store(Config *c, BatchJob *j) {
+    if (c->no_cache || !j->n) return;
+    results_reset();
+    for (size_t at=0; at<j->out.len; ) {
+        const char *line=(const char*)j->out.p+at, *nl=(const char*)memchr(line,'\n',j->out.len-at);
+        size_t len = nl ? (size_t)(nl-line) : j->out.len-at;
+        VideoResult r;
+        if (parse_result(line,len,&r)) *results_add()=r;
+        at+=len+1;
+    }
+    snprintf(c->query,sizeof(c->query),"%s",j->query);
+    scache_store(c);
+    results_reset();
+}
+
+static void batch_start(Config *c, BatchJob *j) {
+    Argv a={0};
+    if (batch_cached(c,j)) { j->state=JOB_OK; return; }
+    search_argv(c,j->query,0,&a);
+    j->ts=trace_now();
+    if (proc_spawn(&j->proc,&a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL)!=0) {
+        warn_msg("Could not start yt-dlp for '%s'",j->query);
+        j->state=JOB_FAILED;
+    } else {
+        lr_init(&j->lr,j->proc.out,64*1024);
+        j->state=JOB_RUNNING;
+    }
+    argv_free(&a);
+}
+
+/* Read a search's output; on EOF reap it and settle the job. */
+static void batch_pump(Config *c, BatchJob *j, int lane) {
+    char *line; size_t len;
+    int more=lr_fill(&j->lr);
+    while ((line=lr_next(&j->lr,&len))) {
+        VideoResult r;
+        if (j->n<c->num_results && parse_result(line,len,&r)) batch_record(j,&r);
+    }
+    if (more) return;
+
+    int rc=proc_wait(&j->proc,-1);
+    proc_close(&j->proc); lr_free(&j->lr);
+    trace_span("search",lane,j->ts);
+    results_reset();                            /* the records hold copies */
+    if (rc==0 || j->n) { j->state=JOB_OK; batch_store(c,j); return; }
+    j->state=JOB_FAILED;
+    warn_msg("Search failed for '%s' (yt-dlp exited with %d)",j->query,rc);
+}
+
+static int batch_search(Config *c) {
+    FILE *f = strcmp(c->batch,"-") ? fopen(c->batch,"rb") : stdin;
+    size_t len;
+    if (!f) die("Cannot read %s",c->batch);
+    char *in=(char*)read_all(f,&len);
+    if (f!=stdin) fclose(f);
+    if (!in) die("Out of memory");
+
+    BatchJob *jobs=NULL;
+    int n=0, cap=0;
+    for (char *cur=in, *line; (line=next_line(&cur)); ) {
+        char *e=line+strlen(line);
+        while (isspace((unsigned char)*line)) line++;
+        while (e>line && isspace((unsigned char)e[-1])) *--e='\0';
+        if (!*line) continue;
+        if (n==cap) {
+            cap = cap ? cap*2 : 64;
+            BatchJob *nj=(BatchJob*)realloc(jobs,(size_t)cap*sizeof(BatchJob));
+            if (!nj) die("Out of memory");
+            jobs=nj;
+        }
+        memset(&jobs[n],0,sizeof(BatchJob));
+        jobs[n++].query=line;
+    }
+    if (!n) { free(in); return 0; }
+    if (!cmd_exists("yt-dlp")) die("yt-dlp not found. Is it installed and in PATH?");
 
-    for (int i=0; i<g_nresults; i++) {
-        VideoResult *r=&g_results[i];
-        char t[62]; strncpy(t,r->title,60); t[60]='\0';
-        if (strlen(r->title)>60) strcat(t,"…");
-        char ch[24]; strncpy(ch,r->channel,22); ch[22]='\0';
-        if (strlen(r->channel)>22) strcat(ch,"…");
-
-        printf("  %s[%2d]%s %s%s%s\n",      C_YLW,i+1,C_RST, C_BLD,t,C_RST);
-        printf("       %s%-24s%s ⏱ %s%-9s%s 👁 %s%s%s\n",
-               C_DIM,ch,C_RST, C_GRN,r->duration,C_RST, C_MAG,r->views,C_RST);
-        printf("\n");
+#ifdef PLATFORM_WINDOWS
+    int maxjobs=1;
+#else
+    int maxjobs=c->jobs;
+    struct pollfd *pf=(struct pollfd*)malloc((size_t)maxjobs*sizeof(*pf));
+    int *who=(int*)malloc((size_t)maxjobs*sizeof(int));
+    if (!pf || !who) die("Out of memory");
+#endif
+    int next=0, emit=0, failed=0;
+    for (;;) {
+        int running=0;
+        for (int i=emit; i<next; i++) running += jobs[i].state==JOB_RUNNING;
+        while (next<n && running<maxjobs) {
+            batch_start(c,&jobs[next]);
+            running += jobs[next++].state==JOB_RUNNING;
+        }
+        for (; emit<n && (jobs[emit].state==JOB_OK || jobs[emit].state==JOB_FAILED); emit++) {
+            BatchJob *j=&jobs[emit];
+            if (j->out.len) fwrite(j->out.p,1,j->out.len,stdout);
+            failed += j->state==JOB_FAILED;
+            free(j->out.p); j->out.p=NULL;
+        }
+        fflush(stdout);
+        if (emit==n) break;
+        if (!running) continue;
+
+#ifdef PLATFORM_WINDOWS
+        for (int i=emit; i<next; i++) if (jobs[i].state==JOB_RUNNING) batch_pump(c,&jobs[i],1+i);
+#else
+        int nfd=0;
+        for (int i=emit; i<next; i++)
+            if (jobs[i].state==JOB_RUNNING) { pf[nfd].fd=jobs[i].lr.fd; pf[nfd].events=POLLIN; pf[nfd].revents=0; who[nfd++]=i; }
+        if (poll(pf,(nfds_t)nfd,-1)<0 && errno!=EINTR) die("poll failed");
+        for (int i=0; i<nfd; i++) if (pf[i].revents) batch_pump(c,&jobs[who[i]],1+who[i]);
+#endif
     }
+#ifndef PLATFORM_WINDOWS
+    free(pf); free(who);
+#endif
+    free(jobs); free(in);
+    return failed ? 1 : 0;
 }
 
-/* ─── Interactive prompt ─────────────────────────────────────── */
-static int prompt_choice(void) {
-    char buf[32];
-    printf("  %s╔══════════════════════════════════════╗%s\n",C_CYN,C_RST);
-    printf("  %s║%s  Enter number to play  [0 = quit]    %s║%s\n",C_CYN,C_RST,C_CYN,C_RST);
-    printf("  %s╚══════════════════════════════════════╝%s\n",C_CYN,C_RST);
-    printf("  %s▶%s  ",C_GRN,C_RST); fflush(stdout);
-    if (!fgets(buf,sizeof(buf),stdin)) return 0;
-    return atoi(buf);
+/* ─── Warm-up ────────────────────────────────────────────────── */
+/*
+ *  --warm: one pass over the watch history that readies what is likely
+ *  to be played next, then exits — meant for a login script or a cron
+ *  job shortly before the usual session. Entries of the last
+ *  HIST_WINDOW count, each weighted by how recent it is (a week old
+ *  counts half). Candidates are
+ *
+ *    - videos played at least twice, in the mode and format last used;
+ *    - the top WARM_TOP hits of searches run at least twice. The
+ *      WARM_QUERIES heaviest are searched again first when their search
+ *      cache entry has expired. Their hits are readied the way that
+ *      search was last played from, else as the command line says.
+ *
+ *  The WARM_VIDEOS heaviest candidates are readied. A stream gets its
+ *  URLs resolved into the URL cache (kept if still good for WARM_FRESH).
+ *  A download is filed in the download store unless it is already
+ *  there. At most --warm-mb MB are downloaded per pass (yt-dlp
+ *  --max-filesize skips what no longer fits), at --warm-rate if given.
+ */
+typedef struct {
+    char   q[512], fmt[512];
+    double w;
+    int    n, stream;               /* stream: last play from it, -1 none */
+} WarmQuery;
+
+typedef struct {
+    char   id[64], title[256], fmt[512];
+    double w;
+    int    n, stream;
+} WarmVideo;
+
+static double warm_weight(long long at, long long now) {
+    const double week=7*24*60*60.0;
+    return week/(week+(double)(now>at ? now-at : 0));
 }
 
-/* ─── Play a video ───────────────────────────────────────────── */
-static int play_video(Config *c, VideoResult *r) {
-    char url[128];
-    snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",r->id);
+static int warm_cmp(const void *a, const void *b) {
+    double x=((const WarmVideo*)a)->w, y=((const WarmVideo*)b)->w;
+    return (x<y)-(x>y);
+}
 
-    char cmd[MAX_CMD];
+static int warmq_cmp(const void *a, const void *b) {
+    double x=((const WarmQuery*)a)->w, y=((const WarmQuery*)b)->w;
+    return (x<y)-(x>y);
+}
 
-    if (c->stream) {
-        /* Stream mode */
-        if (!c->quiet)
-            info_msg("Streaming: %s%s%s",C_BLD,r->title,C_RST);
+static WarmVideo *warm_video(WarmVideo **v, int *n, int *cap, const char *id) {
+    for (int i=0; i<*n; i++) if (!strcmp((*v)[i].id,id)) return &(*v)[i];
+    if (*n==*cap) {
+        *cap = *cap ? *cap*2 : 64;
+        if (!(*v=(WarmVideo*)realloc(*v,(size_t)*cap*sizeof(WarmVideo)))) die("Out of memory");
+    }
+    memset(&(*v)[*n],0,sizeof(WarmVideo));
+    snprintf((*v)[*n].id,sizeof((*v)[0].id),"%s",id);
+    return &(*v)[(*n)++];
+}
 
-        int native = (!strcmp(c->player,"mpv")||!strcmp(c->player,"iina"));
-        if (native) {
-            snprintf(cmd,sizeof(cmd),
-                     "%s --ytdl-format='%s'%s %s '%s'",
-                     c->player,
-                     c->quality,
-                     strlen(c->subtitle_lang)?" --sub-auto=all":"",
-                     c->extra_player,
-                     url);
-        } else {
-            /* get raw URL via yt-dlp -g */
-            char gcmd[MAX_CMD];
-            snprintf(gcmd,sizeof(gcmd),
-                     "yt-dlp --no-warnings -g -f '%s' '%s' 2>" DEVNULL,
-                     c->quality, url);
-            if (c->verbose)
-                printf("%s[yt-dlp -g]%s %s\n",C_DIM,C_RST,gcmd);
-            FILE *fp = POPEN(gcmd,"r");
-            if (!fp) die("Failed to get stream URL.");
-            char surl[4096]="";
-            if (!fgets(surl,sizeof(surl),fp)) die("yt-dlp returned no stream URL.");
-            trim_nl(surl);
-            PCLOSE(fp);
-            snprintf(cmd,sizeof(cmd),"%s %s '%s'",c->player,c->extra_player,surl);
+static WarmQuery *warm_query(WarmQuery **q, int *n, int *cap, const char *query) {
+    char key[512];
+    normalize_query(query,key,sizeof(key));
+    for (int i=0; i<*n; i++) if (!strcmp((*q)[i].q,key)) return &(*q)[i];
+    if (*n==*cap) {
+        *cap = *cap ? *cap*2 : 32;
+        if (!(*q=(WarmQuery*)realloc(*q,(size_t)*cap*sizeof(WarmQuery)))) die("Out of memory");
+    }
+    memset(&(*q)[*n],0,sizeof(WarmQuery));
+    snprintf((*q)[*n].q,sizeof((*q)[0].q),"%s",key);
+    (*q)[*n].stream=-1;
+    return &(*q)[(*n)++];
+}
+
+/* File v in the store; *left is the download budget in bytes. Returns 1 downloaded, 0 not, -1 already there. */
+static int warm_download(Config *c, const WarmVideo *v, long long *left) {
+    char dir[1024], index[1100], key[1024], fmt[512], name[128], url[128], path[2048], got[2048];
+    VideoResult r={v->title,v->id,"Unknown",0,0};
+    Config vc=*c;
+    Stage st;
+    Argv a={0};
+    int rc, ok=0;
+
+    vc.keep=0;
+    snprintf(vc.quality,sizeof(vc.quality),"%s",v->fmt);
+    if (c->progressive) single_format(v->fmt,fmt,sizeof(fmt));
+    else                snprintf(fmt,sizeof(fmt),"%s",v->fmt);
+    if (!store_paths(dir,sizeof(dir),index,sizeof(index))) return 0;
+    store_key(&vc,fmt,key,sizeof(key));
+    if (store_get(&vc,v->id,key,path,sizeof(path))) return -1;
+    if (*left<=0 || !stage_open(&st,dir)) return 0;
+    if (!c->quiet) info_msg("Downloading: %s%s%s",C_BLD,v->title,C_RST);
+
+    store_name(v->id,key,name,sizeof(name));
+    snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",v->id);
+    argv_add(&a,"yt-dlp"); argv_add(&a,"--no-warnings");
+    argv_add(&a,"-f"); argv_add(&a,fmt);
+    argv_add(&a,"--max-filesize"); argv_addf(&a,"%lld",*left);
+    if (c->warm_rate[0]) { argv_add(&a,"--limit-rate"); argv_add(&a,c->warm_rate); }
+    stage_argv(&st,&a,name);
+    argv_split(&a,c->extra_ytdlp);
+    argv_add(&a,url);
+    if (c->verbose) argv_show("warm",&a);
+    long long t=trace_now();
+    rc=proc_run(&a,PROC_STDIN_NULL|PROC_STDOUT_NULL|PROC_STDERR_NULL,-1);
+    trace_span("warm.download",0,t);
+    argv_free(&a);
+    if (rc==0 && stage_result(&st,got,sizeof(got))) {
+        long long size=file_size(got);
+        stage_keep(got,dir,path,sizeof(path));
+        store_put(&vc,v->id,key,path);
+        lib_note(&r,key,path);
+        *left-=size>0 ? size : 0;
+        ok=1;
+    } else if (rc!=0) warn_msg("Download of %s failed (yt-dlp exited with %d)",v->title,rc);
+    stage_close(&st);
+    return ok;
+}
+
+static int warm_up(Config *c) {
+    char path[1100], *d, *cur, *line;
+    size_t len;
+    long long now=(long long)time(NULL), left=(long long)c->warm_mb*1024*1024, t0=mono_ms();
+    WarmQuery *q=NULL;
+    WarmVideo *v=NULL;
+    int nq=0, qcap=0, nv=0, vcap=0, searched=0, resolved=0, fetched=0, ready=0, skipped=0;
+
+    if (!hist_file(path,sizeof(path)) || !(d=(char*)read_file(path,&len))) die("No watch history yet.");
+    for (cur=d; (line=next_line(&cur)); ) {
+        char *f[7]; int nf=0;
+        for (char *p=line; nf<7; ) {
+            f[nf++]=p;
+            if (!(p=strchr(p,'\t'))) break;
+            *p++='\0';
+        }
+        long long at=atoll(f[0]);
+        if (nf<7 || now-at>HIST_WINDOW) continue;
+        double w=warm_weight(at,now);
+        if (!strcmp(f[1],"S") && f[5][0]) {
+            WarmQuery *wq=warm_query(&q,&nq,&qcap,f[5]);
+            wq->n++; wq->w+=w;
+        } else if (!strcmp(f[1],"P") && strcmp(f[2],"library") && strcmp(f[4],"-")) {
+            int stream=!strcmp(f[2],"stream");
+            WarmVideo *wv=warm_video(&v,&nv,&vcap,f[4]);
+            wv->n++; wv->w+=w; wv->stream=stream;
+            snprintf(wv->fmt,sizeof(wv->fmt),"%s",f[3]);
+            snprintf(wv->title,sizeof(wv->title),"%s",f[6]);
+            if (f[5][0]) {
+                WarmQuery *wq=warm_query(&q,&nq,&qcap,f[5]);
+                wq->stream=stream;
+                snprintf(wq->fmt,sizeof(wq->fmt),"%s",f[3]);
+            }
         }
+    }
+    free(d);
+    for (int i=0; i<nv; i++) if (v[i].n<2) v[i].w=0;   /* played once: not a habit */
 
-        if (c->verbose)
-            printf("%s[player]%s %s\n\n",C_DIM,C_RST,cmd);
+    /* recurring searches: refresh the cache, take their top hits */
+    qsort(q,(size_t)nq,sizeof(WarmQuery),warmq_cmp);
+    for (int i=0, k=0; i<nq && k<WARM_QUERIES; i++) {
+        Config qc=*c;
+        int n=0;
+        if (q[i].n<2) continue;
+        k++;
+        snprintf(qc.query,sizeof(qc.query),"%s",q[i].q);
+        if (!c->no_cache && !c->refresh) n=scache_lookup(&qc);
+        if (!n) {
+            SearchStream ss;
+            if (!c->quiet) info_msg("Searching again: %s%s%s",C_BLD,q[i].q,C_RST);
+            search_youtube(&qc,&ss,0);
+            while (!ss.done) search_pump(&ss);
+            search_stop(&ss);
+            if (g_nresults && !c->no_cache) scache_store(&qc);
+            searched++;
+        }
+        for (int j=0; j<g_nresults && j<WARM_TOP; j++) {
+            WarmVideo *wv=warm_video(&v,&nv,&vcap,g_results[j].id);
+            wv->w+=q[i].w/(j+1);
+            if (wv->n) continue;                        /* a play of it says how */
+            wv->stream = q[i].stream>=0 ? q[i].stream : c->stream;
+            snprintf(wv->fmt,sizeof(wv->fmt),"%s",q[i].stream>=0 ? q[i].fmt : c->quality);
+            snprintf(wv->title,sizeof(wv->title),"%s",g_results[j].title);
+        }
+    }
 
-        return system(cmd);
+    qsort(v,(size_t)nv,sizeof(WarmVideo),warm_cmp);
+    for (int i=0; i<nv && i<WARM_VIDEOS && v[i].w>0; i++) {
+        if (v[i].stream) {
+            char url[128], fmt[512];
+            Config vc=*c;
+            StreamUrls su;
+            snprintf(vc.quality,sizeof(vc.quality),"%s",v[i].fmt);
+            stream_format(&vc,fmt,sizeof(fmt));
+            if (ucache_get(v[i].id,fmt,WARM_FRESH,&su)) { ready++; continue; }
+            snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",v[i].id);
+            long long t=trace_now();
+            if (resolve_urls(&vc,url,fmt,&su)) {
+                ucache_update(v[i].id,fmt,&su);
+                resolved++;
+                if (!c->quiet) info_msg("Stream ready: %s%s%s",C_BLD,v[i].title,C_RST);
+            }
+            trace_span("warm.resolve",0,t);
+        } else if (use_store(c)) {
+            int got=warm_download(c,&v[i],&left);
+            if (got>0) fetched++;
+            else if (got<0) ready++;
+            else skipped++;
+        } else skipped++;
+    }
+    free(q); free(v);
 
-    } else {
-        /* Download mode */
-        if (!c->quiet)
-            info_msg("Downloading: %s%s%s  →  %s",C_BLD,r->title,C_RST,c->output_dir);
+    if (!c->quiet)
+        ok_msg("Warm-up: %d search%s refreshed, %d stream%s resolved, %d download%s, %d already ready%s  (%.1fs)",
+               searched,searched==1?"":"es", resolved,resolved==1?"":"s", fetched,fetched==1?"":"s", ready,
+               skipped ? ", some skipped (budget or --no-store)" : "", (mono_ms()-t0)/1000.0);
+    return 0;
+}
 
-        MKDIR(c->output_dir);
+/* ─── Environment profile ────────────────────────────────────── */
+/*
+ *  <cachedir>/env.tsv remembers what startup probing found, so a warm
+ *  start spawns nothing before the search:
+ *
+ *    path    <FNV-1a of $PATH>
+ *    want    <player asked for with -p, empty for auto-detect>
+ *    ytdlp   <path>  <mtime>  <version>
+ *    player  <name>  <path>  <mtime>  <native ytdl 0/1>
+ *
+ *  It is trusted only while $PATH and the requested player are the same
+ *  and both binaries still have the recorded mtime; anything else (or
+ *  --refresh) re-probes and rewrites it.
+ */
+typedef struct {
+    char      ytdlp[1024];
+    long long ytdlp_mtime;
+    char      version[64];
+    char      player[64];
+    char      player_path[1024];
+    long long player_mtime;
+    int       native;
+    int       warm;
+} EnvProfile;
 
-        char dl_cmd[MAX_CMD];
-        snprintf(dl_cmd,sizeof(dl_cmd),
-                 "yt-dlp --no-warnings -f '%s' -o '%s" PATH_SEP "%%(title)s.%%(ext)s' %s '%s'",
-                 c->quality, c->output_dir,
-                 strlen(c->extra_ytdlp)?c->extra_ytdlp:"",
-                 url);
+static EnvProfile g_env;
 
-        if (c->verbose)
-            printf("%s[yt-dlp]%s %s\n\n",C_DIM,C_RST,dl_cmd);
+/* First line of a short-lived command's stdout, or "" on failure/timeout. */
+static void proc_capture(const Argv *a, char *out, size_t n, int timeout_ms) {
+    Proc p;
+    LineReader lr;
+    char *line; size_t len;
+    out[0]='\0';
+    if (proc_spawn(&p,a,PROC_STDIN_NULL|PROC_STDOUT_PIPE|PROC_STDERR_NULL)!=0) return;
+    lr_init(&lr,p.out,1024);
+    while (!out[0] && lr_wait(&lr,timeout_ms)) {
+        int more=lr_fill(&lr);
+        if ((line=lr_next(&lr,&len))) snprintf(out,n,"%.*s",(int)len,line);
+        if (!more) break;
+    }
+    lr_free(&lr);
+    proc_kill(&p);
+    proc_close(&p);
+}
 
-        if (system(dl_cmd)!=0) die("yt-dlp download failed.");
+static unsigned long long path_hash(void) {
+    const char *p=getenv("PATH");
+    unsigned long long h=1469598103934665603ULL;
+    for (; p && *p; p++) { h^=(unsigned char)*p; h*=1099511628211ULL; }
+    return h;
+}
 
-        /* find newest file */
-        char find_cmd[MAX_CMD], dl_path[2048]="";
-#ifdef PLATFORM_WINDOWS
-        snprintf(find_cmd,sizeof(find_cmd),"dir /b /o-d \"%s\" 2>NUL",c->output_dir);
-        FILE *dfp=POPEN(find_cmd,"r");
-        if (dfp) { char fn[1024]; if(fgets(fn,sizeof(fn),dfp)){trim_nl(fn);snprintf(dl_path,sizeof(dl_path),"%s\\%s",c->output_dir,fn);} PCLOSE(dfp); }
-#else
-        snprintf(find_cmd,sizeof(find_cmd),"ls -t '%s' 2>/dev/null | head -1",c->output_dir);
-        FILE *dfp=POPEN(find_cmd,"r");
-        if (dfp) { char fn[1024]; if(fgets(fn,sizeof(fn),dfp)){trim_nl(fn);snprintf(dl_path,sizeof(dl_path),"%s/%s",c->output_dir,fn);} PCLOSE(dfp); }
+static int env_path(char *out, size_t n) {
+    char dir[900];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%senv.tsv",dir,PATH_SEP);
+    return 1;
+}
+
+static int env_load(const char *want, EnvProfile *e) {
+    char path[1100], hash[32], *cur, *line;
+    size_t len=0;
+    int have=0;
+    unsigned char *d;
+    if (!env_path(path,sizeof(path)) || !(d=read_file(path,&len))) return 0;
+    char *nd=(char*)realloc(d,len+1);
+    if (!nd) { free(d); return 0; }
+    nd[len]='\0'; cur=nd;
+    memset(e,0,sizeof(*e));
+    snprintf(hash,sizeof(hash),"%llx",path_hash());
+    while ((line=next_line(&cur))) {
+        char *f[5]; int nf=0;
+        for (char *t=line; nf<5; ) {
+            f[nf++]=t;
+            if (!(t=strchr(t,'\t'))) break;
+            *t++='\0';
+        }
+        if      (!strcmp(f[0],"path"))   have |= (nf==2 && !strcmp(f[1],hash)) ? 1 : 0;
+        else if (!strcmp(f[0],"want"))   have |= (nf==2 && !strcmp(f[1],want)) ? 2 : 0;
+        else if (!strcmp(f[0],"ytdlp") && nf==4) {
+            snprintf(e->ytdlp,sizeof(e->ytdlp),"%s",f[1]);
+            e->ytdlp_mtime=atoll(f[2]);
+            snprintf(e->version,sizeof(e->version),"%s",f[3]);
+            have|=4;
+        } else if (!strcmp(f[0],"player") && nf==5) {
+            snprintf(e->player,sizeof(e->player),"%s",f[1]);
+            snprintf(e->player_path,sizeof(e->player_path),"%s",f[2]);
+            e->player_mtime=atoll(f[3]);
+            e->native=atoi(f[4]);
+            have|=8;
+        }
+    }
+    free(nd);
+    if (have!=15) return 0;
+
+    long long m;
+    if (!is_exec(e->ytdlp,&m)       || m!=e->ytdlp_mtime)  return 0;
+    if (!is_exec(e->player_path,&m) || m!=e->player_mtime) return 0;
+    return 1;
+}
+
+static void env_store(const char *want, const EnvProfile *e) {
+    char path[1100], tmp[1200];
+    if (!env_path(path,sizeof(path))) return;
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    FILE *f=fopen(tmp,"wb");
+    if (!f) return;
+    fprintf(f,"path\t%llx\nwant\t%s\n",path_hash(),want);
+    fprintf(f,"ytdlp\t%s\t%lld\t%s\n",e->ytdlp,e->ytdlp_mtime,e->version);
+    fprintf(f,"player\t%s\t%s\t%lld\t%d\n",e->player,e->player_path,e->player_mtime,e->native);
+    if (fclose(f)!=0 || RENAME(tmp,path)!=0) remove(tmp);
+}
+
+/* ─── Adaptive quality ───────────────────────────────────────── */
+/*
+ *  --auto-quality picks the preset the link can sustain instead of a
+ *  fixed one. The ceiling is the height in -q / the preset given (1080p
+ *  by default). A network's throughput is remembered in bandwidth.tsv
+ *  in the cache directory for AUTO_TTL seconds, so later runs decide
+ *  before the search:
+ *
+ *    <network> \t <bytes/s> \t <measured at>
+ *
+ *  The network is the local address of the default route. Without a
+ *  fresh entry the chosen video is resolved at the ceiling and up to
+ *  AUTO_SAMPLE bytes of its first stream are fetched with curl, timed
+ *  from the first byte and cut off after AUTO_TIME seconds. The highest
+ *  preset whose bitrate times AUTO_HEADROOM fits wins. The bitrates are
+ *  typical YouTube ones, scaled by what the measured video really needs
+ *  when its URLs carry clen= and dur=. -v prints the decision and
+ *  --timings shows the measurement and an auto.<height> mark.
+ */
+static const struct { int height; double mbps; const char *mark; } g_auto[] = {
+    { 2160, 20.0, "auto.2160p" }, { 1440, 10.0, "auto.1440p" }, { 1080, 5.0, "auto.1080p" },
+    {  720,  2.5, "auto.720p"  }, {  480,  1.2, "auto.480p"  }, {  360,  0.7, "auto.360p"  },
+};
+#define N_AUTO ((int)(sizeof(g_auto)/sizeof(g_auto[0])))
+
+static int auto_path(char *out, size_t n) {
+    char dir[1024];
+    if (!get_cachedir(dir,sizeof(dir))) return 0;
+    snprintf(out,n,"%s%sbandwidth.tsv",dir,PATH_SEP);
+    return 1;
+}
+
+/* Which network we are on: the address outgoing traffic leaves from. */
+static void auto_network(char *out, size_t n) {
+    snprintf(out,n,"default");
+#ifndef PLATFORM_WINDOWS
+    struct addrinfo hints, *ai;
+    struct sockaddr_storage ss;
+    socklen_t sl=sizeof(ss);
+    char host[128];
+    memset(&hints,0,sizeof(hints));
+    hints.ai_socktype=SOCK_DGRAM; hints.ai_flags=AI_NUMERICHOST;
+    if (getaddrinfo("8.8.8.8","53",&hints,&ai)!=0) return;
+    int fd=socket(ai->ai_family,SOCK_DGRAM,0);
+    if (fd>=0 && connect(fd,ai->ai_addr,ai->ai_addrlen)==0 &&           /* UDP: nothing is sent */
+        getsockname(fd,(struct sockaddr*)&ss,&sl)==0 &&
+        getnameinfo((struct sockaddr*)&ss,sl,host,sizeof(host),NULL,0,NI_NUMERICHOST)==0)
+        snprintf(out,n,"%s",host);
+    if (fd>=0) close(fd);
+    freeaddrinfo(ai);
 #endif
-        if (!dl_path[0]) die("Could not find downloaded file in %s",c->output_dir);
+}
+
+/* Remembered bytes/s for net, 0 if unknown or older than AUTO_TTL. */
+static double auto_load(const char *net, long long *at) {
+    char path[1100], *cur, *line;
+    size_t len;
+    double bps=0;
+    if (!auto_path(path,sizeof(path))) return 0;
+    char *d=(char*)read_file(path,&len);
+    for (cur=d; d && (line=next_line(&cur)); ) {
+        char *t=strchr(line,'\t');
+        if (!t || (size_t)(t-line)!=strlen(net) || strncmp(line,net,(size_t)(t-line))) continue;
+        char *end;
+        double v=strtod(t+1,&end);
+        *at=atoll(end);
+        if ((long long)time(NULL)-*at<AUTO_TTL) bps=v;
+    }
+    free(d);
+    return bps;
+}
 
-        ok_msg("Saved: %s%s%s",C_GRN,dl_path,C_RST);
+static void auto_save(const char *net, double bps) {
+    char path[1100], tmp[1200], *cur, *line;
+    size_t len;
+    if (!auto_path(path,sizeof(path))) return;
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    char *d=(char*)read_file(path,&len);
+    FILE *f=fopen(tmp,"wb");
+    if (!f) { free(d); return; }
+    for (cur=d; d && (line=next_line(&cur)); ) {
+        char *t=strchr(line,'\t');
+        if (t && (size_t)(t-line)==strlen(net) && !strncmp(line,net,(size_t)(t-line))) continue;
+        if (*line) fprintf(f,"%s\n",line);
+    }
+    fprintf(f,"%s\t%.0f\t%lld\n",net,bps,(long long)time(NULL));
+    free(d);
+    if (fclose(f)!=0 || RENAME(tmp,path)!=0) remove(tmp);
+}
 
-        snprintf(cmd,sizeof(cmd),"%s %s '%s'",c->player,c->extra_player,dl_path);
-        if (c->verbose) printf("%s[player]%s %s\n\n",C_DIM,C_RST,cmd);
+/* Height cap of the format asked for: "…[height<=720]…" → 720. */
+static int auto_ceiling(const char *q) {
+    const char *h=strstr(q,"height<=");
+    return h ? atoi(h+8) : 1080;
+}
 
-        info_msg("Opening with %s%s%s ...",C_BLD,c->player,C_RST);
-        int ret=system(cmd);
+static void auto_format(int height, char *out, size_t n) {
+    snprintf(out,n,"bestvideo[height<=%d]+bestaudio/best[height<=%d]",height,height);
+}
 
-        if (!c->keep) { if(!c->quiet) info_msg("Removing temp file..."); remove(dl_path); }
-        return ret;
+/* Set c->quality for bps: the highest preset up to ceiling that fits. */
+static void auto_pick(Config *c, int ceiling, double bps, double scale, const char *how) {
+    int pick=N_AUTO-1;
+    for (int i=0; i<N_AUTO; i++)
+        if (g_auto[i].height<=ceiling && g_auto[i].mbps*scale*AUTO_HEADROOM*1e6/8<=bps) { pick=i; break; }
+    auto_format(g_auto[pick].height,c->quality,sizeof(c->quality));
+    trace_mark(g_auto[pick].mark,0);
+    if (c->verbose)
+        printf("%s[auto]%s %.1f Mbit/s %s → %dp (needs %.1f Mbit/s with headroom, ceiling %dp)\n\n",C_DIM,C_RST,
+               bps*8/1e6,how,g_auto[pick].height,g_auto[pick].mbps*scale*AUTO_HEADROOM,ceiling);
+    else if (!c->quiet)
+        info_msg("Auto quality: %s%dp%s for %.1f Mbit/s",C_BLD,g_auto[pick].height,C_RST,bps*8/1e6);
+}
+
+static long long url_param(const char *u, const char *key) {
+    const char *p=strstr(u,key);
+    return p && (p[-1]=='?' || p[-1]=='&') ? atoll(p+strlen(key)) : 0;
+}
+
+/*
+ *  Decide c->quality for --auto-quality. Without r only a remembered
+ *  measurement is used; returns 0 if there was none, so the caller asks
+ *  again once a video is chosen. With r the link is measured on it.
+ */
+static int auto_quality(Config *c, VideoResult *r) {
+    char net[128], fmt[256], url[128], out[256], tool[1024];
+    int ceiling=auto_ceiling(c->quality);
+    long long at=0;
+    StreamUrls su;
+    if (!c->auto_quality || c->audio_only || !strcmp(c->quality,"worst")) return 1;
+    auto_network(net,sizeof(net));
+    double bps = c->refresh ? 0 : auto_load(net,&at);
+    if (bps>0) {
+        char how[192];
+        snprintf(how,sizeof(how),"on %s, measured %lld min ago",net,((long long)time(NULL)-at)/60);
+        auto_pick(c,ceiling,bps,1.0,how);
+        return 1;
+    }
+    if (!r) return 0;
+
+    if (!path_lookup("curl",tool,sizeof(tool),NULL)) { warn_msg("--auto-quality needs curl to measure the link."); return 1; }
+    if (!c->quiet) info_msg("Measuring the link on %s%s%s ...",C_BLD,r->title,C_RST);
+    auto_format(ceiling,c->quality,sizeof(c->quality));
+    if (c->stream) stream_format(c,fmt,sizeof(fmt));
+    else           snprintf(fmt,sizeof(fmt),"%s",c->quality);
+    snprintf(url,sizeof(url),"https://www.youtube.com/watch?v=%s",r->id);
+    if (c->no_cache || !ucache_get(r->id,fmt,r->duration+UCACHE_MARGIN,&su))
+        if (resolve_urls(c,url,fmt,&su) && !c->no_cache) ucache_update(r->id,fmt,&su);
+    if (!su.n) { warn_msg("Could not resolve %s to measure the link.",r->id); return 1; }
+
+    Argv a={0};
+    argv_add(&a,"curl"); argv_add(&a,"-sS"); argv_add(&a,"-f"); argv_add(&a,"-L");
+    argv_add(&a,"-r"); argv_addf(&a,"0-%d",AUTO_SAMPLE-1);
+    argv_add(&a,"--max-time"); argv_addf(&a,"%d",AUTO_TIME);
+    argv_add(&a,"-o"); argv_add(&a,DEVNULL);
+    argv_add(&a,"-w"); argv_add(&a,"%{size_download} %{time_starttransfer} %{time_total}\\n");
+    argv_add(&a,su.url[0]);
+    if (c->verbose) argv_show("auto",&a);
+    long long t=trace_now();
+    proc_capture(&a,out,sizeof(out),(AUTO_TIME+10)*1000);
+    trace_span("auto.measure",0,t);
+    argv_free(&a);
+
+    double size=0, ttfb=0, total=0;
+    if (sscanf(out,"%lf %lf %lf",&size,&ttfb,&total)!=3 || size<=0) {
+        warn_msg("Could not measure the link, keeping %dp.",ceiling);
+        return 1;
     }
+    bps = size/(total-ttfb>0.001 ? total-ttfb : 0.001);
+    auto_save(net,bps);
+
+    /* what this video needs at the ceiling, against the table */
+    double scale=1.0, secs=0;
+    const char *d=strstr(su.url[0],"dur=");
+    if (d && (d[-1]=='?' || d[-1]=='&')) secs=atof(d+4);
+    long long bytes=url_param(su.url[0],"clen=") + (su.n>1 ? url_param(su.url[1],"clen=") : 0);
+    if (secs>0 && bytes>0)
+        for (int i=0; i<N_AUTO; i++)
+            if (g_auto[i].height<=ceiling) { scale=bytes*8/secs/1e6/g_auto[i].mbps; break; }
+    if (scale<0.25) scale=0.25;
+    if (scale>4)    scale=4;
+    char how[192];
+    snprintf(how,sizeof(how),"measured on %s (%.0f KB)",net,size/1024);
+    auto_pick(c,ceiling,bps,scale,how);
+#ifndef PLATFORM_WINDOWS
+    prefetch_drop();                        /* resolved for the old format */
+#endif
+    return 1;
 }
 
 /* ─── Dependency check ───────────────────────────────────────── */
+/*
+ *  Find yt-dlp and the player. A valid profile answers this without
+ *  touching anything but a few stat()s; otherwise probe $PATH,
+ *  ask yt-dlp for its version once and remember the result.
+ */
 static void check_deps(Config *c) {
-    if (!cmd_exists("yt-dlp"))
-        die("yt-dlp not found.\n"
-            "  Linux/macOS : pip install yt-dlp   or   brew install yt-dlp\n"
-            "  Windows     : winget install yt-dlp\n"
-            "  Docs        : https://github.com/yt-dlp/yt-dlp");
-    if (!cmd_exists(c->player)) {
-        warn_msg("Player '%s' not found, auto-detecting...",c->player);
-        detect_player(c->player,sizeof(c->player));
-        if (!cmd_exists(c->player))
-            die("No supported player found. Install mpv, vlc, or ffplay.");
-        warn_msg("Using '%s'.",c->player);
+    char want[sizeof(c->player)];
+    EnvProfile *e=&g_env;
+    snprintf(want,sizeof(want),"%s",c->player);
+
+    if (c->local) {                     /* the library needs no yt-dlp */
+        if (!c->player[0] || !cmd_exists(c->player)) detect_player(c->player,sizeof(c->player));
+        if (!cmd_exists(c->player)) die("No supported player found. Install mpv, vlc, or ffplay.");
+        return;
+    }
+
+    if (!c->refresh && env_load(want,e)) {
+        e->warm=1;
+        strncpy(c->player,e->player,sizeof(c->player)-1); c->player[sizeof(c->player)-1]='\0';
+    } else {
+        memset(e,0,sizeof(*e));
+        if (!path_lookup("yt-dlp",e->ytdlp,sizeof(e->ytdlp),&e->ytdlp_mtime))
+            die("yt-dlp not found.\n"
+                "  Linux/macOS : pip install yt-dlp   or   brew install yt-dlp\n"
+                "  Windows     : winget install yt-dlp\n"
+                "  Docs        : https://github.com/yt-dlp/yt-dlp");
+        if (!c->player[0]) detect_player(c->player,sizeof(c->player));
+        if (!cmd_exists(c->player)) {
+            warn_msg("Player '%s' not found, auto-detecting...",c->player);
+            detect_player(c->player,sizeof(c->player));
+            if (!cmd_exists(c->player))
+                die("No supported player found. Install mpv, vlc, or ffplay.");
+            warn_msg("Using '%s'.",c->player);
+        }
+        path_lookup(c->player,e->player_path,sizeof(e->player_path),&e->player_mtime);
+        snprintf(e->player,sizeof(e->player),"%s",c->player);
+        e->native=player_is_native(c->player);
+
+        Argv a={0};
+        argv_add(&a,e->ytdlp); argv_add(&a,"--version");
+        proc_capture(&a,e->version,sizeof(e->version),10000);
+        argv_free(&a);
+        if (!e->version[0]) snprintf(e->version,sizeof(e->version),"unknown");
+        env_store(want,e);
+    }
+    if (c->verbose)
+        printf("%s[env]%s %s profile: yt-dlp %s (%s), %s (%s%s)\n\n",
+               C_DIM,C_RST, e->warm?"cached":"new", e->version, e->ytdlp,
+               e->player, e->player_path, e->native?", native ytdl":"");
+}
+
+/* ─── Extractor daemon ───────────────────────────────────────── */
+/*
+ *  Most of a yt-dlp run is Python starting up and importing its
+ *  extractors. `ytplay --daemon` keeps DAEMON_WARM interpreters that
+ *  have already imported yt_dlp parked on a socketpair; every other
+ *  ytplay on the box sends its yt-dlp invocations to it over a Unix
+ *  socket instead of spawning them.
+ *
+ *  A request is one message:
+ *
+ *    "YTP1 <timeout ms> <bytes>\n" <cwd> <argv[1..]>   (NUL-terminated strings)
+ *
+ *  with the client's stdin, stdout and stderr for the job attached as
+ *  SCM_RIGHTS. The daemon answers "+\n" once the job is running ("-\n"
+ *  when it can't take it, and the client spawns yt-dlp itself), then
+ *  "<exit code>\n" when it is over. Closing the connection cancels it.
+ *  Requests are read without blocking, alongside everything else; one
+ *  not complete within DAEMON_READ_MS is refused.
+ *  The descriptors go straight on to a warm worker, which dup2()s them
+ *  over 0-2 and calls yt_dlp.main(): output never passes through the
+ *  daemon — except for searches and -g, whose output it relays and
+ *  keeps in a shared in-memory cache (LRU, DAEMON_CACHE_MAX bytes;
+ *  searches for SCACHE_TTL, stream URLs until shortly before they
+ *  expire), so an identical request from any client is answered
+ *  without running anything. Searches are killed after SEARCH_TIMEOUT,
+ *  -g after RESOLVE_TIMEOUT.
+ *
+ *  The interpreter is the one on yt-dlp's #! line. If yt_dlp can't be
+ *  imported there (a frozen binary, say) the daemon spawns yt-dlp per
+ *  request and only the cache helps. With no daemon listening, clients
+ *  fall back to spawning directly after one failed connect().
+ *
+ *  The socket is $XDG_RUNTIME_DIR/ytplay.sock, or ytplay.sock in a
+ *  private /tmp/ytplay-<uid> directory.
+ */
+#ifndef PLATFORM_WINDOWS
+static const char WORKER_PY[] =
+    "import os,sys,socket,array\n"
+    "s=socket.socket(fileno=os.dup(0))\n"
+    "try:\n"
+    "    import yt_dlp\n"
+    "except Exception:\n"
+    "    os._exit(111)\n"
+    "try: s.sendall(b'r')\n"
+    "except OSError: pass\n"
+    "fds=array.array('i'); buf=b''\n"
+    "while b'\\n' not in buf or len(buf)<buf.index(b'\\n')+1+int(buf[:buf.index(b'\\n')]):\n"
+    "    m,anc,_,_=s.recvmsg(65536,socket.CMSG_SPACE(3*fds.itemsize))\n"
+    "    if not m: os._exit(112)\n"
+    "    buf+=m\n"
+    "    for l,t,d in anc:\n"
+    "        if l==socket.SOL_SOCKET and t==socket.SCM_RIGHTS: fds.frombytes(d[:len(d)-len(d)%fds.itemsize])\n"
+    "n=buf.index(b'\\n')\n"
+    "args=[a.decode('utf-8','surrogateescape') for a in buf[n+1:].split(b'\\0')[:-1]]\n"
+    "try: os.chdir(args.pop(0))\n"
+    "except OSError: pass\n"
+    "for i,f in enumerate(fds): os.dup2(f,i); os.close(f)\n"
+    "code=0\n"
+    "try: yt_dlp.main(args)\n"
+    "except SystemExit as e: code=e.code if isinstance(e.code,int) else (0 if e.code is None else 1)\n"
+    "except BaseException: code=1\n"
+    "try:\n"
+    "    sys.stdout.flush(); sys.stderr.flush()\n"
+    "except Exception: pass\n"
+    "os._exit(code)\n";
+
+static int daemon_path(char *out, size_t n) {
+    const char *rt=getenv("XDG_RUNTIME_DIR");
+    char dir[128];
+    struct stat st;
+    if (rt && *rt) return (size_t)snprintf(out,n,"%s/ytplay.sock",rt)<n;
+    snprintf(dir,sizeof(dir),"/tmp/ytplay-%lu",(unsigned long)getuid());
+    /* only a directory of ours that nobody else can write to */
+    if (lstat(dir,&st)==0 && (!S_ISDIR(st.st_mode) || st.st_uid!=getuid() || (st.st_mode&077))) return 0;
+    return (size_t)snprintf(out,n,"%s/ytplay.sock",dir)<n;
+}
+
+static int write_all(int fd, const void *d, size_t n) {
+    const char *p=(const char*)d;
+    while (n) {
+        ssize_t w=write(fd,p,n);
+        if (w<0 && errno==EINTR) continue;
+        if (w<=0) return -1;
+        p+=w; n-=(size_t)w;
+    }
+    return 0;
+}
+
+/* Send d with nfd (<= 3) descriptors attached to the first byte. */
+static int send_fds(int sock, const void *d, size_t n, const int *fds, int nfd) {
+    union { struct cmsghdr h; char b[CMSG_SPACE(3*sizeof(int))]; } u;
+    struct msghdr m;
+    struct iovec iov;
+    struct cmsghdr *h;
+    ssize_t r;
+    memset(&m,0,sizeof(m)); memset(&u,0,sizeof(u));
+    iov.iov_base=(void*)d; iov.iov_len=n;
+    m.msg_iov=&iov; m.msg_iovlen=1;
+    m.msg_control=u.b; m.msg_controllen=CMSG_SPACE((size_t)nfd*sizeof(int));
+    h=CMSG_FIRSTHDR(&m);
+    h->cmsg_level=SOL_SOCKET; h->cmsg_type=SCM_RIGHTS;
+    h->cmsg_len=CMSG_LEN((size_t)nfd*sizeof(int));
+    memcpy(CMSG_DATA(h),fds,(size_t)nfd*sizeof(int));
+    do r=sendmsg(sock,&m,0); while (r<0 && errno==EINTR);
+    if (r<0) return -1;
+    return write_all(sock,(const char*)d+r,n-(size_t)r);
+}
+
+static int daemon_connect(void) {
+    struct sockaddr_un sa;
+    int fd;
+    memset(&sa,0,sizeof(sa)); sa.sun_family=AF_UNIX;
+    if (!daemon_path(sa.sun_path,sizeof(sa.sun_path))) return -1;
+    if ((fd=socket(AF_UNIX,SOCK_STREAM,0))<0) return -1;
+    set_cloexec(fd);
+    if (connect(fd,(struct sockaddr*)&sa,sizeof(sa))!=0) { close(fd); return -1; }
+    return fd;
+}
+
+/* Next "\n"-terminated reply on a daemon connection into b; 0 on EOF/timeout. */
+static int daemon_reply(int fd, char *b, size_t n, int timeout_ms) {
+    size_t len=0;
+    for (;;) {
+        struct pollfd pf;
+        int r;
+        pf.fd=fd; pf.events=POLLIN; pf.revents=0;
+        r=poll(&pf,1,timeout_ms);
+        if (r<0 && errno==EINTR) { if (g_fg_sig) return 0; continue; }
+        if (r<=0) return 0;
+        ssize_t k=read(fd,b+len,1);             /* byte-wise: never eat the next reply */
+        if (k<0 && errno==EINTR) continue;
+        if (k<=0) return 0;
+        if (b[len]=='\n' || ++len==n-1) { b[len]='\0'; return 1; }
+    }
+}
+
+/* Client side of proc_spawn(): 0 if a daemon took the job. */
+static int daemon_spawn(Proc *p, const Argv *a, int flags) {
+    int fd, io[3], pfd[2]={-1,-1}, nul=-1, timeout=0, ok;
+    char hdr[64], ack[8], cwd[4096];
+    Buf req={0};
+    if (g_daemon<0) return -1;
+    if ((fd=daemon_connect())<0) { g_daemon=-1; return -1; }
+    if (flags&PROC_STDOUT_PIPE) {
+        if (pipe(pfd)!=0) { close(fd); return -1; }
+        set_cloexec(pfd[0]); set_cloexec(pfd[1]);
+    }
+    if (flags&(PROC_STDIN_NULL|PROC_STDOUT_NULL|PROC_STDERR_NULL)) nul=open(DEVNULL,O_RDWR|O_CLOEXEC);
+    io[0] = (flags&PROC_STDIN_NULL) ? nul : 0;
+    io[1] = pfd[1]>=0 ? pfd[1] : (flags&PROC_STDOUT_NULL) ? nul : 1;
+    io[2] = (pfd[1]>=0 && (flags&PROC_STDERR_OUT)) ? pfd[1] : (flags&PROC_STDERR_NULL) ? nul : 2;
+
+    for (int i=1; i<a->n; i++) {
+        if (!strcmp(a->v[i],"-g") || !strcmp(a->v[i],"--skip-download")) timeout=RESOLVE_TIMEOUT;
+        if (!strcmp(a->v[i],"--dump-json")) timeout=SEARCH_TIMEOUT;
+    }
+    if (!getcwd(cwd,sizeof(cwd))) snprintf(cwd,sizeof(cwd),"/");
+    buf_put(&req,cwd,strlen(cwd)+1);
+    for (int i=1; i<a->n; i++) buf_put(&req,a->v[i],strlen(a->v[i])+1);
+    int hn=snprintf(hdr,sizeof(hdr),"YTP1 %d %lu\n",timeout,(unsigned long)req.len);
+    Buf msg={0};
+    buf_put(&msg,hdr,(size_t)hn); buf_put(&msg,req.p,req.len);
+
+    fflush(stdout);
+    ok = send_fds(fd,msg.p,msg.len,io,3)==0;
+    free(msg.p); free(req.p);
+    if (pfd[1]>=0) close(pfd[1]);
+    if (nul>=0) close(nul);
+    if (ok) ok = daemon_reply(fd,ack,sizeof(ack),5000) ? (ack[0]=='+' ? 1 : 0) : -1;
+    if (ok<=0) {
+        if (ok<0) g_daemon=-1;                 /* gone or hung: stop asking */
+        close(fd);
+        if (pfd[0]>=0) close(pfd[0]);
+        return -1;
+    }
+    if (pfd[0]>=0) set_nonblock(pfd[0]);
+    p->out=pfd[0]; p->ctl=fd;
+    p->alive=1;
+    g_daemon=1;
+    return 0;
+}
+
+/* proc_wait() for a job running in the daemon. */
+static int daemon_wait(Proc *p, int timeout_ms) {
+    char b[32];
+    struct pollfd pf;
+    pf.fd=p->ctl; pf.events=POLLIN; pf.revents=0;
+    if (timeout_ms>=0) {
+        int r=poll(&pf,1,timeout_ms);
+        if (r==0 || (r<0 && !g_fg_sig)) return PROC_TIMEOUT;
+    }
+    if (!daemon_reply(p->ctl,b,sizeof(b),-1)) {
+        if (g_fg_sig) return proc_kill(p);     /* ^C under proc_run() */
+        b[0]='\0';
+    }
+    p->alive=0;
+    p->status = b[0] ? atoi(b) : -1;
+    return p->status;
+}
+
+/* ── server ── */
+
+typedef struct {
+    int    ctl;                 /* client connection, -1 once it hung up */
+    pid_t  pid;                 /* worker, 0 once reaped (or none: cache hit) */
+    int    rc;
+    int    out;                 /* relayed: client's stdout, -1 when done with it */
+    int    rd;                  /* relayed: worker's stdout, -1 at EOF */
+    Buf    data;                /* relayed: everything the worker printed */
+    size_t sent;
+    char  *key; size_t klen;    /* argv as sent, NUL-separated */
+    int    relay, hit, warm, timed_out;
+    long long t0, deadline, kill_at;
+} DJob;
+
+typedef struct {
+    char  *key; size_t klen;
+    unsigned char *data; size_t len;
+    long long expires, used;
+} DEntry;
+
+typedef struct { pid_t pid; int ctl; int ready; } Warm;
+
+typedef struct {                /* a connection whose request is still arriving */
+    int    fd, io[3], nio;
+    char  *buf; size_t got;     /* DCONN_BUF bytes, NUL-terminated */
+    long long deadline;
+} DConn;
+#define DCONN_BUF (65536+64)
+
+static DJob   g_djobs[DAEMON_MAX_JOBS];
+static int    g_ndjobs;
+static DEntry *g_dcache;
+static int    g_ndcache;
+static size_t g_dcache_bytes;
+static DConn  g_dconns[DAEMON_MAX_CONNS];
+static int    g_ndconns;
+static Warm   g_warm[DAEMON_WARM];
+static int    g_nwarm, g_pool_ok=1;
+static char   g_python[1024];
+static int    g_dpipe[2]={-1,-1};   /* SIGCHLD / SIGTERM self-pipe */
+static volatile sig_atomic_t g_dstop;
+
+static void on_dsig(int sig) {
+    int e=errno;
+    if (sig!=SIGCHLD) g_dstop=1;
+    if (write(g_dpipe[1],"x",1)<0) {}
+    errno=e;
+}
+
+/* Does a request (its argv, NUL-separated) contain the argument s? */
+static int key_has(const char *key, size_t klen, const char *s) {
+    for (size_t i=0; i<klen; i+=strlen(key+i)+1) if (!strcmp(key+i,s)) return 1;
+    return 0;
+}
+
+static DEntry *dcache_get(const char *key, size_t klen) {
+    long long now=(long long)time(NULL);
+    for (int i=0; i<g_ndcache; i++) {
+        DEntry *e=&g_dcache[i];
+        if (e->klen==klen && !memcmp(e->key,key,klen) && e->expires>now) { e->used=mono_ms(); return e; }
+    }
+    return NULL;
+}
+
+static void dcache_drop(int i) {
+    g_dcache_bytes -= g_dcache[i].len+g_dcache[i].klen;
+    free(g_dcache[i].key); free(g_dcache[i].data);
+    g_dcache[i]=g_dcache[--g_ndcache];
+}
+
+static void dcache_put(const char *key, size_t klen, const unsigned char *data, size_t len, long long expires) {
+    DEntry *e;
+    if (len+klen>DAEMON_CACHE_MAX/4) return;
+    for (int i=0; i<g_ndcache; i++)
+        if (g_dcache[i].klen==klen && !memcmp(g_dcache[i].key,key,klen)) { dcache_drop(i); break; }
+    while (g_ndcache && g_dcache_bytes+len+klen>DAEMON_CACHE_MAX) {
+        int lru=0;
+        for (int i=1; i<g_ndcache; i++) if (g_dcache[i].used<g_dcache[lru].used) lru=i;
+        dcache_drop(lru);
+    }
+    e=(DEntry*)realloc(g_dcache,(size_t)(g_ndcache+1)*sizeof(DEntry));
+    if (!e) return;
+    g_dcache=e; e=&g_dcache[g_ndcache];
+    e->key=(char*)malloc(klen); e->data=(unsigned char*)malloc(len ? len : 1);
+    if (!e->key || !e->data) { free(e->key); free(e->data); return; }
+    memcpy(e->key,key,klen); memcpy(e->data,data,len);
+    e->klen=klen; e->len=len; e->expires=expires; e->used=mono_ms();
+    g_ndcache++;
+    g_dcache_bytes+=len+klen;
+}
+
+/* How long a relayed job's output may be served again; 0: not at all. */
+static long long djob_expiry(DJob *j) {
+    if (j->rc!=0 || j->timed_out || !j->data.len) return 0;
+    if (key_has(j->key,j->klen,"--dump-json")) return (long long)time(NULL)+SCACHE_TTL;
+    StreamUrls u; u.n=0;
+    char *d=(char*)malloc(j->data.len+1), *cur=d, *line;
+    if (!d) return 0;
+    memcpy(d,j->data.p,j->data.len); d[j->data.len]='\0';
+    while ((line=next_line(&cur))) urls_add(&u,line,strlen(line));
+    free(d);
+    long long exp=urls_expiry(&u);
+    return exp ? exp-UCACHE_MARGIN : 0;
+}
+
+/* Start argv in cwd (if given) with io as its 0, 1, 2. fork: posix_spawn can't chdir. */
+static pid_t dspawn(char *const *argv, const int io[3], const char *cwd) {
+    pid_t pid=fork();
+    if (pid!=0) return pid;
+    for (int i=0; i<3; i++) dup2(io[i],i);
+    if (cwd && chdir(cwd)!=0) {}
+    signal(SIGPIPE,SIG_DFL);
+    execvp(argv[0],argv);
+    _exit(127);
+}
+
+static void warm_spawn(void) {
+    int sv[2], nul, io[3];
+    char *argv[]={g_python,(char*)"-c",(char*)WORKER_PY,NULL};
+    Warm *w;
+    if (!g_pool_ok || g_nwarm>=DAEMON_WARM) return;
+    if (socketpair(AF_UNIX,SOCK_STREAM,0,sv)!=0) return;
+    set_cloexec(sv[0]); set_cloexec(sv[1]);
+    nul=open(DEVNULL,O_RDWR|O_CLOEXEC);
+    io[0]=sv[1]; io[1]=nul; io[2]=nul;
+    w=&g_warm[g_nwarm];
+    w->pid=dspawn(argv,io,NULL);
+    close(sv[1]); close(nul);
+    if (w->pid<0) { close(sv[0]); g_pool_ok=0; return; }
+    w->ctl=sv[0]; w->ready=0;
+    g_nwarm++;
+}
+
+/* Hand a request to a warm worker (ready ones first). 0 if none could take it. */
+static pid_t warm_take(const char *cwd, const char *args, size_t len, const int io[3]) {
+    int k=-1;
+    for (int i=0; i<g_nwarm; i++) if (k<0 || (g_warm[i].ready && !g_warm[k].ready)) k=i;
+    if (k<0) return 0;
+    Warm w=g_warm[k];
+    g_warm[k]=g_warm[--g_nwarm];
+    char hdr[32];
+    int hn=snprintf(hdr,sizeof(hdr),"%lu\n",(unsigned long)(strlen(cwd)+1+len));
+    Buf msg={0};
+    buf_put(&msg,hdr,(size_t)hn); buf_put(&msg,cwd,strlen(cwd)+1); buf_put(&msg,args,len);
+    int ok=send_fds(w.ctl,msg.p,msg.len,io,3)==0;
+    free(msg.p);
+    close(w.ctl);
+    warm_spawn();
+    if (!ok) { kill(w.pid,SIGKILL); return 0; }     /* reaped with the rest */
+    return w.pid;
+}
+
+/* A new connection: its request is read as it arrives (dconn_read). */
+static void daemon_accept(int lfd) {
+    int cfd=accept(lfd,NULL,NULL);
+    DConn *k=&g_dconns[g_ndconns];
+    if (cfd<0) return;
+    set_cloexec(cfd); set_nonblock(cfd);
+    memset(k,0,sizeof(*k));
+    if (!(k->buf=(char*)malloc(DCONN_BUF))) { close(cfd); return; }
+    k->fd=cfd; k->io[0]=k->io[1]=k->io[2]=-1;
+    k->deadline=mono_ms()+DAEMON_READ_MS;
+    g_ndconns++;
+}
+
+/* Refuse connection i (cfd<0: it is already handed on) and drop it. */
+static void dconn_drop(int i, int refuse) {
+    DConn *k=&g_dconns[i];
+    for (int n=0; n<k->nio; n++) if (k->io[n]>=0) close(k->io[n]);
+    if (refuse) { write_all(k->fd,"-\n",2); close(k->fd); }
+    free(k->buf);
+    g_dconns[i]=g_dconns[--g_ndconns];
+}
+
+/* Start the job connection k asked for. 0 if it can't be taken. */
+static int daemon_start(DConn *k, int timeout, const char *req, unsigned long len) {
+    struct stat st;
+    int *io=k->io;
+    if (k->nio<3 || g_ndjobs==DAEMON_MAX_JOBS) return 0;
+
+    const char *cwd=req;
+    size_t cl=strnlen(cwd,len)+1;
+    if (cl>len) return 0;
+    len-=cl;
+    DJob *j=&g_djobs[g_ndjobs];
+    memset(j,0,sizeof(*j));
+    j->ctl=k->fd; j->out=-1; j->rd=-1;
+    j->klen=len;
+    j->key=(char*)malloc(len ? len : 1);
+    if (!j->key) return 0;
+    memcpy(j->key,cwd+cl,len);
+    /* searches and -g into a pipe are relayed; a terminal must stay blocking */
+    j->relay = (key_has(j->key,len,"-g") || key_has(j->key,len,"--dump-json"))
+            && fstat(io[1],&st)==0 && S_ISFIFO(st.st_mode);
+    j->t0=mono_ms();
+    if (timeout>0) j->deadline=j->t0+timeout;
+
+    DEntry *e = j->relay ? dcache_get(j->key,len) : NULL;
+    if (e) {
+        j->hit=1;
+        buf_put(&j->data,e->data,e->len);
+        j->out=io[1]; io[1]=-1;
+        set_nonblock(j->out);
+    } else {
+        int wio[3]={io[0],io[1],io[2]}, pfd[2]={-1,-1};
+        if (j->relay) {
+            if (pipe(pfd)!=0) { free(j->key); return 0; }
+            set_cloexec(pfd[0]); set_cloexec(pfd[1]);
+            wio[1]=pfd[1];
+        }
+        j->pid=warm_take(cwd,j->key,len,wio);
+        j->warm=j->pid>0;
+        if (!j->pid) {                           /* no pool: plain yt-dlp */
+            Argv a={0};
+            argv_add(&a,"yt-dlp");
+            for (size_t i=0; i<len; i+=strlen(j->key+i)+1) argv_add(&a,j->key+i);
+            j->pid=dspawn(a.v,wio,cwd);
+            argv_free(&a);
+        }
+        if (pfd[1]>=0) close(pfd[1]);
+        if (j->pid<=0) { if (pfd[0]>=0) close(pfd[0]); free(j->key); return 0; }
+        if (j->relay) { j->rd=pfd[0]; set_nonblock(j->rd); j->out=io[1]; io[1]=-1; set_nonblock(j->out); }
+    }
+    fcntl(k->fd,F_SETFL,fcntl(k->fd,F_GETFL)&~O_NONBLOCK);   /* the job's replies are blocking writes */
+    write_all(k->fd,"+\n",2);
+    g_ndjobs++;
+    return 1;
+}
+
+/*
+ *  Take what has arrived on connection i: the header and argv, with the
+ *  descriptors on the first chunk. Starts the job once it is all in;
+ *  a malformed request is refused.
+ */
+static void dconn_read(int i) {
+    DConn *k=&g_dconns[i];
+    union { struct cmsghdr h; char b[CMSG_SPACE(3*sizeof(int))]; } u;
+    struct msghdr m; struct iovec iov; struct cmsghdr *h;
+    unsigned long len;
+    int timeout;
+    char *nl;
+    ssize_t r;
+    memset(&m,0,sizeof(m));
+    iov.iov_base=k->buf+k->got; iov.iov_len=DCONN_BUF-1-k->got;
+    m.msg_iov=&iov; m.msg_iovlen=1;
+    m.msg_control=u.b; m.msg_controllen=sizeof(u.b);
+    r=recvmsg(k->fd,&m,0);
+    if (r<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)) return;
+    if (r<=0) { dconn_drop(i,1); return; }
+    for (h=CMSG_FIRSTHDR(&m); h; h=CMSG_NXTHDR(&m,h))
+        if (h->cmsg_level==SOL_SOCKET && h->cmsg_type==SCM_RIGHTS)
+            for (size_t n=0; n<(h->cmsg_len-CMSG_LEN(0))/sizeof(int); n++) {
+                int fd;
+                memcpy(&fd,CMSG_DATA(h)+n*sizeof(int),sizeof(int));
+                set_cloexec(fd);
+                if (k->nio<3) k->io[k->nio++]=fd; else close(fd);
+            }
+    k->got+=(size_t)r; k->buf[k->got]='\0';
+    if ((nl=strchr(k->buf,'\n')) && sscanf(k->buf,"YTP1 %d %lu",&timeout,&len)==2) {
+        if (len>DCONN_BUF-1-(size_t)(nl+1-k->buf)) { dconn_drop(i,1); return; }
+        if (k->got<(size_t)(nl+1-k->buf)+len) return;
+        int ok=daemon_start(k,timeout,nl+1,len);
+        dconn_drop(i,!ok);
+    } else if (nl || k->got==DCONN_BUF-1) dconn_drop(i,1);
+}
+
+/* Forward relayed output the client hasn't taken yet. */
+static void djob_flush(DJob *j) {
+    while (j->out>=0 && j->sent<j->data.len) {
+        ssize_t w=write(j->out,j->data.p+j->sent,j->data.len-j->sent);
+        if (w<0 && errno==EINTR) continue;
+        if (w<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) return;
+        if (w<=0) { close(j->out); j->out=-1; return; }   /* reader gone; keep collecting */
+        j->sent+=(size_t)w;
+    }
+    if (j->out>=0 && j->rd<0 && j->sent==j->data.len) { close(j->out); j->out=-1; }
+}
+
+static void djob_kill(DJob *j) {
+    if (j->pid<=0 || j->kill_at) return;
+    kill(j->pid,SIGTERM);
+    j->kill_at=mono_ms()+1000;
+}
+
+/* Report, cache and drop job i once its worker is reaped and output delivered. */
+static void djob_done(Config *c, int i) {
+    DJob *j=&g_djobs[i];
+    char b[16];
+    if (j->pid>0 || j->rd>=0 || j->out>=0) return;
+    if (j->ctl>=0) {
+        int n=snprintf(b,sizeof(b),"%d\n",j->timed_out ? -1 : j->rc);
+        write_all(j->ctl,b,(size_t)n);
+        close(j->ctl);
+    }
+    long long exp = j->relay && !j->hit ? djob_expiry(j) : 0;
+    if (exp) dcache_put(j->key,j->klen,j->data.p,j->data.len,exp);
+    if (!c->quiet) {
+        const char *what=j->key, *kind="run";
+        for (size_t k=0; k<j->klen; k+=strlen(j->key+k)+1) what=j->key+k;   /* last arg */
+        if (key_has(j->key,j->klen,"--dump-json")) kind="search";
+        else if (key_has(j->key,j->klen,"-g"))     kind="resolve";
+        printf("  %s%-7s %6lld ms  %-7s%s  %s%s%s\n",C_DIM,kind,mono_ms()-j->t0,
+               j->hit ? "cached" : j->warm ? "warm" : "spawned",C_RST,what,
+               j->timed_out ? "  (timed out)" : j->ctl<0 ? "  (cancelled)" : "",
+               j->rc && !j->timed_out && j->ctl>=0 ? "  (failed)" : "");
+        fflush(stdout);
+    }
+    free(j->key); free(j->data.p);
+    g_djobs[i]=g_djobs[--g_ndjobs];
+}
+
+static void daemon_reap(void) {
+    int st;
+    pid_t pid;
+    while ((pid=waitpid(-1,&st,WNOHANG))>0) {
+        int rc = WIFEXITED(st) ? WEXITSTATUS(st) : -1;
+        for (int i=0; i<g_nwarm; i++) {
+            if (g_warm[i].pid!=pid) continue;
+            close(g_warm[i].ctl);
+            g_warm[i]=g_warm[--g_nwarm];
+            if (rc==111 && g_pool_ok) {
+                g_pool_ok=0;
+                warn_msg("yt_dlp can't be imported by %s; running yt-dlp per request.",g_python);
+            } else warm_spawn();
+        }
+        for (int i=0; i<g_ndjobs; i++)
+            if (g_djobs[i].pid==pid) { g_djobs[i].pid=0; g_djobs[i].rc=rc; }
+    }
+}
+
+/* The interpreter from yt-dlp's #! line, "python3" if it has none. */
+static void daemon_python(const char *ytdlp, char *out, size_t n) {
+    char line[1024];
+    FILE *f=fopen(ytdlp,"r");
+    snprintf(out,n,"python3");
+    if (!f) return;
+    if (fgets(line,sizeof(line),f) && !strncmp(line,"#!",2)) {
+        char *s=line+2, *e;
+        s+=strspn(s," \t"); e=s+strcspn(s," \t\r\n");
+        if (e-s>=4 && !strncmp(e-4,"/env",4)) { s=e+strspn(e," \t"); e=s+strcspn(s," \t\r\n"); }
+        *e='\0';
+        if (strstr(s,"python")) snprintf(out,n,"%s",s);
+    }
+    fclose(f);
+}
+
+static int daemon_main(Config *c) {
+    struct sockaddr_un sa;
+    struct sigaction act;
+    char ytdlp[1024];
+    int lfd, probe;
+
+    g_daemon=-1;                                  /* our own spawns are direct */
+    if (!path_lookup("yt-dlp",ytdlp,sizeof(ytdlp),NULL)) die("yt-dlp not found.");
+    daemon_python(ytdlp,g_python,sizeof(g_python));
+
+    memset(&sa,0,sizeof(sa)); sa.sun_family=AF_UNIX;
+    if (!getenv("XDG_RUNTIME_DIR") || !*getenv("XDG_RUNTIME_DIR")) {
+        char dir[128];
+        snprintf(dir,sizeof(dir),"/tmp/ytplay-%lu",(unsigned long)getuid());
+        mkdir(dir,0700);
+    }
+    if (!daemon_path(sa.sun_path,sizeof(sa.sun_path))) die("No safe place for the daemon socket.");
+    if ((probe=daemon_connect())>=0) { close(probe); die("A daemon is already listening on %s",sa.sun_path); }
+    unlink(sa.sun_path);                          /* stale, from one that died */
+    if ((lfd=socket(AF_UNIX,SOCK_STREAM,0))<0) die("socket failed");
+    set_cloexec(lfd);
+    mode_t um=umask(077);
+    if (bind(lfd,(struct sockaddr*)&sa,sizeof(sa))!=0) die("Cannot bind %s: %s",sa.sun_path,strerror(errno));
+    umask(um);
+    if (listen(lfd,64)!=0) die("listen failed");
+
+    if (pipe(g_dpipe)!=0) die("pipe failed");
+    set_cloexec(g_dpipe[0]); set_cloexec(g_dpipe[1]);
+    set_nonblock(g_dpipe[0]); set_nonblock(g_dpipe[1]);
+    memset(&act,0,sizeof(act)); act.sa_handler=on_dsig;
+    sigaction(SIGCHLD,&act,NULL); sigaction(SIGINT,&act,NULL); sigaction(SIGTERM,&act,NULL);
+    act.sa_handler=SIG_IGN;
+    sigaction(SIGPIPE,&act,NULL);
+
+    for (int i=0; i<DAEMON_WARM; i++) warm_spawn();
+    if (!c->quiet) {
+        ok_msg("Daemon listening on %s",sa.sun_path);
+        info_msg("%d warm workers (%s), cache %d MB. Ctrl-C to stop.",DAEMON_WARM,g_python,DAEMON_CACHE_MAX>>20);
+        fflush(stdout);
+    }
+
+    while (!g_dstop) {
+        struct pollfd pf[2+DAEMON_WARM+DAEMON_MAX_CONNS+3*DAEMON_MAX_JOBS];
+        int nfd=0, timeout=-1, cbase;
+        long long now=mono_ms();
+        pf[nfd].fd=lfd;        pf[nfd++].events = g_ndjobs<DAEMON_MAX_JOBS && g_ndconns<DAEMON_MAX_CONNS ? POLLIN : 0;
+        pf[nfd].fd=g_dpipe[0]; pf[nfd++].events=POLLIN;
+        for (int i=0; i<g_nwarm; i++) { pf[nfd].fd=g_warm[i].ctl; pf[nfd++].events = g_warm[i].ready ? 0 : POLLIN; }
+        cbase=nfd;
+        for (int i=0; i<g_ndconns; i++) {
+            long long t=g_dconns[i].deadline;
+            pf[nfd].fd=g_dconns[i].fd; pf[nfd++].events=POLLIN;
+            if (timeout<0 || t-now<timeout) timeout = t>now ? (int)(t-now) : 0;
+        }
+        for (int i=0; i<g_ndjobs; i++) {
+            DJob *j=&g_djobs[i];
+            long long t = j->kill_at ? j->kill_at : j->pid>0 ? j->deadline : 0;
+            pf[nfd].fd=j->ctl; pf[nfd++].events = j->ctl>=0 ? POLLIN : 0;
+            pf[nfd].fd=j->rd;  pf[nfd++].events = POLLIN;
+            pf[nfd].fd=j->out; pf[nfd++].events = j->sent<j->data.len ? POLLOUT : 0;
+            if (t && (timeout<0 || t-now<timeout)) timeout = t>now ? (int)(t-now) : 0;
+        }
+        for (int i=0; i<nfd; i++) pf[i].revents=0;
+        if (poll(pf,(nfds_t)nfd,timeout)<0 && errno!=EINTR) die("poll failed");
+
+        for (int i=0; i<g_nwarm; i++)            /* before daemon_reap() reorders them */
+            if (pf[2+i].revents && !g_warm[i].ready) {
+                char b;
+                if (read(g_warm[i].ctl,&b,1)==1) g_warm[i].ready=1;
+            }
+        if (pf[1].revents) { char b[64]; while (read(g_dpipe[0],b,sizeof(b))>0) {} }
+        daemon_reap();
+        now=mono_ms();
+        int base=nfd-3*g_ndjobs;
+        for (int i=0; i<g_ndjobs; i++) {
+            DJob *j=&g_djobs[i];
+            struct pollfd *q=&pf[base+3*i];
+            if (q[0].revents) {                   /* a client only ever hangs up */
+                char b[16];
+                if (read(j->ctl,b,sizeof(b))<=0) { close(j->ctl); j->ctl=-1; djob_kill(j); }
+            }
+            if (q[1].revents) {
+                char b[65536];
+                ssize_t r=read(j->rd,b,sizeof(b));
+                if (r>0) buf_put(&j->data,b,(size_t)r);
+                else if (r==0 || (errno!=EAGAIN && errno!=EINTR)) { close(j->rd); j->rd=-1; }
+            }
+            djob_flush(j);
+            if (j->pid>0 && j->deadline && now>=j->deadline && !j->kill_at) { j->timed_out=1; djob_kill(j); }
+            if (j->pid>0 && j->kill_at && now>=j->kill_at) kill(j->pid,SIGKILL);
+        }
+        /* pf is stale from here on, bar the connections' (taken last to first) */
+        for (int i=g_ndjobs-1; i>=0; i--) djob_done(c,i);
+        for (int i=g_ndconns-1; i>=0; i--) {
+            if (pf[cbase+i].revents) dconn_read(i);
+            else if (now>=g_dconns[i].deadline) dconn_drop(i,1);
+        }
+        if (g_ndjobs<DAEMON_MAX_JOBS && g_ndconns<DAEMON_MAX_CONNS && (pf[0].revents&POLLIN)) daemon_accept(lfd);
     }
+
+    if (!c->quiet) info_msg("Stopping daemon.");
+    for (int i=0; i<g_ndjobs; i++) if (g_djobs[i].pid>0) kill(g_djobs[i].pid,SIGTERM);
+    for (int i=0; i<g_nwarm; i++) kill(g_warm[i].pid,SIGTERM);
+    unlink(sa.sun_path);
+    return 0;
 }
+#endif
 
 /* ─── main ───────────────────────────────────────────────────── */
 int main(int argc, char **argv) {
+    g_trace_t0=mono_us();
 #ifdef PLATFORM_WINDOWS
     HANDLE h=GetStdHandle(STD_OUTPUT_HANDLE); DWORD m=0;
     if (GetConsoleMode(h,&m)) SetConsoleMode(h,m|ENABLE_VIRTUAL_TERMINAL_PROCESSING);
@@ -596,33 +6736,82 @@ int main(int argc, char **argv) {
     Config c;
     config_defaults(&c);
     parse_args(argc, argv, &c);
+    if (c.batch[0]) { g_color=0; c.quiet=c.no_banner=1; }     /* stdout is data */
+    if (c.local) c.interactive=c.auto_quality=0;              /* nothing to search or probe online */
+    if (g_trace) { atexit(trace_finish); trace_span("args",0,g_trace_t0); }
+#ifndef PLATFORM_WINDOWS
+    lr_init(&g_stdin,STDIN_FILENO,256);
+#endif
 
     if (!c.no_banner && !c.quiet) print_banner();
 
-    if (!strlen(c.player)) detect_player(c.player,sizeof(c.player));
-    check_deps(&c);
+    if (c.daemon) {
+#ifndef PLATFORM_WINDOWS
+        return daemon_main(&c);
+#else
+        die("--daemon is not supported on Windows");
+#endif
+    }
+#ifndef PLATFORM_WINDOWS
+    if (c.no_daemon) g_daemon=-1;
+#endif
+
+    if (c.batch[0]) return batch_search(&c);
 
-    if (!c.quiet)
-        info_msg("Searching YouTube for: %s%s%s ...",C_BLD,c.query,C_RST);
+    long long t=trace_now();
+    check_deps(&c);
+    trace_span("check_deps",0,t);
+    if (c.warm) return warm_up(&c);
+    int decided=auto_quality(&c,NULL);
+    if (c.bulk) return bulk_download(&c);
+    if (c.queue[0]) {
+        queue_read(&c);
+        if (!decided) auto_quality(&c,&g_results[0]);
+        return play_queue(&c,0);
+    }
+    if (c.resume) {
+        int pos=queue_load();
+        if (pos<0) die("No interrupted queue to resume.");
+        info_msg("Resuming the queue at %d/%d",pos+1,g_nresults);
+        if (!decided) auto_quality(&c,&g_results[pos]);
+        return play_queue(&c,pos);
+    }
 
-    if (search_youtube(&c)==0)
-        die("No results found for '%s'\n"
-            "  Tip: run with -v to print the exact yt-dlp command.",c.query);
+    int choice=0;
+    if (c.interactive) {
+#ifndef PLATFORM_WINDOWS
+        c.direct_play=0;
+        choice=type_select(&c);
+#else
+        die("--interactive is not supported on Windows yet");
+#endif
+    } else {
+        if (!c.quiet)
+            info_msg("Searching %s for: %s%s%s ...",c.local?"the library":"YouTube",C_BLD,c.query,C_RST);
+        t=trace_now();
+        choice=select_result(&c);
+        trace_span("select",0,t);
+    }
+    if (!c.local && c.query[0]) hist_note(&c,NULL);
 
     if (c.direct_play) {
         ok_msg("Playing: %s%s%s",C_BLD,g_results[0].title,C_RST);
+        if (!decided) auto_quality(&c,&g_results[0]);
         return play_video(&c,&g_results[0]);
     }
 
-    print_results(&c);
-    int choice=prompt_choice();
     if (choice==0) { printf("\n  %sGoodbye!%s\n\n",C_CYN,C_RST); return 0; }
     if (choice<1||choice>g_nresults) die("Invalid choice: %d",choice);
+    if (queue_picked()) {
+        if (!decided) auto_quality(&c,&g_results[0]);
+        return play_queue(&c,0);
+    }
 
     VideoResult *sel=&g_results[choice-1];
+    if (!decided) auto_quality(&c,sel);
     printf("\n");
     ok_msg("Selected : %s%s%s", C_BLD, sel->title, C_RST);
-    ok_msg("Mode     : %s%s%s", C_GRN, c.stream?"Stream":"Download", C_RST);
+    ok_msg("Mode     : %s%s%s", C_GRN, c.local?"Library":c.stream?"Stream":"Download", C_RST);
     ok_msg("Quality  : %s%s%s", C_YLW, c.quality, C_RST);
     ok_msg("Player   : %s%s%s\n", C_MAG, c.player, C_RST);
 